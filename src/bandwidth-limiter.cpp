@@ -0,0 +1,273 @@
+/*
+* Copyright (C) 2026 The KDE Telepathy Team
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this library; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "bandwidth-limiter.h"
+#include "file-transfer-config.h"
+#include "ktp-fth-debug.h"
+
+#include <QMutexLocker>
+#include <QStringList>
+
+// Time of day profiles are checked at most this often, in ms
+static const qint64 ProfileCheckInterval = 1000;
+
+// Smallest burst allowed to a bucket, so that slow rates still move the data
+// in reasonably sized chunks
+static const qint64 MinimumBurst = 16 * 1024;
+
+// Bounds of the delay returned when a bucket is empty, in ms
+static const int MinimumDelay = 5;
+static const int MaximumDelay = 1000;
+
+static qint64 readRate(const QString &value, bool *ok)
+{
+    const qint64 rate = value.trimmed().toLongLong(ok);
+    if (*ok && rate < 0) {
+        *ok = false;
+    }
+    return rate * 1024;
+}
+
+void BandwidthLimiter::Bucket::setRate(qint64 newRate)
+{
+    if (rate != newRate) {
+        const bool wasUnlimited = rate == 0;
+        rate = newRate;
+        tokens = wasUnlimited ? burst() : qMin<double>(tokens, burst());
+    }
+}
+
+void BandwidthLimiter::Bucket::refill(qint64 now)
+{
+    if (rate > 0) {
+        tokens = qMin<double>(tokens + rate * (now - lastRefill) / 1000.0, burst());
+    }
+    lastRefill = now;
+}
+
+qint64 BandwidthLimiter::Bucket::burst() const
+{
+    // A quarter of a second worth of data
+    return qMax(rate / 4, MinimumBurst);
+}
+
+
+BandwidthLimiter *BandwidthLimiter::instance()
+{
+    static BandwidthLimiter limiter;
+    return &limiter;
+}
+
+BandwidthLimiter::BandwidthLimiter()
+    : m_nextId(1),
+      m_lastProfileCheck(-ProfileCheckInterval)
+{
+    m_defaultRates[Download] = 0;
+    m_defaultRates[Upload] = 0;
+    m_clock.start();
+    reloadConfiguration();
+}
+
+BandwidthLimiter::~BandwidthLimiter()
+{
+}
+
+void BandwidthLimiter::reloadConfiguration()
+{
+    const FileTransferConfig *config = FileTransferConfig::instance();
+
+    // Rates are given in KiB/s
+    const qint64 downloadRate = qint64(config->maxDownloadRate()) * 1024;
+    const qint64 uploadRate = qint64(config->maxUploadRate()) * 1024;
+
+    // contact=rate
+    QHash<QString, qint64> contactRates;
+    Q_FOREACH (const QString &entry, config->contactRateLimits()) {
+        const int separator = entry.lastIndexOf(QLatin1Char('='));
+        bool ok = separator > 0;
+        const qint64 rate = ok ? readRate(entry.mid(separator + 1), &ok) : 0;
+        if (!ok) {
+            qCWarning(KTP_FTH_MODULE) << "Invalid contact rate limit" << entry;
+            continue;
+        }
+        contactRates.insert(entry.left(separator).trimmed(), rate);
+    }
+
+    // HH:MM-HH:MM=download/upload
+    QList<Profile> profiles;
+    Q_FOREACH (const QString &entry, config->rateLimitProfiles()) {
+        const QStringList parts = entry.split(QLatin1Char('='));
+        const QStringList times = parts.first().split(QLatin1Char('-'));
+        const QStringList rates = parts.last().split(QLatin1Char('/'));
+        Profile profile;
+        bool ok = parts.size() == 2 && times.size() == 2 && rates.size() == 2;
+        if (ok) {
+            profile.from = QTime::fromString(times.at(0).trimmed(), QLatin1String("HH:mm"));
+            profile.to = QTime::fromString(times.at(1).trimmed(), QLatin1String("HH:mm"));
+            profile.rates[Download] = readRate(rates.at(0), &ok);
+            if (ok) {
+                profile.rates[Upload] = readRate(rates.at(1), &ok);
+            }
+            ok = ok && profile.from.isValid() && profile.to.isValid();
+        }
+        if (!ok) {
+            qCWarning(KTP_FTH_MODULE) << "Invalid rate limit profile" << entry;
+            continue;
+        }
+        profiles.append(profile);
+    }
+
+    QMutexLocker locker(&m_mutex);
+    m_defaultRates[Download] = downloadRate;
+    m_defaultRates[Upload] = uploadRate;
+    m_profiles = profiles;
+    m_contactRates = contactRates;
+
+    QHash<QString, Bucket>::iterator it = m_contacts.begin();
+    while (it != m_contacts.end()) {
+        if (m_contactRates.contains(it.key())) {
+            it->setRate(m_contactRates.value(it.key()));
+            ++it;
+        } else {
+            it = m_contacts.erase(it);
+        }
+    }
+
+    // Apply the new global rates now
+    m_lastProfileCheck = -ProfileCheckInterval;
+    updateGlobalRates(m_clock.elapsed());
+}
+
+bool BandwidthLimiter::isEnabled() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_defaultRates[Download] || m_defaultRates[Upload]
+        || !m_profiles.isEmpty() || !m_contactRates.isEmpty();
+}
+
+int BandwidthLimiter::addTransfer(Direction direction, const QString &contact)
+{
+    Transfer transfer;
+    transfer.direction = direction;
+    transfer.contact = contact;
+
+    QMutexLocker locker(&m_mutex);
+    const int id = m_nextId++;
+    m_transfers.insert(id, transfer);
+    return id;
+}
+
+void BandwidthLimiter::removeTransfer(int id)
+{
+    QMutexLocker locker(&m_mutex);
+    m_transfers.remove(id);
+}
+
+qint64 BandwidthLimiter::allowance(int id, qint64 wanted, int *delay)
+{
+    QMutexLocker locker(&m_mutex);
+    QHash<int, Transfer>::const_iterator transfer = m_transfers.constFind(id);
+    if (transfer == m_transfers.constEnd()) {
+        return wanted;
+    }
+
+    const qint64 now = m_clock.elapsed();
+    updateGlobalRates(now);
+
+    Bucket *buckets[2] = { &m_global[transfer->direction], contactBucket(transfer->contact) };
+    qint64 available = wanted;
+    for (int i = 0; i < 2; ++i) {
+        if (buckets[i] && buckets[i]->rate > 0) {
+            buckets[i]->refill(now);
+            available = qMin(available, qMax<qint64>(0, buckets[i]->tokens));
+        }
+    }
+
+    if (available == 0) {
+        // Wait until the emptiest bucket can give a useful amount of data
+        int wait = MinimumDelay;
+        for (int i = 0; i < 2; ++i) {
+            if (buckets[i] && buckets[i]->rate > 0) {
+                const double missing = qMin<double>(wanted, MinimumBurst) - buckets[i]->tokens;
+                wait = qMax(wait, int(missing * 1000 / buckets[i]->rate));
+            }
+        }
+        *delay = qMin(wait, MaximumDelay);
+    }
+    return available;
+}
+
+void BandwidthLimiter::consume(int id, qint64 bytes)
+{
+    QMutexLocker locker(&m_mutex);
+    QHash<int, Transfer>::const_iterator transfer = m_transfers.constFind(id);
+    if (transfer == m_transfers.constEnd()) {
+        return;
+    }
+
+    // Buckets may go negative when several transfers share them, the debt is
+    // paid back before any of them moves again.
+    Bucket *buckets[2] = { &m_global[transfer->direction], contactBucket(transfer->contact) };
+    for (int i = 0; i < 2; ++i) {
+        if (buckets[i] && buckets[i]->rate > 0) {
+            buckets[i]->tokens -= bytes;
+        }
+    }
+}
+
+void BandwidthLimiter::updateGlobalRates(qint64 now)
+{
+    if (now - m_lastProfileCheck < ProfileCheckInterval) {
+        return;
+    }
+    m_lastProfileCheck = now;
+
+    qint64 rates[2] = { m_defaultRates[Download], m_defaultRates[Upload] };
+    const QTime time = QTime::currentTime();
+    Q_FOREACH (const Profile &profile, m_profiles) {
+        const bool active = profile.from <= profile.to
+                          ? time >= profile.from && time < profile.to
+                          : time >= profile.from || time < profile.to; // Across midnight
+        if (active) {
+            rates[Download] = profile.rates[Download];
+            rates[Upload] = profile.rates[Upload];
+            break;
+        }
+    }
+
+    for (int i = 0; i < 2; ++i) {
+        m_global[i].refill(now);
+        m_global[i].setRate(rates[i]);
+    }
+}
+
+BandwidthLimiter::Bucket *BandwidthLimiter::contactBucket(const QString &contact)
+{
+    QHash<QString, qint64>::const_iterator rate = m_contactRates.constFind(contact);
+    if (rate == m_contactRates.constEnd()) {
+        return 0;
+    }
+
+    QHash<QString, Bucket>::iterator bucket = m_contacts.find(contact);
+    if (bucket == m_contacts.end()) {
+        bucket = m_contacts.insert(contact, Bucket());
+        bucket->lastRefill = m_clock.elapsed();
+        bucket->setRate(rate.value());
+    }
+    return &bucket.value();
+}
@@ -0,0 +1,112 @@
+/*
+* Copyright (C) 2026 The KDE Telepathy Team
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this library; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef BANDWIDTH_LIMITER_H
+#define BANDWIDTH_LIMITER_H
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QString>
+#include <QTime>
+
+/**
+ * Token buckets shared by all the transfers of the handler.
+ *
+ * There is a global bucket for each direction and a bucket for each contact,
+ * shared by all the transfers with that contact. The global rates can be
+ * overridden by time of day profiles. A transfer may move data only when
+ * all its buckets have tokens left; the transfer engines stop reading from
+ * or writing to the socket until then, so nothing is buffered.
+ *
+ * allowance(), consume() and delay() can be called from any thread.
+ */
+class BandwidthLimiter
+{
+    Q_DISABLE_COPY(BandwidthLimiter)
+
+public:
+    enum Direction {
+        Download,
+        Upload
+    };
+
+    static BandwidthLimiter *instance();
+
+    /** Reads the limits from the "File Transfers" group of ktelepathyrc */
+    void reloadConfiguration();
+    /** True if any limit is configured */
+    bool isEnabled() const;
+
+    /** Returns the id used by the transfer engine in the other calls */
+    int addTransfer(Direction direction, const QString &contact);
+    void removeTransfer(int id);
+
+    /**
+     * Returns how many bytes transfer \p id may move now, at most \p wanted.
+     * If it returns 0, \p delay is set to the number of milliseconds after
+     * which it is worth asking again.
+     */
+    qint64 allowance(int id, qint64 wanted, int *delay);
+    /** Takes \p bytes moved by transfer \p id from its buckets */
+    void consume(int id, qint64 bytes);
+
+private:
+    struct Bucket {
+        Bucket() : rate(0), tokens(0), lastRefill(0) {}
+
+        qint64 rate;  // bytes per second, 0 means unlimited
+        double tokens;
+        qint64 lastRefill;
+
+        void setRate(qint64 newRate);
+        void refill(qint64 now);
+        qint64 burst() const;
+    };
+
+    struct Profile {
+        QTime from;
+        QTime to;
+        qint64 rates[2];
+    };
+
+    struct Transfer {
+        Direction direction;
+        QString contact;
+    };
+
+    BandwidthLimiter();
+    ~BandwidthLimiter();
+
+    void updateGlobalRates(qint64 now);
+    Bucket *contactBucket(const QString &contact);
+
+    mutable QMutex m_mutex;
+    QElapsedTimer m_clock;
+    int m_nextId;
+    qint64 m_defaultRates[2];
+    QList<Profile> m_profiles;
+    qint64 m_lastProfileCheck;
+    QHash<QString, qint64> m_contactRates;
+    Bucket m_global[2];
+    QHash<QString, Bucket> m_contacts;
+    QHash<int, Transfer> m_transfers;
+};
+
+#endif // BANDWIDTH_LIMITER_H
@@ -0,0 +1,124 @@
+/*
+* Copyright (C) 2026 The KDE Telepathy Team
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this library; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "buffer-pool.h"
+#include "ktp-fth-debug.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+
+// Free buffers kept in the shared list, the others are freed
+static const int MaxSharedBuffers = 64;
+
+BufferPool *BufferPool::instance()
+{
+    static BufferPool pool;
+    return &pool;
+}
+
+BufferPool::BufferPool()
+    : m_alignment(qMax<long>(4096, ::sysconf(_SC_PAGESIZE)))
+{
+}
+
+BufferPool::~BufferPool()
+{
+    Q_FOREACH (char *buffer, m_shared) {
+        ::free(buffer);
+    }
+}
+
+char *BufferPool::acquire()
+{
+    const int inUse = m_inUse.fetchAndAddRelaxed(1) + 1;
+    int peak = m_peakInUse.loadAcquire();
+    while (inUse > peak && !m_peakInUse.testAndSetOrdered(peak, inUse, peak)) {
+    }
+
+    {
+        QMutexLocker locker(&m_mutex);
+        if (!m_shared.isEmpty()) {
+            m_hits.fetchAndAddRelaxed(1);
+            return m_shared.takeLast();
+        }
+    }
+
+    m_misses.fetchAndAddRelaxed(1);
+    return allocate();
+}
+
+void BufferPool::release(char *buffer)
+{
+    if (!buffer) {
+        return;
+    }
+    m_inUse.fetchAndAddRelaxed(-1);
+
+    {
+        QMutexLocker locker(&m_mutex);
+        if (m_shared.size() < MaxSharedBuffers) {
+            m_shared.append(buffer);
+            return;
+        }
+    }
+    deallocate(buffer);
+}
+
+void BufferPool::trim()
+{
+    QVector<char*> buffers;
+    {
+        QMutexLocker locker(&m_mutex);
+        buffers.swap(m_shared);
+    }
+
+    Q_FOREACH (char *buffer, buffers) {
+        deallocate(buffer);
+    }
+    if (!buffers.isEmpty()) {
+        qCDebug(KTP_FTH_MODULE) << "Freed" << buffers.size() << "transfer buffers";
+    }
+}
+
+QVariantMap BufferPool::statistics() const
+{
+    QVariantMap statistics;
+    statistics.insert(QLatin1String("bufferSize"), BufferSize);
+    statistics.insert(QLatin1String("hits"), m_hits.load());
+    statistics.insert(QLatin1String("misses"), m_misses.load());
+    statistics.insert(QLatin1String("inUse"), m_inUse.load());
+    statistics.insert(QLatin1String("peakInUse"), m_peakInUse.load());
+    statistics.insert(QLatin1String("allocated"), m_allocated.load());
+    return statistics;
+}
+
+char *BufferPool::allocate()
+{
+    void *buffer = 0;
+    if (::posix_memalign(&buffer, m_alignment, BufferSize) != 0) {
+        qFatal("Unable to allocate a transfer buffer");
+    }
+    m_allocated.fetchAndAddRelaxed(1);
+    return static_cast<char*>(buffer);
+}
+
+void BufferPool::deallocate(char *buffer)
+{
+    m_allocated.fetchAndAddRelaxed(-1);
+    ::free(buffer);
+}
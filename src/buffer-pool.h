@@ -0,0 +1,78 @@
+/*
+* Copyright (C) 2026 The KDE Telepathy Team
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this library; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include <QAtomicInteger>
+#include <QMutex>
+#include <QVector>
+#include <QVariantMap>
+
+/**
+ * Shared pool of the fixed size, page aligned buffers used to move the data
+ * of the transfers, so that a long running handler does not allocate and
+ * free a buffer for every chunk.
+ *
+ * Free buffers go back to a single shared list, trimmed by trim(). Buffers
+ * are often released by another thread than the one that acquired them
+ * (e.g. the write-behind chunks), so they are not cached per thread.
+ * acquire() and release() can be called from any thread; the lock is taken
+ * once per buffer, which is negligible next to the data moved.
+ */
+class BufferPool
+{
+    Q_DISABLE_COPY(BufferPool)
+
+public:
+    /** Size of every buffer, a multiple of the page size */
+    static const int BufferSize = 256 * 1024;
+
+    static BufferPool *instance();
+
+    /** Never fails, the buffer is uninitialized */
+    char *acquire();
+    void release(char *buffer);
+
+    /** Frees all the free buffers */
+    void trim();
+
+    /**
+     * hits and misses of acquire(), and the number of buffers inUse,
+     * peakInUse and allocated
+     */
+    QVariantMap statistics() const;
+
+private:
+    BufferPool();
+    ~BufferPool();
+
+    char *allocate();
+    void deallocate(char *buffer);
+
+    size_t m_alignment;
+    mutable QMutex m_mutex;
+    QVector<char*> m_shared;
+    QAtomicInteger<quint64> m_hits;
+    QAtomicInteger<quint64> m_misses;
+    QAtomicInt m_inUse;
+    QAtomicInt m_peakInUse;
+    QAtomicInt m_allocated;
+};
+
+#endif // BUFFER_POOL_H
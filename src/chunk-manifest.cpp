@@ -0,0 +1,409 @@
+/*
+* Copyright (C) 2026 The KDE Telepathy Team
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this library; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "chunk-manifest.h"
+#include "buffer-pool.h"
+#include "ktp-fth-debug.h"
+
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDateTime>
+#include <QFile>
+#include <QFileInfo>
+#include <QFutureWatcher>
+#include <QVector>
+#include <QtConcurrentMap>
+
+#include <TelepathyQt/Contact>
+#include <TelepathyQt/IncomingFileTransferChannel>
+
+#include <zlib.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char ManifestMagic[8] = { 'K', 'T', 'p', 'C', 'h', 'u', 'n', 'k' };
+static const quint32 ManifestVersion = 1;
+
+// Chunks recorded between two flushes of the .part file
+static const qint64 SyncInterval = 64;
+
+const qint64 ChunkManifest::ChunkSize;
+
+struct ManifestHeader
+{
+    char magic[8];
+    quint32 version;
+    quint32 chunkSize;
+    quint64 syncedChunks;
+    char identity[32];
+};
+
+static const qint64 HeaderSize = sizeof(ManifestHeader);
+
+static bool readFully(int fd, char *data, qint64 size, qint64 position)
+{
+    while (size > 0) {
+        const ssize_t count = ::pread(fd, data, size, position);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            return false;
+        }
+        data += count;
+        size -= count;
+        position += count;
+    }
+    return true;
+}
+
+static bool writeFully(int fd, const char *data, qint64 size, qint64 position)
+{
+    while (size > 0) {
+        const ssize_t count = ::pwrite(fd, data, size, position);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count < 0) {
+            return false;
+        }
+        data += count;
+        size -= count;
+        position += count;
+    }
+    return true;
+}
+
+static bool readHeader(int fd, ManifestHeader *header)
+{
+    return readFully(fd, reinterpret_cast<char*>(header), HeaderSize, 0)
+        && memcmp(header->magic, ManifestMagic, sizeof(ManifestMagic)) == 0
+        && header->version == ManifestVersion
+        && header->chunkSize == ChunkManifest::ChunkSize;
+}
+
+ChunkManifest::ChunkManifest(int fd)
+    : m_fd(::dup(fd)),
+      m_manifestFd(-1),
+      m_position(0),
+      m_crc(::crc32(0, Z_NULL, 0)),
+      m_syncedChunks(0),
+      m_broken(false)
+{
+}
+
+ChunkManifest::~ChunkManifest()
+{
+    if (m_manifestFd >= 0) {
+        ::close(m_manifestFd);
+    }
+    if (m_fd >= 0) {
+        ::close(m_fd);
+    }
+}
+
+QString ChunkManifest::fileName(const QString &partFileName)
+{
+    return partFileName + QLatin1String(".manifest");
+}
+
+QByteArray ChunkManifest::identity(const Tp::IncomingFileTransferChannelPtr &channel)
+{
+    QByteArray data;
+    QDataStream stream(&data, QIODevice::WriteOnly);
+    stream << channel->fileName()
+           << quint64(channel->size())
+           << channel->lastModificationTime().toMSecsSinceEpoch()
+           << (channel->targetContact() ? channel->targetContact()->id() : QString())
+           << quint32(channel->contentHashType())
+           << channel->contentHash();
+    return QCryptographicHash::hash(data, QCryptographicHash::Sha256);
+}
+
+void ChunkManifest::remove(const QString &partFileName)
+{
+    QFile::remove(fileName(partFileName));
+}
+
+bool ChunkManifest::open(const QString &partFileName, const QByteArray &identity, qint64 keep)
+{
+    QMutexLocker locker(&m_mutex);
+
+    m_manifestFd = ::open(QFile::encodeName(fileName(partFileName)).constData(),
+                          O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (m_manifestFd < 0 || m_fd < 0) {
+        qCWarning(KTP_FTH_MODULE) << "Unable to open the manifest of" << partFileName << "-" << strerror(errno);
+        return false;
+    }
+
+    ManifestHeader header;
+    if (keep > 0 && readHeader(m_manifestFd, &header)
+            && memcmp(header.identity, identity.constData(), sizeof(header.identity)) == 0) {
+        const qint64 chunks = keep / ChunkSize;
+        if (::ftruncate(m_manifestFd, HeaderSize + chunks * sizeof(quint32)) < 0) {
+            return false;
+        }
+        m_position = chunks * ChunkSize;
+        m_syncedChunks = qMin<qint64>(header.syncedChunks, chunks);
+        return true;
+    }
+
+    // Start a new manifest, the data already in the .part file is read back
+    // when the first data is written
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, ManifestMagic, sizeof(ManifestMagic));
+    header.version = ManifestVersion;
+    header.chunkSize = ChunkSize;
+    header.syncedChunks = 0;
+    memcpy(header.identity, identity.constData(), qMin<int>(identity.size(), sizeof(header.identity)));
+    return ::ftruncate(m_manifestFd, 0) == 0
+        && writeFully(m_manifestFd, reinterpret_cast<const char*>(&header), HeaderSize, 0);
+}
+
+void ChunkManifest::setPosition(qint64 position)
+{
+    QMutexLocker locker(&m_mutex);
+    if (position < m_position) {
+        rewind(position);
+    }
+}
+
+void ChunkManifest::addData(qint64 position, const char *data, qint64 size)
+{
+    QMutexLocker locker(&m_mutex);
+    if (position < m_position) {
+        rewind(position);
+    }
+    if (position > m_position) {
+        catchUp(position);
+    }
+    if (!m_broken) {
+        consume(data, size);
+    }
+}
+
+void ChunkManifest::dataWritten(qint64 end)
+{
+    QMutexLocker locker(&m_mutex);
+    if (end < m_position) {
+        rewind(end);
+    }
+    catchUp(end);
+}
+
+void ChunkManifest::catchUp(qint64 end)
+{
+    if (m_broken || m_position >= end) {
+        return;
+    }
+
+    char *buffer = BufferPool::instance()->acquire();
+    while (!m_broken && m_position < end) {
+        const qint64 count = qMin<qint64>(BufferPool::BufferSize, end - m_position);
+        if (!readFully(m_fd, buffer, count, m_position)) {
+            qCWarning(KTP_FTH_MODULE) << "Unable to read back the data at" << m_position << "- not updating the manifest";
+            m_broken = true;
+            break;
+        }
+        consume(buffer, count);
+    }
+    BufferPool::instance()->release(buffer);
+}
+
+void ChunkManifest::consume(const char *data, qint64 size)
+{
+    while (size > 0 && !m_broken) {
+        const qint64 count = qMin(size, ChunkSize - m_position % ChunkSize);
+        m_crc = ::crc32(m_crc, reinterpret_cast<const Bytef*>(data), count);
+        m_position += count;
+        data += count;
+        size -= count;
+
+        if (m_position % ChunkSize != 0) {
+            continue;
+        }
+
+        const qint64 index = m_position / ChunkSize - 1;
+        const quint32 crc = m_crc;
+        m_crc = ::crc32(0, Z_NULL, 0);
+        if (!writeFully(m_manifestFd, reinterpret_cast<const char*>(&crc), sizeof(crc),
+                        HeaderSize + index * sizeof(quint32))) {
+            m_broken = true;
+            return;
+        }
+
+        if (index + 1 - m_syncedChunks >= SyncInterval && ::fdatasync(m_fd) == 0) {
+            m_syncedChunks = index + 1;
+            const quint64 synced = m_syncedChunks;
+            writeFully(m_manifestFd, reinterpret_cast<const char*>(&synced), sizeof(synced),
+                       offsetof(ManifestHeader, syncedChunks));
+        }
+    }
+}
+
+void ChunkManifest::rewind(qint64 position)
+{
+    const qint64 chunks = position / ChunkSize;
+    if (::ftruncate(m_manifestFd, HeaderSize + chunks * sizeof(quint32)) < 0) {
+        m_broken = true;
+        return;
+    }
+    m_position = chunks * ChunkSize;
+    m_crc = ::crc32(0, Z_NULL, 0);
+    if (m_syncedChunks > chunks) {
+        m_syncedChunks = chunks;
+        const quint64 synced = m_syncedChunks;
+        writeFully(m_manifestFd, reinterpret_cast<const char*>(&synced), sizeof(synced),
+                   offsetof(ManifestHeader, syncedChunks));
+    }
+}
+
+
+namespace {
+
+struct ChunkCheck
+{
+    int fd;
+    qint64 index;
+    quint32 crc;
+};
+
+bool checkChunk(const ChunkCheck &chunk)
+{
+    char *buffer = BufferPool::instance()->acquire();
+    uLong crc = ::crc32(0, Z_NULL, 0);
+    bool ok = true;
+    for (qint64 done = 0; ok && done < ChunkManifest::ChunkSize; done += BufferPool::BufferSize) {
+        ok = readFully(chunk.fd, buffer, BufferPool::BufferSize, chunk.index * ChunkManifest::ChunkSize + done);
+        if (ok) {
+            crc = ::crc32(crc, reinterpret_cast<const Bytef*>(buffer), BufferPool::BufferSize);
+        }
+    }
+    BufferPool::instance()->release(buffer);
+    return ok && quint32(crc) == chunk.crc;
+}
+
+}
+
+PartFileValidator::PartFileValidator(QObject *parent)
+    : QObject(parent),
+      m_fd(-1),
+      m_firstChecked(0),
+      m_watcher(0)
+{
+}
+
+PartFileValidator::~PartFileValidator()
+{
+    if (m_watcher) {
+        m_watcher->cancel();
+        m_watcher->waitForFinished();
+    }
+    if (m_fd >= 0) {
+        ::close(m_fd);
+    }
+}
+
+void PartFileValidator::start(const QString &partFileName, const QByteArray &identity)
+{
+    m_partFileName = partFileName;
+
+    const int manifestFd = ::open(QFile::encodeName(ChunkManifest::fileName(partFileName)).constData(),
+                                  O_RDONLY | O_CLOEXEC);
+    if (manifestFd < 0) {
+        finish(NoManifest, QFileInfo(partFileName).size());
+        return;
+    }
+
+    ManifestHeader header;
+    struct stat manifestStat;
+    struct stat partStat;
+    m_fd = ::open(QFile::encodeName(partFileName).constData(), O_RDONLY | O_CLOEXEC);
+    if (m_fd < 0 || ::fstat(m_fd, &partStat) < 0 || ::fstat(manifestFd, &manifestStat) < 0
+            || !readHeader(manifestFd, &header)
+            || memcmp(header.identity, identity.constData(), sizeof(header.identity)) != 0) {
+        ::close(manifestFd);
+        finish(IdentityMismatch, 0);
+        return;
+    }
+
+    // Only complete chunks can be checked, a partial one at the end is dropped
+    const qint64 recorded = (manifestStat.st_size - HeaderSize) / qint64(sizeof(quint32));
+    const qint64 complete = qMin<qint64>(recorded, partStat.st_size / ChunkManifest::ChunkSize);
+    m_firstChecked = qMin<qint64>(header.syncedChunks, complete);
+
+    QVector<ChunkCheck> chunks;
+    chunks.reserve(complete - m_firstChecked);
+    for (qint64 index = m_firstChecked; index < complete; ++index) {
+        ChunkCheck chunk;
+        chunk.fd = m_fd;
+        chunk.index = index;
+        if (!readFully(manifestFd, reinterpret_cast<char*>(&chunk.crc), sizeof(chunk.crc),
+                       HeaderSize + index * sizeof(quint32))) {
+            break;
+        }
+        chunks.append(chunk);
+    }
+    ::close(manifestFd);
+
+    qCDebug(KTP_FTH_MODULE) << "Checking" << chunks.size() << "chunks of" << partFileName
+                            << "-" << m_firstChecked << "chunks already on disk";
+    if (chunks.isEmpty()) {
+        finish(Valid, m_firstChecked * ChunkManifest::ChunkSize);
+        return;
+    }
+
+    m_watcher = new QFutureWatcher<bool>(this);
+    connect(m_watcher, SIGNAL(finished()), SLOT(onChunksChecked()));
+    m_watcher->setFuture(QtConcurrent::mapped(chunks, checkChunk));
+}
+
+void PartFileValidator::onChunksChecked()
+{
+    const QFuture<bool> future = m_watcher->future();
+    qint64 valid = m_firstChecked;
+    for (int i = 0; i < future.resultCount() && future.resultAt(i); ++i) {
+        ++valid;
+    }
+    m_watcher->deleteLater();
+    m_watcher = 0;
+    finish(Valid, valid * ChunkManifest::ChunkSize);
+}
+
+void PartFileValidator::finish(Result result, qint64 validLength)
+{
+    if (m_fd >= 0) {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+
+    if (result == Valid && ::truncate(QFile::encodeName(m_partFileName).constData(), validLength) < 0) {
+        qCWarning(KTP_FTH_MODULE) << "Unable to truncate" << m_partFileName << "-" << strerror(errno);
+    }
+
+    // Always asynchronous, the caller may not be ready yet
+    QMetaObject::invokeMethod(this, "finished", Qt::QueuedConnection,
+                              Q_ARG(int, result), Q_ARG(qint64, validLength));
+}
+
+#include "moc_chunk-manifest.cpp"
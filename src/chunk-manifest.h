@@ -0,0 +1,133 @@
+/*
+* Copyright (C) 2026 The KDE Telepathy Team
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this library; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef CHUNK_MANIFEST_H
+#define CHUNK_MANIFEST_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QMutex>
+#include <QString>
+
+#include <TelepathyQt/Types>
+
+template <typename T> class QFutureWatcher;
+
+/**
+ * Sidecar of a .part file, named like it with a .manifest suffix, holding the
+ * CRC32 of every complete 4 MiB chunk received and the identity of the remote
+ * file. It lets a resumed transfer check that the .part file belongs to the
+ * same remote file and drop a corrupted tail, see PartFileValidator.
+ *
+ * Chunks are recorded after they were written, by the thread writing the
+ * data. Every 64 chunks the .part file is flushed to disk and the number of
+ * chunks flushed is saved in the manifest; those chunks are not read again
+ * when resuming, only the ones after them.
+ *
+ * The methods can be called from any thread, one at a time.
+ */
+class ChunkManifest
+{
+    Q_DISABLE_COPY(ChunkManifest)
+
+public:
+    static const qint64 ChunkSize = 4 * 1024 * 1024;
+
+    /** The part file descriptor is duplicated */
+    explicit ChunkManifest(int fd);
+    ~ChunkManifest();
+
+    static QString fileName(const QString &partFileName);
+    /** Identity of the remote file sent on \p channel */
+    static QByteArray identity(const Tp::IncomingFileTransferChannelPtr &channel);
+    static void remove(const QString &partFileName);
+
+    /**
+     * Opens the manifest of \p partFileName, keeping the chunks recorded
+     * before \p keep if \p keep is not 0, starting a new one otherwise.
+     */
+    bool open(const QString &partFileName, const QByteArray &identity, qint64 keep);
+
+    /** The next data is going to be written at \p position */
+    void setPosition(qint64 position);
+
+    /** \p size bytes of \p data were written at \p position */
+    void addData(qint64 position, const char *data, qint64 size);
+    /**
+     * Data was written up to \p end without going through userspace, it is
+     * read back from the file.
+     */
+    void dataWritten(qint64 end);
+
+private:
+    void catchUp(qint64 end);
+    void consume(const char *data, qint64 size);
+    void rewind(qint64 position);
+
+    QMutex m_mutex;
+    int m_fd;
+    int m_manifestFd;
+    // Bytes covered by the recorded chunks and by m_crc
+    qint64 m_position;
+    quint32 m_crc;
+    qint64 m_syncedChunks;
+    bool m_broken;
+};
+
+
+/**
+ * Checks a .part file against its manifest before resuming it. The chunks
+ * not yet known to be on disk are verified in parallel on all the cores.
+ * The .part file is truncated to the last good chunk.
+ */
+class PartFileValidator : public QObject
+{
+    Q_OBJECT
+    Q_DISABLE_COPY(PartFileValidator)
+
+public:
+    enum Result {
+        /** There is no manifest, the .part file cannot be checked */
+        NoManifest,
+        /** The .part file belongs to a different remote file */
+        IdentityMismatch,
+        /** The .part file is valid up to the length reported */
+        Valid
+    };
+
+    explicit PartFileValidator(QObject *parent = 0);
+    virtual ~PartFileValidator();
+
+    void start(const QString &partFileName, const QByteArray &identity);
+
+Q_SIGNALS:
+    void finished(int result, qint64 validLength);
+
+private Q_SLOTS:
+    void onChunksChecked();
+
+private:
+    void finish(Result result, qint64 validLength);
+
+    QString m_partFileName;
+    int m_fd;
+    qint64 m_firstChecked;
+    QFutureWatcher<bool> *m_watcher;
+};
+
+#endif // CHUNK_MANIFEST_H
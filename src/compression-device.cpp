@@ -0,0 +1,339 @@
+/*
+* Copyright (C) 2026 The KDE Telepathy Team
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this library; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "compression-device.h"
+#include "buffer-pool.h"
+#include "ktp-fth-debug.h"
+
+#include <QDBusArgument>
+#include <QStringList>
+
+#include <TelepathyQt/Constants>
+#include <TelepathyQt/Contact>
+#include <TelepathyQt/ContactCapabilities>
+#include <TelepathyQt/FileTransferChannel>
+
+#include <string.h>
+
+// Amount of data read from the source or produced for the sink at once
+static const int ChunkSize = BufferPool::BufferSize;
+
+// Size of the sample used to decide whether the data is worth compressing
+static const int SampleSize = 64 * 1024;
+
+// The sample must shrink at least to this ratio to be compressed
+static const double MaximumCompressionRatio = 0.9;
+
+// Metadata.ServiceName of the handler filter advertised by the receivers
+static const char DeflateServiceName[] = "org.kde.Telepathy.FileTransfer.Deflate";
+
+static Tp::Metadata channelMetadata(const Tp::FileTransferChannelPtr &channel)
+{
+    const QVariant value = channel->immutableProperties().value(
+        TP_QT_IFACE_CHANNEL_INTERFACE_FILE_TRANSFER_METADATA + QLatin1String(".Metadata"));
+    if (!value.isValid()) {
+        return Tp::Metadata();
+    }
+    return qdbus_cast<Tp::Metadata>(value);
+}
+
+bool TransferCompression::isCompressed(const Tp::FileTransferChannelPtr &channel)
+{
+    return channelMetadata(channel).value(QLatin1String("x-ktp-compression")).contains(QLatin1String("deflate"));
+}
+
+qulonglong TransferCompression::fileSize(const Tp::FileTransferChannelPtr &channel)
+{
+    if (!isCompressed(channel)) {
+        return channel->size();
+    }
+
+    const QStringList values = channelMetadata(channel).value(QLatin1String("x-ktp-uncompressed-size"));
+    bool ok = false;
+    const qulonglong size = values.isEmpty() ? 0 : values.first().toULongLong(&ok);
+    return ok ? size : Q_UINT64_C(0xFFFFFFFFFFFFFFFF);
+}
+
+Tp::ChannelClassSpec TransferCompression::receiverFilter()
+{
+    Tp::ChannelClassSpec filter = Tp::ChannelClassSpec::incomingFileTransfer();
+    filter.setProperty(TP_QT_IFACE_CHANNEL_INTERFACE_FILE_TRANSFER_METADATA + QLatin1String(".ServiceName"),
+                       QString::fromLatin1(DeflateServiceName));
+    return filter;
+}
+
+bool TransferCompression::isSupportedBy(const Tp::ContactPtr &contact)
+{
+    if (!contact) {
+        return false;
+    }
+
+    const QString serviceName = TP_QT_IFACE_CHANNEL_INTERFACE_FILE_TRANSFER_METADATA + QLatin1String(".ServiceName");
+    Q_FOREACH (const Tp::RequestableChannelClassSpec &spec, contact->capabilities().allClassSpecs()) {
+        if (spec.channelType() == TP_QT_IFACE_CHANNEL_TYPE_FILE_TRANSFER
+                && spec.fixedProperties().value(serviceName).toString() == QLatin1String(DeflateServiceName)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+DeflateReader::DeflateReader(QIODevice *source, QObject *parent)
+    : QIODevice(parent),
+      m_source(source),
+      m_input(0),
+      m_read(0),
+      m_initialized(false),
+      m_inputEnd(false),
+      m_streamEnd(false)
+{
+    memset(&m_stream, 0, sizeof(m_stream));
+}
+
+DeflateReader::~DeflateReader()
+{
+    close();
+}
+
+bool DeflateReader::open(OpenMode mode)
+{
+    if ((mode & ReadWrite) != ReadOnly) {
+        setErrorString(QLatin1String("DeflateReader is read-only"));
+        return false;
+    }
+
+    // Sample the beginning of the data with the fastest level
+    int level = Z_DEFAULT_COMPRESSION;
+    const QByteArray sample = m_source->peek(SampleSize);
+    if (!sample.isEmpty()) {
+        QByteArray compressed(compressBound(sample.size()), Qt::Uninitialized);
+        uLongf compressedSize = compressed.size();
+        if (compress2(reinterpret_cast<Bytef*>(compressed.data()), &compressedSize,
+                      reinterpret_cast<const Bytef*>(sample.constData()), sample.size(), 1) == Z_OK
+                && compressedSize > sample.size() * MaximumCompressionRatio) {
+            level = Z_NO_COMPRESSION;
+        }
+    }
+    qCDebug(KTP_FTH_MODULE) << "Compressing with level" << level;
+
+    if (deflateInit(&m_stream, level) != Z_OK) {
+        setErrorString(QString::fromLatin1(m_stream.msg ? m_stream.msg : "Unable to initialize compression"));
+        return false;
+    }
+    m_initialized = true;
+    m_input = BufferPool::instance()->acquire();
+
+    return QIODevice::open(mode | Unbuffered);
+}
+
+void DeflateReader::close()
+{
+    if (m_initialized) {
+        deflateEnd(&m_stream);
+        m_initialized = false;
+    }
+    BufferPool::instance()->release(m_input);
+    m_input = 0;
+    QIODevice::close();
+}
+
+bool DeflateReader::isSequential() const
+{
+    return true;
+}
+
+bool DeflateReader::atEnd() const
+{
+    return m_streamEnd;
+}
+
+qint64 DeflateReader::bytesAvailable() const
+{
+    // The compressed size is not known in advance, more data can be produced
+    // as long as the stream is not finished.
+    return m_streamEnd ? 0 : ChunkSize;
+}
+
+qulonglong DeflateReader::uncompressedPosition() const
+{
+    return m_read - m_stream.avail_in;
+}
+
+qint64 DeflateReader::readData(char *data, qint64 maxSize)
+{
+    if (m_streamEnd) {
+        return -1;
+    }
+
+    m_stream.next_out = reinterpret_cast<Bytef*>(data);
+    m_stream.avail_out = qMin<qint64>(maxSize, ChunkSize);
+    const uInt requested = m_stream.avail_out;
+
+    while (m_stream.avail_out > 0 && !m_streamEnd) {
+        if (m_stream.avail_in == 0 && !m_inputEnd) {
+            const qint64 read = m_source->read(m_input, ChunkSize);
+            if (read < 0) {
+                setErrorString(m_source->errorString());
+                return -1;
+            }
+            m_inputEnd = read == 0;
+            m_read += read;
+            m_stream.next_in = reinterpret_cast<Bytef*>(m_input);
+            m_stream.avail_in = read;
+        }
+
+        const int result = deflate(&m_stream, m_inputEnd ? Z_FINISH : Z_NO_FLUSH);
+        if (result == Z_STREAM_END) {
+            m_streamEnd = true;
+        } else if (result != Z_OK && result != Z_BUF_ERROR) {
+            setErrorString(QString::fromLatin1(m_stream.msg ? m_stream.msg : "Compression failed"));
+            return -1;
+        }
+    }
+
+    return requested - m_stream.avail_out;
+}
+
+qint64 DeflateReader::writeData(const char *data, qint64 maxSize)
+{
+    Q_UNUSED(data);
+    Q_UNUSED(maxSize);
+    return -1;
+}
+
+
+InflateWriter::InflateWriter(QIODevice *sink, QObject *parent)
+    : QIODevice(parent),
+      m_sink(sink),
+      m_output(0),
+      m_written(0),
+      m_initialized(false),
+      m_streamEnd(false)
+{
+    memset(&m_stream, 0, sizeof(m_stream));
+}
+
+InflateWriter::~InflateWriter()
+{
+    close();
+}
+
+bool InflateWriter::open(OpenMode mode)
+{
+    if ((mode & ReadWrite) != WriteOnly) {
+        setErrorString(QLatin1String("InflateWriter is write-only"));
+        return false;
+    }
+
+    if (inflateInit(&m_stream) != Z_OK) {
+        setErrorString(QString::fromLatin1(m_stream.msg ? m_stream.msg : "Unable to initialize decompression"));
+        return false;
+    }
+    m_initialized = true;
+    m_output = BufferPool::instance()->acquire();
+
+    return QIODevice::open(mode | Unbuffered);
+}
+
+void InflateWriter::close()
+{
+    if (m_initialized) {
+        inflateEnd(&m_stream);
+        m_initialized = false;
+    }
+    BufferPool::instance()->release(m_output);
+    m_output = 0;
+    QIODevice::close();
+}
+
+bool InflateWriter::isSequential() const
+{
+    return true;
+}
+
+qulonglong InflateWriter::uncompressedPosition() const
+{
+    return m_written;
+}
+
+bool InflateWriter::isFinished() const
+{
+    return m_streamEnd;
+}
+
+qint64 InflateWriter::readData(char *data, qint64 maxSize)
+{
+    Q_UNUSED(data);
+    Q_UNUSED(maxSize);
+    return -1;
+}
+
+qint64 InflateWriter::writeData(const char *data, qint64 maxSize)
+{
+    if (m_streamEnd) {
+        setFailed(QLatin1String("Unexpected data after the end of the compressed stream"));
+        return -1;
+    }
+
+    m_stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+    m_stream.avail_in = maxSize;
+
+    // Keep going while there is input, or while the output buffer was filled
+    // and more data might be pending inside zlib
+    do {
+        m_stream.next_out = reinterpret_cast<Bytef*>(m_output);
+        m_stream.avail_out = ChunkSize;
+
+        const int result = inflate(&m_stream, Z_NO_FLUSH);
+        if (result != Z_OK && result != Z_STREAM_END && result != Z_BUF_ERROR) {
+            setFailed(QString::fromLatin1(m_stream.msg ? m_stream.msg : "Corrupted compressed data"));
+            return -1;
+        }
+
+        const qint64 produced = ChunkSize - m_stream.avail_out;
+        if (produced > 0 && m_sink->write(m_output, produced) != produced) {
+            setFailed(m_sink->errorString());
+            return -1;
+        }
+        m_written += produced;
+
+        if (result == Z_STREAM_END) {
+            m_streamEnd = true;
+            if (m_stream.avail_in > 0) {
+                setFailed(QLatin1String("Unexpected data after the end of the compressed stream"));
+                return -1;
+            }
+            Q_EMIT finished();
+            break;
+        }
+        if (result == Z_BUF_ERROR && produced == 0) {
+            break;
+        }
+    } while (m_stream.avail_in > 0 || m_stream.avail_out == 0);
+
+    return maxSize;
+}
+
+void InflateWriter::setFailed(const QString &errorMessage)
+{
+    setErrorString(errorMessage);
+    Q_EMIT writeFailed(errorMessage);
+}
+
+#include "moc_compression-device.cpp"
@@ -0,0 +1,152 @@
+/*
+* Copyright (C) 2026 The KDE Telepathy Team
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this library; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef COMPRESSION_DEVICE_H
+#define COMPRESSION_DEVICE_H
+
+#include <QIODevice>
+#include <QByteArray>
+
+#include <TelepathyQt/ChannelClassSpec>
+#include <TelepathyQt/Types>
+
+#include <zlib.h>
+
+/**
+ * On the fly compression of the transferred data.
+ *
+ * Receivers able to uncompress the data advertise the handler filter
+ * returned by receiverFilter(), which appears in their contact capabilities.
+ * Only then may the requester set the x-ktp-compression key of the channel
+ * Metadata (FileTransfer.Metadata interface) to "deflate"; the handler
+ * refuses to send compressed data to other contacts, which would save the
+ * zlib stream as it is.
+ *
+ * The data on the socket is then a zlib stream. As for any channel, the Size
+ * is the number of bytes on the socket, i.e. the length of the zlib stream,
+ * or unknown; connection managers stop at Size. The size of the file, when
+ * known, is given with the x-ktp-uncompressed-size key. Compressed transfers
+ * cannot be resumed.
+ */
+class TransferCompression
+{
+public:
+    /** True if the data of \p channel is compressed */
+    static bool isCompressed(const Tp::FileTransferChannelPtr &channel);
+
+    /**
+     * Size of the file received on \p channel once uncompressed, the Size of
+     * the channel if it is not compressed. UINT64_MAX if unknown.
+     */
+    static qulonglong fileSize(const Tp::FileTransferChannelPtr &channel);
+
+    /** Handler filter of the receivers able to uncompress the data */
+    static Tp::ChannelClassSpec receiverFilter();
+    /** True if \p contact advertises receiverFilter() */
+    static bool isSupportedBy(const Tp::ContactPtr &contact);
+};
+
+
+/**
+ * Read-only sequential device returning the compressed content of the
+ * source device. The first block of the source is sampled when the device
+ * is opened: data that does not compress, e.g. media files or archives, is
+ * sent in stored blocks instead of being compressed again.
+ *
+ * The source must be open and is not owned by the device.
+ */
+class DeflateReader : public QIODevice
+{
+    Q_OBJECT
+    Q_DISABLE_COPY(DeflateReader)
+
+public:
+    explicit DeflateReader(QIODevice *source, QObject *parent = 0);
+    virtual ~DeflateReader();
+
+    virtual bool open(OpenMode mode);
+    virtual void close();
+    virtual bool isSequential() const;
+    virtual bool atEnd() const;
+    virtual qint64 bytesAvailable() const;
+
+    /** Amount of the source consumed so far */
+    qulonglong uncompressedPosition() const;
+
+protected:
+    virtual qint64 readData(char *data, qint64 maxSize);
+    virtual qint64 writeData(const char *data, qint64 maxSize);
+
+private:
+    QIODevice *m_source;
+    z_stream m_stream;
+    // From the BufferPool, while the device is open
+    char *m_input;
+    qulonglong m_read;
+    bool m_initialized;
+    bool m_inputEnd;
+    bool m_streamEnd;
+};
+
+
+/**
+ * Write-only sequential device uncompressing the data written to it into the
+ * sink device. finished() is emitted when the end of the compressed stream
+ * is reached, writeFailed() when the data is corrupted or the sink cannot be
+ * written.
+ *
+ * The sink must be open and is not owned by the device.
+ */
+class InflateWriter : public QIODevice
+{
+    Q_OBJECT
+    Q_DISABLE_COPY(InflateWriter)
+
+public:
+    explicit InflateWriter(QIODevice *sink, QObject *parent = 0);
+    virtual ~InflateWriter();
+
+    virtual bool open(OpenMode mode);
+    virtual void close();
+    virtual bool isSequential() const;
+
+    /** Amount of uncompressed data written to the sink so far */
+    qulonglong uncompressedPosition() const;
+    bool isFinished() const;
+
+Q_SIGNALS:
+    void finished();
+    void writeFailed(const QString &errorMessage);
+
+protected:
+    virtual qint64 readData(char *data, qint64 maxSize);
+    virtual qint64 writeData(const char *data, qint64 maxSize);
+
+private:
+    void setFailed(const QString &errorMessage);
+
+    QIODevice *m_sink;
+    z_stream m_stream;
+    // From the BufferPool, while the device is open
+    char *m_output;
+    qulonglong m_written;
+    bool m_initialized;
+    bool m_streamEnd;
+};
+
+#endif // COMPRESSION_DEVICE_H
@@ -0,0 +1,58 @@
+/*
+* Copyright (C) 2026 The KDE Telepathy Team
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this library; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "conflict-resolver.h"
+#include "file-transfer-config.h"
+#include "ktp-fth-debug.h"
+
+#include <kio/global.h>
+
+ConflictResolver::Action ConflictResolver::parse(const QString &policy, Action defaultAction)
+{
+    if (policy == QLatin1String("overwrite")) {
+        return Overwrite;
+    } else if (policy == QLatin1String("rename")) {
+        return Rename;
+    } else if (policy == QLatin1String("resume")) {
+        return Resume;
+    } else if (policy == QLatin1String("skip")) {
+        return Skip;
+    }
+
+    qCWarning(KTP_FTH_MODULE) << "Unknown conflict policy" << policy;
+    return defaultAction;
+}
+
+ConflictResolver::Action ConflictResolver::existingFileAction()
+{
+    const Action action = parse(FileTransferConfig::instance()->existingFilePolicy(), Rename);
+    return action == Resume ? Rename : action;
+}
+
+ConflictResolver::Action ConflictResolver::partialFileAction()
+{
+    return parse(FileTransferConfig::instance()->partialFilePolicy(), Resume);
+}
+
+QUrl ConflictResolver::uniqueUrl(const QUrl &url)
+{
+    const QUrl directory = url.adjusted(QUrl::RemoveFilename);
+    QUrl result = url;
+    result.setPath(directory.path() + KIO::suggestName(directory, url.fileName()));
+    return result;
+}
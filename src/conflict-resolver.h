@@ -0,0 +1,52 @@
+/*
+* Copyright (C) 2026 The KDE Telepathy Team
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this library; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef CONFLICT_RESOLVER_H
+#define CONFLICT_RESOLVER_H
+
+#include <QString>
+#include <QUrl>
+
+/**
+ * Decides what to do with an incoming file when a file with the same name
+ * or a .part file already exists, from the existingFilePolicy and
+ * partialFilePolicy configuration entries. Used instead of the dialogs when
+ * running headless.
+ */
+class ConflictResolver
+{
+public:
+    enum Action {
+        Overwrite,
+        Rename,
+        Resume,
+        Skip
+    };
+
+    /** Never Resume, a complete file cannot be resumed */
+    static Action existingFileAction();
+    static Action partialFileAction();
+
+    /** \p url with a file name not used in its directory yet */
+    static QUrl uniqueUrl(const QUrl &url);
+
+private:
+    static Action parse(const QString &policy, Action defaultAction);
+};
+
+#endif // CONFLICT_RESOLVER_H
@@ -0,0 +1,329 @@
+/*
+* Copyright (C) 2026 The KDE Telepathy Team
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this library; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "content-hash-cache.h"
+#include "buffer-pool.h"
+#include "ktp-fth-debug.h"
+
+#include <QCoreApplication>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDBusConnection>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QRunnable>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QThread>
+#include <QThreadPool>
+#include <QTimer>
+
+#include <TelepathyQt/Constants>
+
+#include <algorithm>
+
+#include <sys/stat.h>
+
+// Bumped when the format of the cache file changes
+static const quint32 CacheVersion = 1;
+
+// Number of hashes kept, the ones not used for the longest time are dropped
+static const int MaxEntries = 4096;
+
+// Delay before writing the cache after a change, in ms
+static const int SaveDelay = 5000;
+
+class ContentHashCache::HashTask : public QRunnable
+{
+public:
+    HashTask(ContentHashCache *cache, const QString &path, const Key &key,
+             QCryptographicHash::Algorithm algorithm)
+        : m_cache(cache),
+          m_path(path),
+          m_key(key),
+          m_algorithm(algorithm)
+    {
+    }
+
+    virtual void run();
+
+private:
+    ContentHashCache *m_cache;
+    QString m_path;
+    Key m_key;
+    QCryptographicHash::Algorithm m_algorithm;
+};
+
+void ContentHashCache::HashTask::run()
+{
+    Result result;
+    result.path = m_path;
+    result.key = m_key;
+
+    QFile file(m_path);
+    if (file.open(QIODevice::ReadOnly)) {
+        QCryptographicHash hash(m_algorithm);
+        char *buffer = BufferPool::instance()->acquire();
+        qint64 count;
+        while (!m_cache->m_stopping.load() && (count = file.read(buffer, BufferPool::BufferSize)) > 0) {
+            hash.addData(buffer, count);
+        }
+        BufferPool::instance()->release(buffer);
+
+        // Discard the hash if the file changed while it was read
+        Key after;
+        if (!m_cache->m_stopping.load() && count == 0 && file.pos() == m_key.size
+                && makeKey(m_path, m_key.hashType, &after) && after == m_key) {
+            result.hash = hash.result();
+        }
+    }
+
+    QMutexLocker locker(&m_cache->m_mutex);
+    m_cache->m_results.append(result);
+    if (m_cache->m_results.size() == 1) {
+        QMetaObject::invokeMethod(m_cache, "onHashesComputed", Qt::QueuedConnection);
+    }
+}
+
+ContentHashCache *ContentHashCache::instance()
+{
+    static ContentHashCache *cache = 0;
+    if (!cache) {
+        cache = new ContentHashCache(qApp);
+    }
+    return cache;
+}
+
+ContentHashCache::ContentHashCache(QObject *parent)
+    : QObject(parent),
+      m_dirty(false),
+      m_saveTimer(new QTimer(this)),
+      m_pool(new QThreadPool(this)),
+      m_stopping(0)
+{
+    m_fileName = QStandardPaths::writableLocation(QStandardPaths::CacheLocation)
+               + QLatin1String("/content-hashes");
+
+    m_saveTimer->setSingleShot(true);
+    m_saveTimer->setInterval(SaveDelay);
+    connect(m_saveTimer, SIGNAL(timeout()), SLOT(save()));
+
+    // Hashing is CPU bound once the file is in the page cache
+    m_pool->setMaxThreadCount(qMax(1, QThread::idealThreadCount()));
+
+    load();
+}
+
+ContentHashCache::~ContentHashCache()
+{
+    m_stopping.store(1);
+    m_pool->waitForDone();
+    if (m_dirty) {
+        save();
+    }
+}
+
+bool ContentHashCache::registerObject()
+{
+    if (!QDBusConnection::sessionBus().registerObject(QLatin1String("/org/kde/KTp/FileTransferHandler/ContentHashes"),
+                                                      this,
+                                                      QDBusConnection::ExportScriptableSlots
+                                                    | QDBusConnection::ExportScriptableSignals)) {
+        qCWarning(KTP_FTH_MODULE) << "Unable to export the content hash cache on the session bus";
+        return false;
+    }
+    return true;
+}
+
+bool ContentHashCache::makeKey(const QString &path, uint hashType, Key *key)
+{
+    struct stat st;
+    if (::stat(QFile::encodeName(path).constData(), &st) < 0 || !S_ISREG(st.st_mode)) {
+        return false;
+    }
+
+    key->device = st.st_dev;
+    key->inode = st.st_ino;
+    key->size = st.st_size;
+    key->mtime = qint64(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+    key->hashType = hashType;
+    return true;
+}
+
+bool ContentHashCache::algorithm(uint hashType, QCryptographicHash::Algorithm *algorithm)
+{
+    switch (hashType) {
+    case Tp::FileHashTypeMD5:
+        *algorithm = QCryptographicHash::Md5;
+        return true;
+    case Tp::FileHashTypeSHA1:
+        *algorithm = QCryptographicHash::Sha1;
+        return true;
+    case Tp::FileHashTypeSHA256:
+        *algorithm = QCryptographicHash::Sha256;
+        return true;
+    default:
+        return false;
+    }
+}
+
+QString ContentHashCache::lookup(const QString &path, uint hashType)
+{
+    QCryptographicHash::Algorithm hashAlgorithm;
+    if (!algorithm(hashType, &hashAlgorithm)) {
+        qCWarning(KTP_FTH_MODULE) << "Unsupported hash type" << hashType;
+        return QString();
+    }
+
+    Key key;
+    if (!makeKey(path, hashType, &key)) {
+        return QString();
+    }
+
+    QHash<Key, Entry>::iterator it = m_entries.find(key);
+    if (it != m_entries.end()) {
+        it->lastUsed = QDateTime::currentMSecsSinceEpoch() / 1000;
+        scheduleSave();
+        return QString::fromLatin1(it->hash.toHex());
+    }
+
+    if (!m_pending.contains(key)) {
+        qCDebug(KTP_FTH_MODULE) << "Hashing" << path;
+        m_pending.insert(key);
+        m_pool->start(new HashTask(this, path, key, hashAlgorithm));
+    }
+    return QString();
+}
+
+QString ContentHashCache::contentHash(const QString &path, uint hashType)
+{
+    return lookup(path, hashType);
+}
+
+void ContentHashCache::precompute(const QStringList &paths, uint hashType)
+{
+    Q_FOREACH (const QString &path, paths) {
+        lookup(path, hashType);
+    }
+}
+
+void ContentHashCache::onHashesComputed()
+{
+    QList<Result> results;
+    {
+        QMutexLocker locker(&m_mutex);
+        results.swap(m_results);
+    }
+
+    const qint64 now = QDateTime::currentMSecsSinceEpoch() / 1000;
+    Q_FOREACH (const Result &result, results) {
+        m_pending.remove(result.key);
+        if (result.hash.isEmpty()) {
+            qCDebug(KTP_FTH_MODULE) << "Unable to hash" << result.path;
+            continue;
+        }
+
+        Entry entry;
+        entry.hash = result.hash;
+        entry.lastUsed = now;
+        m_entries.insert(result.key, entry);
+        scheduleSave();
+
+        Q_EMIT contentHashReady(result.path, result.key.hashType, QString::fromLatin1(result.hash.toHex()));
+    }
+}
+
+void ContentHashCache::load()
+{
+    QFile file(m_fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return;
+    }
+
+    QDataStream stream(&file);
+    quint32 version;
+    quint32 count;
+    stream >> version >> count;
+    if (version != CacheVersion) {
+        qCDebug(KTP_FTH_MODULE) << "Ignoring content hash cache version" << version;
+        return;
+    }
+
+    for (quint32 i = 0; i < count && stream.status() == QDataStream::Ok; ++i) {
+        Key key;
+        Entry entry;
+        stream >> key.device >> key.inode >> key.size >> key.mtime >> key.hashType
+               >> entry.hash >> entry.lastUsed;
+        if (stream.status() == QDataStream::Ok) {
+            m_entries.insert(key, entry);
+        }
+    }
+    qCDebug(KTP_FTH_MODULE) << "Loaded" << m_entries.size() << "content hashes";
+}
+
+void ContentHashCache::scheduleSave()
+{
+    m_dirty = true;
+    if (!m_saveTimer->isActive()) {
+        m_saveTimer->start();
+    }
+}
+
+void ContentHashCache::save()
+{
+    m_dirty = false;
+
+    if (m_entries.size() > MaxEntries) {
+        QList<qint64> ages;
+        Q_FOREACH (const Entry &entry, m_entries) {
+            ages.append(entry.lastUsed);
+        }
+        std::nth_element(ages.begin(), ages.begin() + (ages.size() - MaxEntries), ages.end());
+        const qint64 oldest = ages.at(ages.size() - MaxEntries);
+        QHash<Key, Entry>::iterator it = m_entries.begin();
+        while (it != m_entries.end()) {
+            if (it->lastUsed < oldest) {
+                it = m_entries.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    QDir().mkpath(QFileInfo(m_fileName).absolutePath());
+    QSaveFile file(m_fileName);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qCWarning(KTP_FTH_MODULE) << "Unable to save the content hash cache:" << file.errorString();
+        return;
+    }
+
+    QDataStream stream(&file);
+    stream << CacheVersion << quint32(m_entries.size());
+    QHash<Key, Entry>::const_iterator it = m_entries.constBegin();
+    for (; it != m_entries.constEnd(); ++it) {
+        const Key &key = it.key();
+        stream << key.device << key.inode << key.size << key.mtime << key.hashType
+               << it->hash << it->lastUsed;
+    }
+    if (!file.commit()) {
+        qCWarning(KTP_FTH_MODULE) << "Unable to save the content hash cache:" << file.errorString();
+    }
+}
+
+#include "moc_content-hash-cache.cpp"
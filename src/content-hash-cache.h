@@ -0,0 +1,138 @@
+/*
+* Copyright (C) 2026 The KDE Telepathy Team
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this library; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef CONTENT_HASH_CACHE_H
+#define CONTENT_HASH_CACHE_H
+
+#include <QObject>
+#include <QCryptographicHash>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QSet>
+#include <QStringList>
+
+class QThreadPool;
+class QTimer;
+
+/**
+ * Persistent cache of the content hashes of the files sent, exported on the
+ * session bus on the object /org/kde/KTp/FileTransferHandler/ContentHashes.
+ *
+ * Hashes are keyed by device, inode, size and modification time of the
+ * file, therefore a file that is sent again is not hashed again unless it
+ * changed. Missing hashes are computed in the background, several files in
+ * parallel, and the result is announced with contentHashReady().
+ *
+ * The hash of an outgoing channel is set by the requester when the channel
+ * is created, so the handler cannot announce it for the transfer that
+ * triggered the computation. Requesters can ask for the hash here before
+ * creating the channel.
+ *
+ * Hash types are the values of Tp::FileHashType.
+ */
+class ContentHashCache : public QObject
+{
+    Q_OBJECT
+    Q_CLASSINFO("D-Bus Interface", "org.kde.KTp.FileTransferHandler.ContentHashes")
+    Q_DISABLE_COPY(ContentHashCache)
+
+public:
+    static ContentHashCache *instance();
+
+    /** Exports the cache on the session bus */
+    bool registerObject();
+
+    /**
+     * Returns the hash of \p path if it is known and the file did not change,
+     * otherwise schedules its computation and returns an empty string.
+     */
+    QString lookup(const QString &path, uint hashType);
+
+public Q_SLOTS:
+    /** Hex encoded hash of \p path, or an empty string while it is computed */
+    Q_SCRIPTABLE QString contentHash(const QString &path, uint hashType);
+    /** Computes the missing hashes of \p paths in the background */
+    Q_SCRIPTABLE void precompute(const QStringList &paths, uint hashType);
+
+Q_SIGNALS:
+    Q_SCRIPTABLE void contentHashReady(const QString &path, uint hashType, const QString &hash);
+
+private Q_SLOTS:
+    void onHashesComputed();
+    void save();
+
+private:
+    struct Key
+    {
+        quint64 device;
+        quint64 inode;
+        qint64 size;
+        qint64 mtime;
+        uint hashType;
+
+        bool operator==(const Key &other) const
+        {
+            return device == other.device && inode == other.inode && size == other.size
+                && mtime == other.mtime && hashType == other.hashType;
+        }
+
+        friend uint qHash(const Key &key)
+        {
+            return ::qHash(key.inode) ^ ::qHash(key.device) ^ ::qHash(key.mtime) ^ key.hashType;
+        }
+    };
+
+    struct Entry
+    {
+        QByteArray hash;
+        qint64 lastUsed;
+    };
+
+    struct Result
+    {
+        QString path;
+        Key key;
+        QByteArray hash;
+    };
+
+    class HashTask;
+
+    explicit ContentHashCache(QObject *parent = 0);
+    virtual ~ContentHashCache();
+
+    static bool makeKey(const QString &path, uint hashType, Key *key);
+    static bool algorithm(uint hashType, QCryptographicHash::Algorithm *algorithm);
+
+    void load();
+    void scheduleSave();
+
+    QString m_fileName;
+    QHash<Key, Entry> m_entries;
+    // Only used by the main thread
+    QSet<Key> m_pending;
+    bool m_dirty;
+    QTimer *m_saveTimer;
+    QThreadPool *m_pool;
+    // Results of the tasks, collected by the main thread
+    QMutex m_mutex;
+    QList<Result> m_results;
+    QAtomicInt m_stopping;
+};
+
+#endif // CONTENT_HASH_CACHE_H
@@ -0,0 +1,174 @@
+/*
+* Copyright (C) 2026 The KDE Telepathy Team
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this library; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "disk-space-ledger.h"
+#include "ktp-fth-debug.h"
+
+#include <QCoreApplication>
+#include <QFile>
+#include <QPair>
+#include <QTimer>
+
+#include <KJob>
+
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+
+// Space always left free on the filesystem
+static const qulonglong SafetyMargin = 16 * 1024 * 1024;
+
+// Interval between two checks of the free space while jobs are waiting, in ms
+static const int RetryInterval = 5000;
+
+DiskSpaceLedger *DiskSpaceLedger::instance()
+{
+    static DiskSpaceLedger *ledger = 0;
+    if (!ledger) {
+        ledger = new DiskSpaceLedger(qApp);
+    }
+    return ledger;
+}
+
+DiskSpaceLedger::DiskSpaceLedger(QObject *parent)
+    : QObject(parent),
+      m_retryTimer(new QTimer(this))
+{
+    m_retryTimer->setInterval(RetryInterval);
+    connect(m_retryTimer, SIGNAL(timeout()), SLOT(checkQueue()));
+}
+
+DiskSpaceLedger::~DiskSpaceLedger()
+{
+}
+
+DiskSpaceLedger::Result DiskSpaceLedger::reserve(KJob *job, const QString &directory,
+                                                 qulonglong bytes, qulonglong offset)
+{
+    Reservation reservation;
+    reservation.job = job;
+    reservation.directory = directory;
+    reservation.device = 0;
+    reservation.bytes = bytes;
+    reservation.offset = offset;
+    reservation.allocated = false;
+
+    const Result result = tryReserve(reservation);
+    if (result == Queued) {
+        qCDebug(KTP_FTH_MODULE) << "Waiting for" << bytes << "bytes in" << directory;
+        m_queue.append(reservation);
+        m_retryTimer->start();
+    }
+    if (result != NotEnoughSpace) {
+        // finished() is emitted also when the job is killed quietly
+        connect(job, SIGNAL(finished(KJob*)), SLOT(onJobFinished(KJob*)), Qt::UniqueConnection);
+    }
+    return result;
+}
+
+void DiskSpaceLedger::setAllocated(KJob *job)
+{
+    QHash<KJob*, Reservation>::iterator it = m_reservations.find(job);
+    if (it != m_reservations.end()) {
+        it->allocated = true;
+    }
+}
+
+DiskSpaceLedger::Result DiskSpaceLedger::tryReserve(const Reservation &reservation)
+{
+    struct stat st;
+    struct statvfs vfs;
+    const QByteArray path = QFile::encodeName(reservation.directory);
+    if (::stat(path.constData(), &st) < 0 || ::statvfs(path.constData(), &vfs) < 0) {
+        // Let the job fail when it opens the file
+        return Reserved;
+    }
+
+    const qulonglong available = qulonglong(vfs.f_bavail) * vfs.f_frsize;
+    if (reservation.bytes + SafetyMargin > available) {
+        qCWarning(KTP_FTH_MODULE) << "Not enough space in" << reservation.directory << "-"
+                                  << reservation.bytes << "bytes needed," << available << "available";
+        return NotEnoughSpace;
+    }
+
+    const qulonglong others = outstanding(st.st_dev);
+    if (reservation.bytes + others + SafetyMargin > available) {
+        return Queued;
+    }
+
+    Reservation granted = reservation;
+    granted.device = st.st_dev;
+    m_reservations.insert(granted.job, granted);
+    qCDebug(KTP_FTH_MODULE) << "Reserved" << granted.bytes << "bytes in" << granted.directory
+                            << "-" << others << "bytes reserved by other transfers";
+    return Reserved;
+}
+
+qulonglong DiskSpaceLedger::outstanding(quint64 device) const
+{
+    qulonglong total = 0;
+    Q_FOREACH (const Reservation &reservation, m_reservations) {
+        if (reservation.device != device || reservation.allocated) {
+            continue;
+        }
+        // What was already written is not free anymore
+        const qulonglong processed = reservation.job->processedAmount(KJob::Bytes);
+        const qulonglong written = processed > reservation.offset ? processed - reservation.offset : 0;
+        if (written < reservation.bytes) {
+            total += reservation.bytes - written;
+        }
+    }
+    return total;
+}
+
+void DiskSpaceLedger::onJobFinished(KJob *job)
+{
+    m_reservations.remove(job);
+    for (int i = 0; i < m_queue.size(); ++i) {
+        if (m_queue.at(i).job == job) {
+            m_queue.removeAt(i);
+            break;
+        }
+    }
+    checkQueue();
+}
+
+void DiskSpaceLedger::checkQueue()
+{
+    // Later jobs can go first if they fit
+    QList<QPair<KJob*, bool> > done;
+    QList<Reservation>::iterator it = m_queue.begin();
+    while (it != m_queue.end()) {
+        const Result result = tryReserve(*it);
+        if (result == Queued) {
+            ++it;
+            continue;
+        }
+        done.append(qMakePair(it->job, result == Reserved));
+        it = m_queue.erase(it);
+    }
+
+    if (m_queue.isEmpty()) {
+        m_retryTimer->stop();
+    }
+
+    for (int i = 0; i < done.size(); ++i) {
+        Q_EMIT reservationDone(done.at(i).first, done.at(i).second);
+    }
+}
+
+#include "moc_disk-space-ledger.cpp"
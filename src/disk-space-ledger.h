@@ -0,0 +1,96 @@
+/*
+* Copyright (C) 2026 The KDE Telepathy Team
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this library; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef DISK_SPACE_LEDGER_H
+#define DISK_SPACE_LEDGER_H
+
+#include <QObject>
+#include <QHash>
+#include <QList>
+
+class KJob;
+class QTimer;
+
+/**
+ * Keeps track of the disk space promised to the incoming transfers, per
+ * filesystem, so that parallel downloads do not all start on a disk that
+ * can only hold some of them.
+ *
+ * A reservation covers the bytes still to be written by the job; it shrinks
+ * while the job progresses and it is released when the job finishes. A job
+ * whose file was preallocated does not hold anything anymore, the space is
+ * already used on the filesystem.
+ *
+ * Must be used from the main thread only.
+ */
+class DiskSpaceLedger : public QObject
+{
+    Q_OBJECT
+    Q_DISABLE_COPY(DiskSpaceLedger)
+
+public:
+    enum Result {
+        /** The space is reserved for the job */
+        Reserved,
+        /** Space reserved by other transfers is needed, reservationDone() will tell */
+        Queued,
+        /** The filesystem does not have enough free space */
+        NotEnoughSpace
+    };
+
+    static DiskSpaceLedger *instance();
+
+    /**
+     * Reserves \p bytes on the filesystem of \p directory for \p job, that
+     * is going to write them starting from \p offset.
+     */
+    Result reserve(KJob *job, const QString &directory, qulonglong bytes, qulonglong offset);
+    /** The space needed by \p job was allocated on the filesystem */
+    void setAllocated(KJob *job);
+
+Q_SIGNALS:
+    /** A queued reservation succeeded or failed */
+    void reservationDone(KJob *job, bool reserved);
+
+private Q_SLOTS:
+    void onJobFinished(KJob *job);
+    void checkQueue();
+
+private:
+    struct Reservation
+    {
+        KJob *job;
+        QString directory;
+        quint64 device;
+        qulonglong bytes;
+        qulonglong offset;
+        bool allocated;
+    };
+
+    explicit DiskSpaceLedger(QObject *parent = 0);
+    virtual ~DiskSpaceLedger();
+
+    Result tryReserve(const Reservation &reservation);
+    qulonglong outstanding(quint64 device) const;
+
+    QHash<KJob*, Reservation> m_reservations;
+    QList<Reservation> m_queue;
+    QTimer *m_retryTimer;
+};
+
+#endif // DISK_SPACE_LEDGER_H
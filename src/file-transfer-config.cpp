@@ -0,0 +1,187 @@
+/*
+* Copyright (C) 2026 The KDE Telepathy Team
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this library; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "file-transfer-config.h"
+#include "ktp-fth-debug.h"
+
+#include <KConfigGroup>
+#include <KDirWatch>
+#include <KLocalizedString>
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QStandardPaths>
+
+FileTransferConfig *FileTransferConfig::instance()
+{
+    static FileTransferConfig *config = 0;
+    if (!config) {
+        config = new FileTransferConfig(qApp);
+    }
+    return config;
+}
+
+int FileTransferConfig::standbyTimeout()
+{
+    KConfigGroup filetransferConfig = KSharedConfig::openConfig(QLatin1String("ktelepathyrc"))->group(QLatin1String("File Transfers"));
+    return qMax(0, filetransferConfig.readEntry(QLatin1String("standbyTimeout"), 30)) * 1000;
+}
+
+FileTransferConfig::FileTransferConfig(QObject *parent)
+    : QObject(parent),
+      m_config(KSharedConfig::openConfig(QLatin1String("ktelepathyrc")))
+{
+    // Switching to headless needs the jobs to be tracked differently, it is
+    // not reloaded
+    const QByteArray headlessVariable = qgetenv("KTP_FTH_HEADLESS");
+    m_headless = !headlessVariable.isEmpty() ? headlessVariable != "0"
+                                             : m_config->group(QLatin1String("File Transfers")).readEntry(QLatin1String("headless"), false);
+    if (m_headless) {
+        qCDebug(KTP_FTH_MODULE) << "Running headless";
+    }
+
+    load();
+
+    // KConfig saves the file by replacing it, KDirWatch follows the path.
+    const QString path = QStandardPaths::writableLocation(QStandardPaths::GenericConfigLocation)
+                       + QLatin1String("/ktelepathyrc");
+    KDirWatch *watch = new KDirWatch(this);
+    watch->addFile(path);
+    connect(watch, SIGNAL(dirty(QString)), SLOT(onConfigFileChanged()));
+    connect(watch, SIGNAL(created(QString)), SLOT(onConfigFileChanged()));
+    connect(watch, SIGNAL(deleted(QString)), SLOT(onConfigFileChanged()));
+}
+
+FileTransferConfig::~FileTransferConfig()
+{
+}
+
+void FileTransferConfig::load()
+{
+    KConfigGroup filetransferConfig = m_config->group(QLatin1String("File Transfers"));
+
+    m_alwaysAsk = !m_headless && filetransferConfig.readEntry(QLatin1String("alwaysAsk"), false);
+    m_existingFilePolicy = filetransferConfig.readEntry(QLatin1String("existingFilePolicy"), QString::fromLatin1("rename"));
+    m_partialFilePolicy = filetransferConfig.readEntry(QLatin1String("partialFilePolicy"), QString::fromLatin1("resume"));
+    // Also used when asking is not possible
+    m_downloadDirectory = filetransferConfig.readPathEntry(QLatin1String("downloadDirectory"),
+        QDir::homePath() + QLatin1String("/") + i18nc("This is the download directory in user's home", "Downloads"));
+    m_zeroCopy = filetransferConfig.readEntry(QLatin1String("zeroCopy"), true);
+    m_diskWriterThreads = qMax(1, filetransferConfig.readEntry(QLatin1String("diskWriterThreads"), 2));
+    m_progressUpdatesPerSecond = filetransferConfig.readEntry(QLatin1String("progressUpdatesPerSecond"), 4);
+    m_largeFileThreshold = qulonglong(qMax(0, filetransferConfig.readEntry(QLatin1String("largeFileThreshold"), 512))) * 1024 * 1024;
+    m_largeFileIoMode = filetransferConfig.readEntry(QLatin1String("largeFileIoMode"), QString::fromLatin1("dropBehind"));
+    m_averageSpeed = filetransferConfig.readEntry(QLatin1String("speedMode"), QString()) == QLatin1String("average");
+    m_maxActiveTransfersPerAccount = qMax(0, filetransferConfig.readEntry(QLatin1String("maxActiveTransfersPerAccount"), 3));
+    m_maxDownloadRate = qMax(0, filetransferConfig.readEntry(QLatin1String("maxDownloadRate"), 0));
+    m_maxUploadRate = qMax(0, filetransferConfig.readEntry(QLatin1String("maxUploadRate"), 0));
+    m_contactRateLimits = filetransferConfig.readEntry(QLatin1String("contactRateLimits"), QStringList());
+    m_rateLimitProfiles = filetransferConfig.readEntry(QLatin1String("rateLimitProfiles"), QStringList());
+
+    qCDebug(KTP_FTH_MODULE) << "Download directory:" << m_downloadDirectory << "\t Always Ask:" << m_alwaysAsk;
+}
+
+void FileTransferConfig::onConfigFileChanged()
+{
+    qCDebug(KTP_FTH_MODULE) << "ktelepathyrc changed, reloading";
+    m_config->reparseConfiguration();
+    load();
+    Q_EMIT changed();
+}
+
+bool FileTransferConfig::headless() const
+{
+    return m_headless;
+}
+
+QString FileTransferConfig::existingFilePolicy() const
+{
+    return m_existingFilePolicy;
+}
+
+QString FileTransferConfig::partialFilePolicy() const
+{
+    return m_partialFilePolicy;
+}
+
+bool FileTransferConfig::alwaysAsk() const
+{
+    return m_alwaysAsk;
+}
+
+QString FileTransferConfig::downloadDirectory() const
+{
+    return m_downloadDirectory;
+}
+
+bool FileTransferConfig::zeroCopy() const
+{
+    return m_zeroCopy;
+}
+
+int FileTransferConfig::diskWriterThreads() const
+{
+    return m_diskWriterThreads;
+}
+
+int FileTransferConfig::progressUpdatesPerSecond() const
+{
+    return m_progressUpdatesPerSecond;
+}
+
+qulonglong FileTransferConfig::largeFileThreshold() const
+{
+    return m_largeFileThreshold;
+}
+
+QString FileTransferConfig::largeFileIoMode() const
+{
+    return m_largeFileIoMode;
+}
+
+bool FileTransferConfig::averageSpeed() const
+{
+    return m_averageSpeed;
+}
+
+int FileTransferConfig::maxActiveTransfersPerAccount() const
+{
+    return m_maxActiveTransfersPerAccount;
+}
+
+int FileTransferConfig::maxDownloadRate() const
+{
+    return m_maxDownloadRate;
+}
+
+int FileTransferConfig::maxUploadRate() const
+{
+    return m_maxUploadRate;
+}
+
+QStringList FileTransferConfig::contactRateLimits() const
+{
+    return m_contactRateLimits;
+}
+
+QStringList FileTransferConfig::rateLimitProfiles() const
+{
+    return m_rateLimitProfiles;
+}
+
+#include "moc_file-transfer-config.cpp"
@@ -0,0 +1,118 @@
+/*
+* Copyright (C) 2026 The KDE Telepathy Team
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this library; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef FILE_TRANSFER_CONFIG_H
+#define FILE_TRANSFER_CONFIG_H
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+
+#include <KSharedConfig>
+
+/**
+ * The "File Transfers" group of ktelepathyrc, parsed once.
+ *
+ * The configuration file is watched and parsed again only when it changes,
+ * then changed() is emitted. The getters are cheap and must be used from the
+ * main thread only.
+ */
+class FileTransferConfig : public QObject
+{
+    Q_OBJECT
+    Q_DISABLE_COPY(FileTransferConfig)
+
+public:
+    static FileTransferConfig *instance();
+
+    /**
+     * How long the handler stays running after the last transfer, in ms.
+     * Read directly from the configuration file, it is needed before the
+     * application is created.
+     */
+    static int standbyTimeout();
+
+    /**
+     * No dialog is shown and no widget is used, conflicts are solved with
+     * the policies below. Read once at startup, from the configuration or
+     * from the KTP_FTH_HEADLESS environment variable.
+     */
+    bool headless() const;
+    /** overwrite, rename or skip an existing file with the same name */
+    QString existingFilePolicy() const;
+    /** resume, overwrite, rename or skip an existing .part file */
+    QString partialFilePolicy() const;
+
+    /** Always false if headless() is true */
+    bool alwaysAsk() const;
+    /** Used when alwaysAsk() is false or no dialog can be shown */
+    QString downloadDirectory() const;
+    bool zeroCopy() const;
+    int diskWriterThreads() const;
+    int progressUpdatesPerSecond() const;
+    /**
+     * Files at least this big, in bytes, use largeFileIoMode(); 0 if the
+     * page cache is always used normally
+     */
+    qulonglong largeFileThreshold() const;
+    /** dropBehind, direct or buffered */
+    QString largeFileIoMode() const;
+    bool averageSpeed() const;
+    int maxActiveTransfersPerAccount() const;
+
+    /** Rates in KiB/s, 0 means no limit */
+    int maxDownloadRate() const;
+    int maxUploadRate() const;
+    /** contact=rate entries */
+    QStringList contactRateLimits() const;
+    /** HH:MM-HH:MM=download/upload entries */
+    QStringList rateLimitProfiles() const;
+
+Q_SIGNALS:
+    void changed();
+
+private Q_SLOTS:
+    void onConfigFileChanged();
+
+private:
+    explicit FileTransferConfig(QObject *parent = 0);
+    virtual ~FileTransferConfig();
+
+    void load();
+
+    KSharedConfigPtr m_config;
+
+    bool m_headless;
+    QString m_existingFilePolicy;
+    QString m_partialFilePolicy;
+    bool m_alwaysAsk;
+    QString m_downloadDirectory;
+    bool m_zeroCopy;
+    int m_diskWriterThreads;
+    int m_progressUpdatesPerSecond;
+    qulonglong m_largeFileThreshold;
+    QString m_largeFileIoMode;
+    bool m_averageSpeed;
+    int m_maxActiveTransfersPerAccount;
+    int m_maxDownloadRate;
+    int m_maxUploadRate;
+    QStringList m_contactRateLimits;
+    QStringList m_rateLimitProfiles;
+};
+
+#endif // FILE_TRANSFER_CONFIG_H
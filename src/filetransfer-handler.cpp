@@ -17,29 +17,80 @@
 
 #include "filetransfer-handler.h"
 
+#include "bandwidth-limiter.h"
+#include "buffer-pool.h"
+#include "compression-device.h"
+#include "file-transfer-config.h"
 #include "handle-incoming-file-transfer-channel-job.h"
 #include "handle-outgoing-file-transfer-channel-job.h"
+#include "transfer-journal.h"
+#include "transfer-metrics.h"
+#include "transfer-scheduler.h"
 #include "ktp-fth-debug.h"
 
 #include <KTp/telepathy-handler-application.h>
 
 #include <TelepathyQt/ChannelClassSpecList>
+#include <TelepathyQt/Contact>
 #include <TelepathyQt/IncomingFileTransferChannel>
 #include <TelepathyQt/OutgoingFileTransferChannel>
 
-#include <KSharedConfig>
-#include <KConfigGroup>
 #include <KLocalizedString>
 #include <KJob>
 
 #include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QTimer>
+
+#include <unistd.h>
+
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+// Transfers bigger than this are started after the other ones
+static const qulonglong LargeTransferSize = Q_UINT64_C(1024) * 1024 * 1024;
+
+// Delay after the last transfer before the memory is trimmed, in ms
+static const int IdleDelay = 2000;
+
+// Resident set size in KiB, or -1
+static qint64 residentSize()
+{
+    QFile statm(QLatin1String("/proc/self/statm"));
+    if (!statm.open(QIODevice::ReadOnly)) {
+        return -1;
+    }
+    const QList<QByteArray> fields = statm.readAll().split(' ');
+    if (fields.size() < 2) {
+        return -1;
+    }
+    return fields.at(1).toLongLong() * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+// The target contact is not always known, e.g. for anonymous channels
+static QString targetContactId(const Tp::FileTransferChannelPtr &channel)
+{
+    return channel->targetContact() ? channel->targetContact()->id() : QString();
+}
 
 
 FileTransferHandler::FileTransferHandler(QObject *parent)
     : QObject(parent),
       Tp::AbstractClientHandler(Tp::ChannelClassSpecList() << Tp::ChannelClassSpec::incomingFileTransfer()
-                                                           << Tp::ChannelClassSpec::outgoingFileTransfer())
+                                                           << Tp::ChannelClassSpec::outgoingFileTransfer()
+                                                           << TransferCompression::receiverFilter()),
+      m_scheduler(new TransferScheduler(this)),
+      m_idleTimer(new QTimer(this)),
+      m_activeJobs(0)
 {
+    m_idleTimer->setSingleShot(true);
+    m_idleTimer->setInterval(IdleDelay);
+    connect(m_idleTimer, SIGNAL(timeout()), SLOT(onIdle()));
+
+    connect(FileTransferConfig::instance(), SIGNAL(changed()), SLOT(onConfigChanged()));
+    onConfigChanged();
 }
 
 FileTransferHandler::~FileTransferHandler()
@@ -59,7 +110,6 @@ void FileTransferHandler::handleChannels(const Tp::MethodInvocationContextPtr<>
                                          const QDateTime &userActionTime,
                                          const Tp::AbstractClientHandler::HandlerInfo &handlerInfo)
 {
-    Q_UNUSED(account);
     Q_UNUSED(connection);
     Q_UNUSED(requestsSatisfied);
     Q_UNUSED(userActionTime);
@@ -73,6 +123,8 @@ void FileTransferHandler::handleChannels(const Tp::MethodInvocationContextPtr<>
         }
 
         KJob* job = NULL;
+        qulonglong size = Q_UINT64_C(0xFFFFFFFFFFFFFFFF);
+        TransferScheduler::Priority priority = TransferScheduler::NormalPriority;
 
         if (!channel->isRequested()) {
             Tp::IncomingFileTransferChannelPtr incomingFileTransferChannel = Tp::IncomingFileTransferChannelPtr::qObjectCast(channel);
@@ -80,19 +132,24 @@ void FileTransferHandler::handleChannels(const Tp::MethodInvocationContextPtr<>
 
             qCDebug(KTP_FTH_MODULE) << incomingFileTransferChannel->immutableProperties();
 
-            KSharedConfigPtr config = KSharedConfig::openConfig(QLatin1String("ktelepathyrc"));
-            KConfigGroup filetransferConfig = config->group(QLatin1String("File Transfers"));
-
-            const bool alwaysAsk = filetransferConfig.readEntry(QLatin1String("alwaysAsk"), false);
-            QString downloadDirectory;
-            if (!alwaysAsk) {
-                downloadDirectory = filetransferConfig.readPathEntry(QLatin1String("downloadDirectory"),
-                    QDir::homePath() + QLatin1String("/") + i18nc("This is the download directory in user's home", "Downloads"));
+            const bool alwaysAsk = FileTransferConfig::instance()->alwaysAsk();
+            const QString downloadDirectory = FileTransferConfig::instance()->downloadDirectory();
+            if (!alwaysAsk && !QDir().mkpath(downloadDirectory)) {
+                // The job fails when it opens the file
+                qCWarning(KTP_FTH_MODULE) << "Unable to create the download directory" << downloadDirectory;
             }
-            qCDebug(KTP_FTH_MODULE) << "Download directory:" << downloadDirectory << "\t Always Ask:" << alwaysAsk;
-            // TODO Check if directory exists
 
             job = new HandleIncomingFileTransferChannelJob(incomingFileTransferChannel, downloadDirectory, alwaysAsk, this);
+            // The scheduler slot is given back while the job waits for the
+            // user or for disk space
+            connect(job, SIGNAL(waiting(KJob*)), m_scheduler, SLOT(releaseSlot(KJob*)));
+            connect(job, SIGNAL(readyToTransfer(KJob*)), m_scheduler, SLOT(requestSlot(KJob*)));
+            connect(m_scheduler, SIGNAL(slotGranted(KJob*)), job, SLOT(__k__onSlotGranted(KJob*)), Qt::QueuedConnection);
+            TransferMetrics::instance()->addTransfer(job, TransferMetrics::Incoming,
+                                                     incomingFileTransferChannel->fileName(),
+                                                     targetContactId(incomingFileTransferChannel),
+                                                     incomingFileTransferChannel->size());
+            size = incomingFileTransferChannel->size();
         } else {
             Tp::OutgoingFileTransferChannelPtr outgoingFileTransferChannel = Tp::OutgoingFileTransferChannelPtr::qObjectCast(channel);
             Q_ASSERT(outgoingFileTransferChannel);
@@ -106,22 +163,42 @@ void FileTransferHandler::handleChannels(const Tp::MethodInvocationContextPtr<>
             }
 
             job = new HandleOutgoingFileTransferChannelJob(outgoingFileTransferChannel, this);
+            TransferMetrics::instance()->addTransfer(job, TransferMetrics::Outgoing,
+                                                     outgoingFileTransferChannel->fileName(),
+                                                     targetContactId(outgoingFileTransferChannel),
+                                                     outgoingFileTransferChannel->size());
+            size = outgoingFileTransferChannel->size();
+            // The user is waiting for the files just sent
+            priority = TransferScheduler::HighPriority;
+        }
+
+        // Unknown sizes are UINT64_MAX
+        if (size > LargeTransferSize) {
+            priority = TransferScheduler::LowPriority;
         }
 
         if (job) {
+            ++m_activeJobs;
+            m_idleTimer->stop();
             connect(job,
                     SIGNAL(infoMessage(KJob*, QString, QString)),
                     SLOT(onInfoMessage(KJob*, QString, QString)));
             connect(job,
                     SIGNAL(result(KJob*)),
                     SLOT(handleResult(KJob*)));
-            job->start();
+            m_scheduler->enqueue(job, account->objectPath(), size, priority);
         }
     }
 
     context->setFinished();
 }
 
+void FileTransferHandler::onConfigChanged()
+{
+    m_scheduler->setMaxActiveTransfers(FileTransferConfig::instance()->maxActiveTransfersPerAccount());
+    BandwidthLimiter::instance()->reloadConfiguration();
+}
+
 void FileTransferHandler::onInfoMessage(KJob* job, const QString &plain, const QString &rich)
 {
     Q_UNUSED(job);
@@ -137,5 +214,23 @@ void FileTransferHandler::handleResult(KJob* job)
         // TODO do something;
     }
 
+    if (--m_activeJobs == 0) {
+        m_idleTimer->start();
+    }
     KTp::TelepathyHandlerApplication::jobFinished();
 }
+
+// The handler stays around between bursts of transfers, give back what it
+// does not need while waiting
+void FileTransferHandler::onIdle()
+{
+    const qint64 before = residentSize();
+
+    TransferJournal::instance()->flush();
+    BufferPool::instance()->trim();
+#ifdef __GLIBC__
+    ::malloc_trim(0);
+#endif
+
+    qCDebug(KTP_FTH_MODULE) << "Idle, resident size" << before << "KiB ->" << residentSize() << "KiB";
+}
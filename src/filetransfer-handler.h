@@ -22,6 +22,8 @@
 #include <TelepathyQt/Types>
 
 class KJob;
+class QTimer;
+class TransferScheduler;
 namespace Tp
 {
     class PendingOperation;
@@ -46,8 +48,15 @@ public:
                         const Tp::AbstractClientHandler::HandlerInfo &handlerInfo);
 
 private Q_SLOTS:
+    void onConfigChanged();
     void onInfoMessage(KJob* job, const QString &plain, const QString &rich);
     void handleResult(KJob* job);
+    void onIdle();
+
+private:
+    TransferScheduler *m_scheduler;
+    QTimer *m_idleTimer;
+    int m_activeJobs;
 };
 
 #endif // TELEPATHY_KDE_FILETRANSFER_HANDLER_H
@@ -19,19 +19,34 @@
 
 #include "handle-incoming-file-transfer-channel-job.h"
 #include "telepathy-base-job_p.h"
+#include "bandwidth-limiter.h"
+#include "chunk-manifest.h"
+#include "compression-device.h"
+#include "conflict-resolver.h"
+#include "disk-space-ledger.h"
+#include "file-transfer-config.h"
+#include "log-job-tracker.h"
+#include "page-cache-io.h"
+#include "splice-receiver.h"
+#include "stream-receiver.h"
+#include "tar-stream.h"
+#include "transfer-journal.h"
+#include "transfer-metrics.h"
+#include "transfer-ui.h"
+#include "write-behind-file.h"
 #include "ktp-fth-debug.h"
 
 #include <QTimer>
 #include <QUrl>
 #include <QPointer>
+#include <QDir>
+#include <QCryptographicHash>
 #include <QDebug>
-#include <QFileDialog>
+#include <QSharedPointer>
 
 #include <KLocalizedString>
-#include <kio/renamedialog.h>
 #include <kio/global.h>
-#include <KIOFileWidgets/KFileWidget>
-#include <KIOFileWidgets/KRecentDirs>
+#include <kio/jobuidelegateextension.h>
 #include <kjobtrackerinterface.h>
 
 #include <TelepathyQt/IncomingFileTransferChannel>
@@ -39,6 +54,14 @@
 #include <TelepathyQt/PendingOperation>
 #include <TelepathyQt/Contact>
 
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+
+// Time given to TelepathyQt to deliver the end of a compressed stream or an
+// archive once the connection manager reported the transfer as completed,
+// in ms
+static const int CompletionTimeout = 30 * 1000;
 
 class HandleIncomingFileTransferChannelJobPrivate : public KTp::TelepathyBaseJobPrivate
 {
@@ -55,14 +78,52 @@ public:
     QUrl url, partUrl;
     qulonglong offset;
     bool isResuming;
-    QPointer<KIO::RenameDialog> renameDialog;
+    QPointer<QObject> renameDialog;
+    SpliceReceiver* spliceReceiver;
+    StreamReceiver* streamReceiver;
+    WriteBehindFile* writeBehindFile;
+    InflateWriter* inflateWriter;
+    TarReader* tarReader;
+    QSharedPointer<ChunkManifest> chunkManifest;
+    bool completionPending;
+    int metricsId;
+    bool firstByteRecorded;
+    QString journalKey;
+    bool spaceReserved;
+    // The user confirmed in the rename dialog that the existing file or
+    // directory can be replaced
+    bool overwriteConfirmed;
+    // The scheduler slot was given back while waiting
+    bool slotReleased;
+    bool slotRequested;
 
     void init();
+    void recordFirstByte();
+    bool resumeFromJournal();
+    void beginJournalEntry();
+    void endJournalEntry();
+    bool isDataPending() const;
+    bool isStreamIncomplete() const;
+    bool isDataTruncated() const;
+    void failIncompleteData();
+    bool verifyContentHash();
+    void receiveArchive();
+    void createInflateWriter(QIODevice *sink);
     void start();
     bool kill();
     void checkFileExists();
     void checkPartFile();
+    void resolveExistingFile();
+    void resolvePartFile();
+    void skipFile();
+    void validatePartFile();
     void receiveFile();
+    bool reserveSpace();
+    void failNotEnoughSpace(qulonglong needed);
+    bool preallocatePartFile();
+    void completeTransfer();
+    void releaseSlot();
+    bool acquireSlot();
 
     void __k__onRenameDialogFinished(int result);
     void __k__onResumeDialogFinished(int result);
@@ -71,11 +132,77 @@ public:
     void __k__onFileTransferChannelStateChanged(Tp::FileTransferState state, Tp::FileTransferStateChangeReason reason);
     void __k__onFileTransferChannelTransferredBytesChanged(qulonglong count);
     void __k__acceptFile();
+    void __k__emitDescription();
     void __k__onAcceptFileFinished(Tp::PendingOperation* op);
     void __k__onCancelOperationFinished(Tp::PendingOperation* op);
     void __k__onInvalidated();
+    void __k__onNativeTransferredBytesChanged(qulonglong position);
+    void __k__onNativeTransferFinished();
+    void __k__onNativeTransferFailed(const QString &errorName, const QString &errorMessage);
+    void __k__onWriteBehindFileDrained();
+    void __k__onWriteBehindFileWriteFailed(const QString &errorMessage);
+    void __k__onStreamFinished();
+    void __k__onCompletionTimeout();
+    void __k__onArchiveEntryStarted(const QString &name);
+    void __k__onPartFileValidated(int result, qint64 validLength);
+    void __k__onSpaceReservationDone(KJob *job, bool reserved);
+    void __k__onSlotGranted(KJob *job);
 };
 
+// Returns false if the name of the file cannot be used as is in the download
+// directory
+static bool isSafeFileName(const QString &name)
+{
+    return !name.isEmpty()
+        && name != QLatin1String(".")
+        && name != QLatin1String("..")
+        && !name.contains(QLatin1Char('/'))
+        && !name.contains(QChar(0));
+}
+
+// Name of the contact for the messages, the contact might not be known
+static QString contactName(const Tp::FileTransferChannelPtr &channel)
+{
+    const Tp::ContactPtr contact = channel->targetContact();
+    if (!contact) {
+        return QString();
+    }
+    return contact->alias().isEmpty() ? contact->id() : contact->alias();
+}
+
+// Deletes a file, a symbolic link or a whole directory
+static bool removePath(const QString &path)
+{
+    const QFileInfo info(path);
+    if (info.isDir() && !info.isSymLink()) {
+        return QDir(path).removeRecursively();
+    }
+    return !(info.exists() || info.isSymLink()) || QFile::remove(path);
+}
+
+// Returns false if the sender did not announce a hash that can be checked
+static bool contentHashAlgorithm(const Tp::IncomingFileTransferChannelPtr &channel,
+                                 QCryptographicHash::Algorithm *algorithm)
+{
+    if (channel->contentHash().isEmpty() || TransferArchive::isArchive(channel)) {
+        return false;
+    }
+
+    switch (channel->contentHashType()) {
+    case Tp::FileHashTypeMD5:
+        *algorithm = QCryptographicHash::Md5;
+        return true;
+    case Tp::FileHashTypeSHA1:
+        *algorithm = QCryptographicHash::Sha1;
+        return true;
+    case Tp::FileHashTypeSHA256:
+        *algorithm = QCryptographicHash::Sha256;
+        return true;
+    default:
+        return false;
+    }
+}
+
 HandleIncomingFileTransferChannelJob::HandleIncomingFileTransferChannelJob(Tp::IncomingFileTransferChannelPtr channel,
                                                                            const QString downloadDirectory,
                                                                            bool askForDownloadDirectory,
@@ -94,7 +221,7 @@ HandleIncomingFileTransferChannelJob::HandleIncomingFileTransferChannelJob(Tp::I
 HandleIncomingFileTransferChannelJob::~HandleIncomingFileTransferChannelJob()
 {
     qCDebug(KTP_FTH_MODULE);
-    KIO::getJobTracker()->unregisterJob(this);
+    LogJobTracker::transferTracker()->unregisterJob(this);
 }
 
 void HandleIncomingFileTransferChannelJob::start()
@@ -115,7 +242,19 @@ HandleIncomingFileTransferChannelJobPrivate::HandleIncomingFileTransferChannelJo
     : askForDownloadDirectory(true),
       file(0),
       offset(0),
-      isResuming(false)
+      isResuming(false),
+      spliceReceiver(0),
+      streamReceiver(0),
+      writeBehindFile(0),
+      inflateWriter(0),
+      tarReader(0),
+      completionPending(false),
+      metricsId(-1),
+      firstByteRecorded(false),
+      spaceReserved(false),
+      overwriteConfirmed(false),
+      slotReleased(false),
+      slotRequested(false)
 {
     qCDebug(KTP_FTH_MODULE);
 }
@@ -148,8 +287,10 @@ void HandleIncomingFileTransferChannelJobPrivate::init()
     }
 
     q->setCapabilities(KJob::Killable);
-    q->setTotalAmount(KJob::Bytes, channel->size());
-    q->setProcessedAmountAndCalculateSpeed(0);
+    q->setProgressUpdatesPerSecond(FileTransferConfig::instance()->progressUpdatesPerSecond());
+    q->setAverageSpeed(FileTransferConfig::instance()->averageSpeed());
+    q->setTotalAmount(KJob::Bytes, TransferCompression::fileSize(channel));
+    q->setInitialProcessedAmount(0);
 
     q->connect(channel.data(),
                SIGNAL(invalidated(Tp::DBusProxy*,QString,QString)),
@@ -177,16 +318,25 @@ void HandleIncomingFileTransferChannelJobPrivate::start()
         return;
     }
 
-    if (askForDownloadDirectory) {
+    metricsId = TransferMetrics::instance()->transferId(q);
 
-        QString recentDirClass;
+    // The name comes from the contact, it must stay inside the download
+    // directory
+    if (!isSafeFileName(channel->fileName())) {
+        qCWarning(KTP_FTH_MODULE) << "Refusing the file name" << channel->fileName();
+        q->setError(KTp::AcceptFileError);
+        q->setErrorText(i18n("The name of the incoming file is not valid: %1", channel->fileName()));
+        channel->cancel();
+        QTimer::singleShot(0, q, SLOT(__k__doEmitResult()));
+        return;
+    }
 
-        url = QFileDialog::getSaveFileUrl(0, QString(),
-                                          KFileWidget::getStartUrl(QUrl(QLatin1String("kfiledialog:///FileTransferLastDirectory/") + channel->fileName()), recentDirClass));
+    if (resumeFromJournal()) {
+        return;
+    }
 
-        if (!recentDirClass.isEmpty()) {
-            KRecentDirs::add(recentDirClass, url.toLocalFile());
-        }
+    if (askForDownloadDirectory && TransferUi::instance()) {
+        url = TransferUi::instance()->askSaveUrl(channel->fileName());
 
         partUrl = url;
         partUrl.setPath(url.path() + QLatin1String(".part"));
@@ -198,6 +348,58 @@ void HandleIncomingFileTransferChannelJobPrivate::start()
     checkFileExists();
 }
 
+// Resumes a transfer interrupted while the same file was being received,
+// without asking anything
+bool HandleIncomingFileTransferChannelJobPrivate::resumeFromJournal()
+{
+    Q_Q(HandleIncomingFileTransferChannelJob);
+
+    if (TransferCompression::isCompressed(channel) || TransferArchive::isArchive(channel)) {
+        return false;
+    }
+
+    TransferJournal::Entry entry;
+    if (!TransferJournal::instance()->find(TransferJournal::key(channel), &entry)) {
+        return false;
+    }
+    if (!QFileInfo::exists(entry.partFileName)) {
+        TransferJournal::instance()->end(entry.key);
+        return false;
+    }
+
+    qCDebug(KTP_FTH_MODULE) << "Resuming interrupted transfer of" << entry.url << "from" << entry.partFileName;
+    Q_EMIT q->infoMessage(q, i18n("Resuming interrupted file transfer"));
+
+    url = entry.url;
+    partUrl = QUrl::fromLocalFile(entry.partFileName);
+    validatePartFile();
+    return true;
+}
+
+void HandleIncomingFileTransferChannelJobPrivate::beginJournalEntry()
+{
+    TransferJournal::Entry entry;
+    entry.key = TransferJournal::key(channel);
+    entry.contact = channel->targetContact() ? channel->targetContact()->id() : QString();
+    entry.fileName = channel->fileName();
+    entry.url = url;
+    entry.partFileName = partUrl.toLocalFile();
+    entry.size = channel->size();
+    entry.offset = offset;
+    entry.contentHashType = channel->contentHashType();
+    entry.contentHash = channel->contentHash();
+    TransferJournal::instance()->begin(entry);
+    journalKey = entry.key;
+}
+
+void HandleIncomingFileTransferChannelJobPrivate::endJournalEntry()
+{
+    if (!journalKey.isEmpty()) {
+        TransferJournal::instance()->end(journalKey);
+        journalKey.clear();
+    }
+}
+
 void HandleIncomingFileTransferChannelJobPrivate::checkFileExists()
 {
     Q_Q(HandleIncomingFileTransferChannelJob);
@@ -208,18 +410,20 @@ void HandleIncomingFileTransferChannelJobPrivate::checkFileExists()
     partUrl.setPath(url.path() + QLatin1String(".part"));
 
     QFileInfo fileInfo(url.toLocalFile()); // TODO check if it is a dir?
+    if (fileInfo.exists() && !TransferUi::instance()) {
+        resolveExistingFile();
+        return;
+    }
     if (fileInfo.exists()) {
-        renameDialog = new KIO::RenameDialog(0,
-                                             i18n("Incoming file exists"),
-                                             QUrl(), //TODO
-                                             url,
-                                             KIO::RenameDialog_Overwrite,
-                                             fileInfo.size(),
-                                             channel->size(),
-                                             fileInfo.created(),
-                                             QDateTime(),
-                                             fileInfo.lastModified(),
-                                             channel->lastModificationTime());
+        releaseSlot();
+        renameDialog = TransferUi::instance()->showRenameDialog(i18n("Incoming file exists"),
+                                                                url,
+                                                                false,
+                                                                fileInfo.size(),
+                                                                TransferCompression::fileSize(channel),
+                                                                fileInfo.created(),
+                                                                fileInfo.lastModified(),
+                                                                channel->lastModificationTime());
 
         q->connect(q, SIGNAL(finished(KJob*)),
                    renameDialog.data(), SLOT(reject()));
@@ -227,8 +431,6 @@ void HandleIncomingFileTransferChannelJobPrivate::checkFileExists()
         q->connect(renameDialog.data(),
                    SIGNAL(finished(int)),
                    SLOT(__k__onRenameDialogFinished(int)));
-
-        renameDialog.data()->show();
         return;
     }
 
@@ -246,8 +448,6 @@ void HandleIncomingFileTransferChannelJobPrivate::__k__onRenameDialogFinished(in
         return;
     }
 
-    Q_ASSERT(renameDialog.data()->result() == result);
-
     switch (result) {
     case KIO::R_CANCEL:
         // TODO Cancel file transfer and close channel
@@ -255,15 +455,17 @@ void HandleIncomingFileTransferChannelJobPrivate::__k__onRenameDialogFinished(in
         QTimer::singleShot(0, q, SLOT(__k__doEmitResult()));
         return;
     case KIO::R_RENAME:
-        url = renameDialog.data()->newDestUrl();
+        url = TransferUi::instance()->newDestUrl(renameDialog.data());
         break;
     case KIO::R_OVERWRITE:
     {
-        // Delete the old file if exists
+        // Delete the old file if exists, a directory is replaced when the
+        // archive is complete
         QFile oldFile(url.toLocalFile(), 0);
         if (oldFile.exists()) {
             oldFile.remove();
         }
+        overwriteConfirmed = true;
     }
         break;
     default:
@@ -284,19 +486,26 @@ void HandleIncomingFileTransferChannelJobPrivate::checkPartFile()
     qCDebug(KTP_FTH_MODULE);
     Q_Q(HandleIncomingFileTransferChannelJob);
 
+    // Compressed transfers and archives cannot be resumed, the .part file
+    // is overwritten
     QFileInfo fileInfo(partUrl.toLocalFile());
-    if (fileInfo.exists()) {
-        renameDialog = new KIO::RenameDialog(0,
-                                             i18n("Would you like to resume partial download?"),
-                                             QUrl(),
-                                             partUrl,
-                                             KIO::RenameDialog_Resume,
-                                             fileInfo.size(),
-                                             channel->size(),
-                                             fileInfo.created(),
-                                             QDateTime(),
-                                             fileInfo.lastModified(),
-                                             channel->lastModificationTime());
+    const bool resumable = fileInfo.exists()
+                        && !TransferCompression::isCompressed(channel)
+                        && !TransferArchive::isArchive(channel);
+    if (resumable && !TransferUi::instance()) {
+        resolvePartFile();
+        return;
+    }
+    if (resumable) {
+        releaseSlot();
+        renameDialog = TransferUi::instance()->showRenameDialog(i18n("Would you like to resume partial download?"),
+                                                                partUrl,
+                                                                true,
+                                                                fileInfo.size(),
+                                                                channel->size(),
+                                                                fileInfo.created(),
+                                                                fileInfo.lastModified(),
+                                                                channel->lastModificationTime());
 
         q->connect(q, SIGNAL(finished(KJob*)),
                    renameDialog.data(), SLOT(reject()));
@@ -304,8 +513,6 @@ void HandleIncomingFileTransferChannelJobPrivate::checkPartFile()
         q->connect(renameDialog.data(),
                    SIGNAL(finished(int)),
                    SLOT(__k__onResumeDialogFinished(int)));
-
-        renameDialog.data()->show();
         return;
     }
     receiveFile();
@@ -323,19 +530,13 @@ void HandleIncomingFileTransferChannelJobPrivate::__k__onResumeDialogFinished(in
         return;
     }
 
-    Q_ASSERT(renameDialog.data()->result() == result);
-
     switch (result) {
     case KIO::R_RESUME:
-    {
-        QFileInfo fileInfo(partUrl.toLocalFile());
-        offset = fileInfo.size();
-        isResuming = true;
-        break;
-    }
+        validatePartFile();
+        return;
     case KIO::R_RENAME:
         // If the user hits rename, we use the new name as the .part file
-        partUrl = renameDialog.data()->newDestUrl();
+        partUrl = TransferUi::instance()->newDestUrl(renameDialog.data());
         break;
     case KIO::R_CANCEL:
         // If user hits cancel .part file will be overwritten
@@ -346,14 +547,194 @@ void HandleIncomingFileTransferChannelJobPrivate::__k__onResumeDialogFinished(in
     receiveFile();
 }
 
+// Headless counterpart of the rename dialog
+void HandleIncomingFileTransferChannelJobPrivate::resolveExistingFile()
+{
+    switch (ConflictResolver::existingFileAction()) {
+    case ConflictResolver::Skip:
+        skipFile();
+        return;
+    case ConflictResolver::Overwrite:
+        qCDebug(KTP_FTH_MODULE) << "Overwriting" << url.toLocalFile();
+        QFile::remove(url.toLocalFile());
+        break;
+    case ConflictResolver::Rename:
+    default:
+        url = ConflictResolver::uniqueUrl(url);
+        partUrl = url;
+        partUrl.setPath(url.path() + QLatin1String(".part"));
+        qCDebug(KTP_FTH_MODULE) << "Saving as" << url.toLocalFile();
+        break;
+    }
+    checkPartFile();
+}
+
+// Headless counterpart of the resume dialog
+void HandleIncomingFileTransferChannelJobPrivate::resolvePartFile()
+{
+    switch (ConflictResolver::partialFileAction()) {
+    case ConflictResolver::Skip:
+        skipFile();
+        return;
+    case ConflictResolver::Resume:
+        validatePartFile();
+        return;
+    case ConflictResolver::Rename:
+        partUrl = ConflictResolver::uniqueUrl(partUrl);
+        break;
+    case ConflictResolver::Overwrite:
+    default:
+        break;
+    }
+    receiveFile();
+}
+
+void HandleIncomingFileTransferChannelJobPrivate::skipFile()
+{
+    qCDebug(KTP_FTH_MODULE) << "Skipping" << channel->fileName();
+    Q_Q(HandleIncomingFileTransferChannelJob);
+
+    Q_EMIT q->infoMessage(q, i18n("Skipped incoming file %1, it already exists", channel->fileName()));
+    channel->cancel();
+    QTimer::singleShot(0, q, SLOT(__k__doEmitResult()));
+}
+
+// Checks the .part file against its manifest before trusting it, then
+// continues in __k__onPartFileValidated()
+void HandleIncomingFileTransferChannelJobPrivate::validatePartFile()
+{
+    Q_Q(HandleIncomingFileTransferChannelJob);
+
+    PartFileValidator *validator = new PartFileValidator(q);
+    q->connect(validator,
+               SIGNAL(finished(int,qint64)),
+               SLOT(__k__onPartFileValidated(int,qint64)));
+    validator->start(partUrl.toLocalFile(), ChunkManifest::identity(channel));
+}
+
+void HandleIncomingFileTransferChannelJobPrivate::__k__onPartFileValidated(int result, qint64 validLength)
+{
+    qCDebug(KTP_FTH_MODULE) << "Partial download check result" << result << "valid length" << validLength;
+    Q_Q(HandleIncomingFileTransferChannelJob);
+
+    q->sender()->deleteLater();
+
+    switch (result) {
+    case PartFileValidator::IdentityMismatch:
+        qCWarning(KTP_FTH_MODULE) << partUrl.toLocalFile() << "does not belong to this file, restarting";
+        Q_EMIT q->infoMessage(q, i18n("The partial download belongs to a different file. Restarting."));
+        break;
+    case PartFileValidator::NoManifest:
+        // Written by an older version, nothing to check it against
+        qCDebug(KTP_FTH_MODULE) << "No manifest for" << partUrl.toLocalFile();
+        // fall through
+    case PartFileValidator::Valid:
+    default:
+        offset = validLength;
+        isResuming = true;
+        break;
+    }
+
+    receiveFile();
+}
+
 void HandleIncomingFileTransferChannelJobPrivate::receiveFile()
 {
     qCDebug(KTP_FTH_MODULE);
     Q_Q(HandleIncomingFileTransferChannelJob);
 
-    // Open the .part file in append mode
+    // Nothing is written before the space is available
+    if (!spaceReserved && !reserveSpace()) {
+        return;
+    }
+    // Continued by __k__onSlotGranted() after waiting
+    if (!acquireSlot()) {
+        return;
+    }
+
+    if (TransferArchive::isArchive(channel)) {
+        receiveArchive();
+        return;
+    }
+
+    const bool zeroCopy = FileTransferConfig::instance()->zeroCopy();
+    // Compressed data has to go through the inflater, and data to verify
+    // through the hash
+    const bool compressed = TransferCompression::isCompressed(channel);
+    QCryptographicHash::Algorithm hashAlgorithm;
+    const bool verify = contentHashAlgorithm(channel, &hashAlgorithm);
+
+    // Data is always written at explicit offsets, therefore the .part file
+    // is opened unbuffered, in read-write mode to keep its content when
+    // resuming.
     file = new QFile(partUrl.toLocalFile(), q->parent());
-    file->open(isResuming ? QIODevice::Append : QIODevice::WriteOnly);
+    file->open((isResuming ? QIODevice::ReadWrite : QIODevice::WriteOnly) | QIODevice::Unbuffered);
+
+    if (!file->isOpen()) {
+        qCWarning(KTP_FTH_MODULE) << "Unable to open" << file->fileName() << "-" << file->errorString();
+        q->setError(KTp::WriteFileError);
+        q->setErrorText(i18n("Unable to open %1: %2", file->fileName(), file->errorString()));
+        channel->cancel();
+        QTimer::singleShot(0, q, SLOT(__k__doEmitResult()));
+        return;
+    }
+
+    if (!preallocatePartFile()) {
+        file->close();
+        channel->cancel();
+        QTimer::singleShot(0, q, SLOT(__k__doEmitResult()));
+        return;
+    }
+
+    // The chunks received are recorded to check the .part file if the
+    // transfer is resumed
+    if (compressed) {
+        ChunkManifest::remove(partUrl.toLocalFile());
+    } else {
+        chunkManifest = QSharedPointer<ChunkManifest>(new ChunkManifest(file->handle()));
+        if (chunkManifest->open(partUrl.toLocalFile(), ChunkManifest::identity(channel), isResuming ? offset : 0)) {
+            chunkManifest->setPosition(offset);
+        } else {
+            chunkManifest.clear();
+        }
+        beginJournalEntry();
+    }
+
+    if (zeroCopy && !compressed && !verify && NativeFileTransfer::isSupported(channel)) {
+        spliceReceiver = new SpliceReceiver(channel, file->handle(), q);
+        spliceReceiver->setMetricsId(metricsId);
+        spliceReceiver->setChunkManifest(chunkManifest);
+        PageCacheIo::Mode ioMode = PageCacheIo::modeFor(channel->size());
+        if (ioMode == PageCacheIo::Direct) {
+            // Spliced data never goes through a user space buffer
+            ioMode = PageCacheIo::DropBehind;
+        }
+        spliceReceiver->setDropBehind(ioMode == PageCacheIo::DropBehind);
+        TransferMetrics::instance()->setIoMode(metricsId, PageCacheIo::modeName(ioMode));
+    } else {
+        // Data received through the QIODevice is written to disk by the
+        // disk I/O threads
+        writeBehindFile = new WriteBehindFile(file->handle(), q);
+        writeBehindFile->setMetricsId(metricsId);
+        writeBehindFile->setChunkManifest(chunkManifest);
+        const PageCacheIo::Mode ioMode = writeBehindFile->setIoMode(PageCacheIo::modeFor(TransferCompression::fileSize(channel)));
+        TransferMetrics::instance()->setIoMode(metricsId, PageCacheIo::modeName(ioMode));
+        if (verify) {
+            writeBehindFile->enableHashing(hashAlgorithm);
+        }
+        writeBehindFile->open(QIODevice::WriteOnly | QIODevice::Unbuffered);
+        writeBehindFile->seek(offset);
+        q->connect(writeBehindFile,
+                   SIGNAL(drained()),
+                   SLOT(__k__onWriteBehindFileDrained()));
+        q->connect(writeBehindFile,
+                   SIGNAL(writeFailed(QString)),
+                   SLOT(__k__onWriteBehindFileWriteFailed(QString)));
+    }
+
+    if (compressed) {
+        createInflateWriter(writeBehindFile);
+    }
 
     // Create an empty file with the definitive file name
     QFile realFile(url.toLocalFile(), 0);
@@ -365,12 +746,201 @@ void HandleIncomingFileTransferChannelJobPrivate::receiveFile()
                SLOT(__k__onSetUriOperationFinished(Tp::PendingOperation*)));
 }
 
+// Returns false if the job has to wait or fail
+bool HandleIncomingFileTransferChannelJobPrivate::reserveSpace()
+{
+    Q_Q(HandleIncomingFileTransferChannelJob);
+
+    // Without the uncompressed size, the compressed length is at least a
+    // lower bound
+    qulonglong size = TransferCompression::fileSize(channel);
+    if (size == Q_UINT64_C(0xFFFFFFFFFFFFFFFF)) {
+        size = channel->size();
+    }
+    if (size == 0 || size == Q_UINT64_C(0xFFFFFFFFFFFFFFFF)) {
+        spaceReserved = true;
+        return true;
+    }
+
+    const qulonglong needed = size > offset ? size - offset : 0;
+    const QString directory = QFileInfo(partUrl.toLocalFile()).absolutePath();
+    switch (DiskSpaceLedger::instance()->reserve(q, directory, needed, offset)) {
+    case DiskSpaceLedger::Reserved:
+        spaceReserved = true;
+        return true;
+    case DiskSpaceLedger::Queued:
+        releaseSlot();
+        q->connect(DiskSpaceLedger::instance(),
+                   SIGNAL(reservationDone(KJob*,bool)),
+                   SLOT(__k__onSpaceReservationDone(KJob*,bool)));
+        Q_EMIT q->infoMessage(q, i18n("Waiting for other transfers to free disk space"));
+        return false;
+    case DiskSpaceLedger::NotEnoughSpace:
+    default:
+        failNotEnoughSpace(needed);
+        return false;
+    }
+}
+
+void HandleIncomingFileTransferChannelJobPrivate::__k__onSpaceReservationDone(KJob *job, bool reserved)
+{
+    Q_Q(HandleIncomingFileTransferChannelJob);
+
+    if (job != q) {
+        return;
+    }
+    q->disconnect(DiskSpaceLedger::instance(), SIGNAL(reservationDone(KJob*,bool)),
+                  q, SLOT(__k__onSpaceReservationDone(KJob*,bool)));
+
+    if (!reserved) {
+        failNotEnoughSpace(channel->size() - offset);
+        return;
+    }
+    spaceReserved = true;
+    receiveFile();
+}
+
+void HandleIncomingFileTransferChannelJobPrivate::releaseSlot()
+{
+    Q_Q(HandleIncomingFileTransferChannelJob);
+
+    if (!slotReleased) {
+        slotReleased = true;
+        Q_EMIT q->waiting(q);
+    }
+}
+
+// Returns false if the job has to wait for a slot first
+bool HandleIncomingFileTransferChannelJobPrivate::acquireSlot()
+{
+    Q_Q(HandleIncomingFileTransferChannelJob);
+
+    if (!slotReleased) {
+        return true;
+    }
+    if (!slotRequested) {
+        slotRequested = true;
+        Q_EMIT q->readyToTransfer(q);
+    }
+    return false;
+}
+
+void HandleIncomingFileTransferChannelJobPrivate::__k__onSlotGranted(KJob *job)
+{
+    Q_Q(HandleIncomingFileTransferChannelJob);
+
+    if (job != q || !slotRequested) {
+        return;
+    }
+    slotReleased = false;
+    slotRequested = false;
+    receiveFile();
+}
+
+void HandleIncomingFileTransferChannelJobPrivate::failNotEnoughSpace(qulonglong needed)
+{
+    Q_Q(HandleIncomingFileTransferChannelJob);
+
+    q->setError(KTp::NotEnoughSpaceError);
+    q->setErrorText(i18n("There is not enough space to save %1 (%2 needed)",
+                         url.toLocalFile(), KIO::convertSize(needed)));
+    channel->cancel();
+    QTimer::singleShot(0, q, SLOT(__k__doEmitResult()));
+}
+
+void HandleIncomingFileTransferChannelJobPrivate::receiveArchive()
+{
+    qCDebug(KTP_FTH_MODULE);
+    Q_Q(HandleIncomingFileTransferChannelJob);
+
+    // The archive is unpacked while it is received in the .part directory,
+    // renamed when the transfer is completed. Archives are never resumed,
+    // what a previous attempt left would be mixed with the new entries.
+    removePath(partUrl.toLocalFile());
+
+    tarReader = new TarReader(partUrl.toLocalFile(), q);
+    if (!tarReader->open(QIODevice::WriteOnly)) {
+        qCWarning(KTP_FTH_MODULE) << "Unable to extract to" << partUrl.toLocalFile() << "-" << tarReader->errorString();
+        q->setError(KTp::WriteFileError);
+        q->setErrorText(i18n("Unable to open %1: %2", partUrl.toLocalFile(), tarReader->errorString()));
+        channel->cancel();
+        QTimer::singleShot(0, q, SLOT(__k__doEmitResult()));
+        return;
+    }
+    q->connect(tarReader,
+               SIGNAL(entryStarted(QString)),
+               SLOT(__k__onArchiveEntryStarted(QString)));
+    q->connect(tarReader,
+               SIGNAL(finished()),
+               SLOT(__k__onStreamFinished()));
+    q->connect(tarReader,
+               SIGNAL(writeFailed(QString)),
+               SLOT(__k__onWriteBehindFileWriteFailed(QString)));
+
+    if (TransferCompression::isCompressed(channel)) {
+        createInflateWriter(tarReader);
+    }
+
+    Tp::PendingOperation* setUriOperation = channel->setUri(url.url());
+    q->connect(setUriOperation,
+               SIGNAL(finished(Tp::PendingOperation*)),
+               SLOT(__k__onSetUriOperationFinished(Tp::PendingOperation*)));
+}
+
+void HandleIncomingFileTransferChannelJobPrivate::createInflateWriter(QIODevice *sink)
+{
+    qCDebug(KTP_FTH_MODULE) << "Receiving compressed data";
+    Q_Q(HandleIncomingFileTransferChannelJob);
+
+    inflateWriter = new InflateWriter(sink, q);
+    inflateWriter->open(QIODevice::WriteOnly);
+    q->connect(inflateWriter,
+               SIGNAL(finished()),
+               SLOT(__k__onStreamFinished()));
+    q->connect(inflateWriter,
+               SIGNAL(writeFailed(QString)),
+               SLOT(__k__onWriteBehindFileWriteFailed(QString)));
+}
+
+bool HandleIncomingFileTransferChannelJobPrivate::preallocatePartFile()
+{
+    qCDebug(KTP_FTH_MODULE);
+    Q_Q(HandleIncomingFileTransferChannelJob);
+
+    const qulonglong size = TransferCompression::fileSize(channel);
+    if (size == 0 || size == Q_UINT64_C(0xFFFFFFFFFFFFFFFF)) {
+        return true;
+    }
+
+    // Reserve the whole file at once to avoid fragmentation. The size of the
+    // file is left unchanged, since the size of the .part file is used as
+    // offset when resuming.
+    if (::fallocate(file->handle(), FALLOC_FL_KEEP_SIZE, 0, size) == 0) {
+        DiskSpaceLedger::instance()->setAllocated(q);
+        return true;
+    }
+
+    if (errno != ENOSPC && errno != EFBIG) {
+        // Most likely the filesystem does not support it, nothing to worry about
+        qCDebug(KTP_FTH_MODULE) << "Unable to preallocate" << file->fileName() << "-" << strerror(errno);
+        return true;
+    }
+
+    qCWarning(KTP_FTH_MODULE) << "Not enough space for" << file->fileName() << "-" << strerror(errno);
+    q->setError(KTp::NotEnoughSpaceError);
+    q->setErrorText(i18n("There is not enough space to save %1 (%2 needed)",
+                         url.toLocalFile(), KIO::convertSize(size - offset)));
+    return false;
+}
+
 bool HandleIncomingFileTransferChannelJobPrivate::kill()
 {
     qCDebug(KTP_FTH_MODULE);
     Q_Q(HandleIncomingFileTransferChannelJob);
 
     if (channel->state() != Tp::FileTransferStateCancelled) {
+        // Cancelled by the user, it is not going to be resumed automatically
+        endJournalEntry();
         Tp::PendingOperation *cancelOperation = channel->cancel();
         q->connect(cancelOperation,
                    SIGNAL(finished(Tp::PendingOperation*)),
@@ -393,24 +963,73 @@ void HandleIncomingFileTransferChannelJobPrivate::__k__onSetUriOperationFinished
         qCWarning(KTP_FTH_MODULE) << "Unable to set the URI -" << op->errorName() << ":" << op->errorMessage();
     }
 
-    KIO::getJobTracker()->registerJob(q);
-    // KWidgetJobTracker has an internal timer of 500 ms, if we don't wait here
-    // when the job description is emitted it won't be ready
-    // We set the description here and then whe update it if path is changed.
+    // Accept before registering the job, the job tracker might have to be
+    // loaded first
+    __k__acceptFile();
 
-    QTimer::singleShot(500, q, SLOT(__k__acceptFile()));
+    LogJobTracker::transferTracker()->registerJob(q);
+    // KWidgetJobTracker has an internal timer of 500 ms, a description
+    // emitted before the widget is ready is lost, therefore it is emitted
+    // again later. The transfer does not wait for it.
+    __k__emitDescription();
+    QTimer::singleShot(500, q, SLOT(__k__emitDescription()));
 }
 
-void HandleIncomingFileTransferChannelJobPrivate::__k__acceptFile()
+void HandleIncomingFileTransferChannelJobPrivate::__k__emitDescription()
 {
-    qCDebug(KTP_FTH_MODULE);
     Q_Q(HandleIncomingFileTransferChannelJob);
 
     Q_EMIT q->description(q, i18n("Incoming file transfer"),
-                          qMakePair<QString, QString>(i18n("From"), channel->targetContact()->alias()),
+                          qMakePair<QString, QString>(i18n("From"), contactName(channel)),
                           qMakePair<QString, QString>(i18n("Filename"), url.toLocalFile()));
+}
+
+void HandleIncomingFileTransferChannelJobPrivate::__k__acceptFile()
+{
+    qCDebug(KTP_FTH_MODULE);
+    Q_Q(HandleIncomingFileTransferChannelJob);
 
-    Tp::PendingOperation* acceptFileOperation = channel->acceptFile(offset, file);
+    if (spliceReceiver) {
+        q->connect(spliceReceiver,
+                   SIGNAL(transferredBytesChanged(qulonglong)),
+                   SLOT(__k__onNativeTransferredBytesChanged(qulonglong)));
+        q->connect(spliceReceiver,
+                   SIGNAL(finished()),
+                   SLOT(__k__onNativeTransferFinished()));
+        q->connect(spliceReceiver,
+                   SIGNAL(failed(QString,QString)),
+                   SLOT(__k__onNativeTransferFailed(QString,QString)));
+        spliceReceiver->accept(offset);
+        return;
+    }
+
+    QIODevice *output = writeBehindFile;
+    if (inflateWriter) {
+        output = inflateWriter;
+    } else if (tarReader) {
+        output = tarReader;
+    }
+
+    // On its own socket the handler can stop reading while the disk is
+    // behind, TelepathyQt would queue everything in memory
+    if (SocketStream::isSupported(channel)) {
+        streamReceiver = new StreamReceiver(channel, q);
+        streamReceiver->setWriteQueue(writeBehindFile);
+        q->connect(streamReceiver,
+                   SIGNAL(finished()),
+                   SLOT(__k__onStreamFinished()));
+        q->connect(streamReceiver,
+                   SIGNAL(failed(QString,QString)),
+                   SLOT(__k__onNativeTransferFailed(QString,QString)));
+        streamReceiver->accept(offset, output);
+        return;
+    }
+
+    if (BandwidthLimiter::instance()->isEnabled()) {
+        qCWarning(KTP_FTH_MODULE) << "Bandwidth limits cannot be enforced on the sockets offered for" << channel->fileName();
+    }
+
+    Tp::PendingOperation* acceptFileOperation = channel->acceptFile(offset, output);
     q->connect(acceptFileOperation,
                SIGNAL(finished(Tp::PendingOperation*)),
                SLOT(__k__onAcceptFileFinished(Tp::PendingOperation*)));
@@ -430,8 +1049,30 @@ void HandleIncomingFileTransferChannelJobPrivate::__k__onInitialOffsetDefined(qu
 
     this->offset = offset;
 
-    file->seek(offset);
-    q->setProcessedAmountAndCalculateSpeed(offset);
+    // Drop anything after the offset, the connection manager might have
+    // decided to restart from a different position. Truncating drops the
+    // blocks preallocated beyond the end of the file, therefore the file is
+    // only truncated if needed, and preallocated again afterwards.
+    if (file && offset != qulonglong(file->size())) {
+        file->resize(offset);
+        if (!preallocatePartFile()) {
+            channel->cancel();
+            QTimer::singleShot(0, q, SLOT(__k__doEmitResult()));
+            return;
+        }
+    }
+    if (chunkManifest) {
+        chunkManifest->setPosition(offset);
+    }
+    if (spliceReceiver) {
+        spliceReceiver->setInitialOffset(offset);
+    } else if (writeBehindFile) {
+        writeBehindFile->seek(offset);
+    }
+    if (streamReceiver) {
+        streamReceiver->setInitialOffset(offset);
+    }
+    q->setInitialProcessedAmount(offset);
 }
 
 void HandleIncomingFileTransferChannelJobPrivate::__k__onFileTransferChannelStateChanged(Tp::FileTransferState state,
@@ -451,24 +1092,38 @@ void HandleIncomingFileTransferChannelJobPrivate::__k__onFileTransferChannelStat
         QTimer::singleShot(0, q, SLOT(__k__doEmitResult()));
         break;
     case Tp::FileTransferStateCompleted:
-    {
-        QFileInfo fileinfo(url.toLocalFile());
-        if (fileinfo.exists()) {
-            QFile::remove(url.toLocalFile());
+        if (isDataTruncated()) {
+            failIncompleteData();
+            break;
         }
-        file->rename(url.toLocalFile());
-        file->flush();
-        file->close();
-        qCDebug(KTP_FTH_MODULE) << "Incoming file transfer completed, saved at" << file->fileName();
-        Q_EMIT q->infoMessage(q, i18n("Incoming file transfer")); // [Finished] is added automatically to the notification
-        QTimer::singleShot(0, q, SLOT(__k__doEmitResult()));
+        if (isDataPending()) {
+            qCDebug(KTP_FTH_MODULE) << "Waiting for the remaining data to be written";
+            completionPending = true;
+            // The sockets of the handler tell when the data ends, TelepathyQt
+            // does not
+            if (!streamReceiver && !spliceReceiver) {
+                QTimer::singleShot(CompletionTimeout, q, SLOT(__k__onCompletionTimeout()));
+            }
+            break;
+        }
+        completeTransfer();
         break;
-    }
     case Tp::FileTransferStateCancelled:
     {
-        q->setError(KTp::FileTransferCancelled);
-        q->setErrorText(i18n("Incoming file transfer was canceled."));
+        // Keep the error if the transfer was cancelled by us because of it
+        if (!q->error()) {
+            q->setError(KTp::FileTransferCancelled);
+            q->setErrorText(i18n("Incoming file transfer was canceled."));
+        }
+        // Keep the journal entry if the sender or the connection went away,
+        // the transfer is resumed when the file is offered again
+        if (stateReason == Tp::FileTransferStateChangeReasonLocalStopped) {
+            endJournalEntry();
+        }
         // Close .part file if open
+        if (writeBehindFile) {
+            writeBehindFile->close();
+        }
         if (file && file->isOpen()) {
             file->close();
         }
@@ -483,15 +1138,96 @@ void HandleIncomingFileTransferChannelJobPrivate::__k__onFileTransferChannelStat
     }
 }
 
-void HandleIncomingFileTransferChannelJobPrivate::__k__onFileTransferChannelTransferredBytesChanged(qulonglong count)
+void HandleIncomingFileTransferChannelJobPrivate::completeTransfer()
 {
     qCDebug(KTP_FTH_MODULE);
     Q_Q(HandleIncomingFileTransferChannelJob);
 
-    qCDebug(KTP_FTH_MODULE).nospace() << "Receiving " << channel->fileName() << " - "
-                       << "transferred bytes" << " = " << offset + count << " ("
-                       << ((int)(((double)(offset + count) / channel->size()) * 100)) << "% done)";
-    q->setProcessedAmountAndCalculateSpeed(offset + count);
+    completionPending = false;
+
+    if (tarReader) {
+        // Only what the user agreed to overwrite is deleted, anything else
+        // found at the destination is kept under another name
+        const QFileInfo existing(url.toLocalFile());
+        if (existing.exists() || existing.isSymLink()) {
+            if (overwriteConfirmed) {
+                removePath(url.toLocalFile());
+            } else {
+                const QString aside = ConflictResolver::uniqueUrl(url).toLocalFile();
+                qCDebug(KTP_FTH_MODULE) << "Moving" << url.toLocalFile() << "to" << aside;
+                QDir().rename(url.toLocalFile(), aside);
+            }
+        }
+        if (!QDir().rename(partUrl.toLocalFile(), url.toLocalFile())) {
+            qCWarning(KTP_FTH_MODULE) << "Unable to rename" << partUrl.toLocalFile() << "to" << url.toLocalFile();
+            q->setError(KTp::WriteFileError);
+            q->setErrorText(i18n("Unable to save the received directory at %1, it was left at %2",
+                                 url.toLocalFile(), partUrl.toLocalFile()));
+            QTimer::singleShot(0, q, SLOT(__k__doEmitResult()));
+            return;
+        }
+        qCDebug(KTP_FTH_MODULE) << "Incoming archive completed," << tarReader->entryCount() << "entries saved at" << url.toLocalFile();
+        Q_EMIT q->infoMessage(q, i18n("Incoming file transfer"));
+        QTimer::singleShot(0, q, SLOT(__k__doEmitResult()));
+        return;
+    }
+
+    if (!verifyContentHash()) {
+        return;
+    }
+
+    QFileInfo fileinfo(url.toLocalFile());
+    if (fileinfo.exists()) {
+        QFile::remove(url.toLocalFile());
+    }
+    if (writeBehindFile) {
+        writeBehindFile->close();
+    }
+    chunkManifest.clear();
+    ChunkManifest::remove(partUrl.toLocalFile());
+    endJournalEntry();
+    file->rename(url.toLocalFile());
+    file->flush();
+    file->close();
+    qCDebug(KTP_FTH_MODULE) << "Incoming file transfer completed, saved at" << file->fileName();
+    Q_EMIT q->infoMessage(q, i18n("Incoming file transfer")); // [Finished] is added automatically to the notification
+    QTimer::singleShot(0, q, SLOT(__k__doEmitResult()));
+}
+
+void HandleIncomingFileTransferChannelJobPrivate::__k__onFileTransferChannelTransferredBytesChanged(qulonglong count)
+{
+    // Called for every chunk, keep it cheap
+    Q_Q(HandleIncomingFileTransferChannelJob);
+
+    if (spliceReceiver) {
+        // Progress is reported by the receiver, that knows what actually
+        // reached the disk
+        return;
+    }
+
+    if (count > 0) {
+        recordFirstByte();
+    }
+    if (tarReader) {
+        q->updateProcessedAmount(tarReader->contentPosition());
+        return;
+    }
+    if (inflateWriter) {
+        q->updateProcessedAmount(inflateWriter->uncompressedPosition());
+        return;
+    }
+    q->updateProcessedAmount(offset + count);
+    if (!journalKey.isEmpty()) {
+        TransferJournal::instance()->updateOffset(journalKey, offset + count);
+    }
+}
+
+void HandleIncomingFileTransferChannelJobPrivate::recordFirstByte()
+{
+    if (!firstByteRecorded) {
+        firstByteRecorded = true;
+        TransferMetrics::instance()->recordFirstByte(metricsId);
+    }
 }
 
 void HandleIncomingFileTransferChannelJobPrivate::__k__onAcceptFileFinished(Tp::PendingOperation* op)
@@ -535,4 +1271,204 @@ void HandleIncomingFileTransferChannelJobPrivate::__k__onInvalidated()
     QTimer::singleShot(0, q, SLOT(__k__doEmitResult()));
 }
 
+void HandleIncomingFileTransferChannelJobPrivate::__k__onNativeTransferredBytesChanged(qulonglong position)
+{
+    Q_Q(HandleIncomingFileTransferChannelJob);
+
+    if (position > offset) {
+        recordFirstByte();
+    }
+    q->updateProcessedAmount(position);
+    if (!journalKey.isEmpty()) {
+        TransferJournal::instance()->updateOffset(journalKey, position);
+    }
+}
+
+void HandleIncomingFileTransferChannelJobPrivate::__k__onNativeTransferFinished()
+{
+    qCDebug(KTP_FTH_MODULE);
+
+    if (completionPending && !isDataPending()) {
+        completeTransfer();
+    }
+}
+
+void HandleIncomingFileTransferChannelJobPrivate::__k__onNativeTransferFailed(const QString &errorName, const QString &errorMessage)
+{
+    qCDebug(KTP_FTH_MODULE);
+    Q_Q(HandleIncomingFileTransferChannelJob);
+
+    qCWarning(KTP_FTH_MODULE) << "Native file transfer failed -" << errorName << ":" << errorMessage;
+
+    if (channel->state() == Tp::FileTransferStatePending) {
+        // AcceptFile failed
+        q->setError(KTp::AcceptFileError);
+        q->setErrorText(i18n("Unable to accept file"));
+        QTimer::singleShot(0, q, SLOT(__k__doEmitResult()));
+        return;
+    }
+
+    q->setError(KTp::WriteFileError);
+    q->setErrorText(i18n("Unable to write the received file: %1", errorMessage));
+    if (file && file->isOpen()) {
+        file->close();
+    }
+    kill();
+}
+
+void HandleIncomingFileTransferChannelJobPrivate::__k__onWriteBehindFileDrained()
+{
+    qCDebug(KTP_FTH_MODULE);
+
+    if (completionPending && !isDataPending()) {
+        completeTransfer();
+    }
+}
+
+void HandleIncomingFileTransferChannelJobPrivate::__k__onWriteBehindFileWriteFailed(const QString &errorMessage)
+{
+    qCDebug(KTP_FTH_MODULE);
+    Q_Q(HandleIncomingFileTransferChannelJob);
+
+    qCWarning(KTP_FTH_MODULE) << "Unable to write" << (file ? file->fileName() : partUrl.toLocalFile()) << "-" << errorMessage;
+
+    q->setError(KTp::WriteFileError);
+    q->setErrorText(i18n("Unable to write the received file: %1", errorMessage));
+    completionPending = false;
+    if (file && file->isOpen()) {
+        file->close();
+    }
+    kill();
+}
+
+void HandleIncomingFileTransferChannelJobPrivate::__k__onStreamFinished()
+{
+    qCDebug(KTP_FTH_MODULE);
+
+    if (isDataTruncated()) {
+        failIncompleteData();
+        return;
+    }
+    if (completionPending && !isDataPending()) {
+        completeTransfer();
+    }
+}
+
+void HandleIncomingFileTransferChannelJobPrivate::__k__onCompletionTimeout()
+{
+    if (completionPending && isStreamIncomplete()) {
+        failIncompleteData();
+    }
+}
+
+void HandleIncomingFileTransferChannelJobPrivate::failIncompleteData()
+{
+    Q_Q(HandleIncomingFileTransferChannelJob);
+
+    qCWarning(KTP_FTH_MODULE) << "The data of" << partUrl.toLocalFile() << "ended before the end of the"
+                              << (tarReader ? "archive" : "compressed stream");
+
+    completionPending = false;
+    endJournalEntry();
+    q->setError(KTp::WriteFileError);
+    q->setErrorText(i18n("The received file %1 is incomplete, the data ended unexpectedly", url.toLocalFile()));
+    if (writeBehindFile) {
+        writeBehindFile->close();
+    }
+    if (file && file->isOpen()) {
+        file->close();
+    }
+
+    if (channel->state() == Tp::FileTransferStateCompleted) {
+        QTimer::singleShot(0, q, SLOT(__k__doEmitResult()));
+    } else {
+        kill();
+    }
+}
+
+bool HandleIncomingFileTransferChannelJobPrivate::verifyContentHash()
+{
+    Q_Q(HandleIncomingFileTransferChannelJob);
+
+    QCryptographicHash::Algorithm algorithm;
+    if (!writeBehindFile || !contentHashAlgorithm(channel, &algorithm)) {
+        return true;
+    }
+
+    const QByteArray result = writeBehindFile->hashResult().toHex();
+    if (result.isEmpty()) {
+        qCWarning(KTP_FTH_MODULE) << "Unable to verify" << file->fileName();
+        return true;
+    }
+    if (result == channel->contentHash().toLatin1().toLower()) {
+        qCDebug(KTP_FTH_MODULE) << "Content hash verified" << result;
+        return true;
+    }
+
+    qCWarning(KTP_FTH_MODULE) << "Content hash mismatch for" << file->fileName() << "- expected"
+                              << channel->contentHash() << "got" << result;
+    q->setError(KTp::ContentHashMismatchError);
+    q->setErrorText(i18n("The received file %1 is corrupted, its checksum does not match the one sent by %2",
+                         url.toLocalFile(), contactName(channel)));
+    writeBehindFile->close();
+    file->close();
+
+    // The data is left for inspection under another name, neither the
+    // journal nor the resume dialog may pick it up again
+    chunkManifest.clear();
+    ChunkManifest::remove(partUrl.toLocalFile());
+    endJournalEntry();
+    QUrl corruptUrl = url;
+    corruptUrl.setPath(url.path() + QLatin1String(".corrupt"));
+    corruptUrl = ConflictResolver::uniqueUrl(corruptUrl);
+    if (file->rename(corruptUrl.toLocalFile())) {
+        qCDebug(KTP_FTH_MODULE) << "Corrupted data kept at" << file->fileName();
+    } else {
+        file->remove();
+    }
+    QTimer::singleShot(0, q, SLOT(__k__doEmitResult()));
+    return false;
+}
+
+bool HandleIncomingFileTransferChannelJobPrivate::isDataPending() const
+{
+    // When the connection manager reports the transfer as completed, there
+    // might still be data in the socket, in the inflater or in the write
+    // queue.
+    if (spliceReceiver && !spliceReceiver->isFinished()) {
+        return true;
+    }
+    if (streamReceiver && !streamReceiver->isFinished()) {
+        return true;
+    }
+    if (inflateWriter && !inflateWriter->isFinished()) {
+        return true;
+    }
+    if (tarReader && !tarReader->isFinished()) {
+        return true;
+    }
+    return writeBehindFile && !writeBehindFile->isDrained();
+}
+
+// The compressed stream or the archive did not reach its end
+bool HandleIncomingFileTransferChannelJobPrivate::isStreamIncomplete() const
+{
+    return (inflateWriter && !inflateWriter->isFinished())
+        || (tarReader && !tarReader->isFinished());
+}
+
+// No more data can arrive, but the stream is incomplete
+bool HandleIncomingFileTransferChannelJobPrivate::isDataTruncated() const
+{
+    return streamReceiver && streamReceiver->isFinished() && isStreamIncomplete();
+}
+
+void HandleIncomingFileTransferChannelJobPrivate::__k__onArchiveEntryStarted(const QString &name)
+{
+    Q_Q(HandleIncomingFileTransferChannelJob);
+
+    q->setProcessedAmount(KJob::Files, tarReader->entryCount());
+    Q_EMIT q->infoMessage(q, i18n("Receiving %1", name));
+}
+
 #include "moc_handle-incoming-file-transfer-channel-job.cpp"
@@ -44,9 +44,21 @@ class HandleIncomingFileTransferChannelJob : public KTp::TelepathyBaseJob
     Q_PRIVATE_SLOT(d_func(), void __k__onFileTransferChannelStateChanged(Tp::FileTransferState state, Tp::FileTransferStateChangeReason reason))
     Q_PRIVATE_SLOT(d_func(), void __k__onFileTransferChannelTransferredBytesChanged(qulonglong count))
     Q_PRIVATE_SLOT(d_func(), void __k__acceptFile())
+    Q_PRIVATE_SLOT(d_func(), void __k__emitDescription())
     Q_PRIVATE_SLOT(d_func(), void __k__onAcceptFileFinished(Tp::PendingOperation* op))
     Q_PRIVATE_SLOT(d_func(), void __k__onCancelOperationFinished(Tp::PendingOperation* op))
     Q_PRIVATE_SLOT(d_func(), void __k__onInvalidated())
+    Q_PRIVATE_SLOT(d_func(), void __k__onNativeTransferredBytesChanged(qulonglong position))
+    Q_PRIVATE_SLOT(d_func(), void __k__onNativeTransferFinished())
+    Q_PRIVATE_SLOT(d_func(), void __k__onNativeTransferFailed(const QString &errorName, const QString &errorMessage))
+    Q_PRIVATE_SLOT(d_func(), void __k__onWriteBehindFileDrained())
+    Q_PRIVATE_SLOT(d_func(), void __k__onWriteBehindFileWriteFailed(const QString &errorMessage))
+    Q_PRIVATE_SLOT(d_func(), void __k__onStreamFinished())
+    Q_PRIVATE_SLOT(d_func(), void __k__onCompletionTimeout())
+    Q_PRIVATE_SLOT(d_func(), void __k__onArchiveEntryStarted(const QString &name))
+    Q_PRIVATE_SLOT(d_func(), void __k__onPartFileValidated(int result, qint64 validLength))
+    Q_PRIVATE_SLOT(d_func(), void __k__onSpaceReservationDone(KJob *job, bool reserved))
+    Q_PRIVATE_SLOT(d_func(), void __k__onSlotGranted(KJob *job))
 
 public:
     HandleIncomingFileTransferChannelJob(Tp::IncomingFileTransferChannelPtr channel,
@@ -57,6 +69,18 @@ public:
 
     virtual void start();
     virtual bool doKill();
+
+Q_SIGNALS:
+    /**
+     * The job waits for the user or for disk space, its scheduler slot can
+     * be used by another transfer.
+     */
+    void waiting(KJob *job);
+    /**
+     * The job is ready to move data after waiting, it continues when a slot
+     * is granted to it with __k__onSlotGranted().
+     */
+    void readyToTransfer(KJob *job);
 };
 
 
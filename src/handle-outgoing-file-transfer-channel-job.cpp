@@ -19,11 +19,22 @@
 
 #include "handle-outgoing-file-transfer-channel-job.h"
 #include "telepathy-base-job_p.h"
+#include "bandwidth-limiter.h"
+#include "compression-device.h"
+#include "content-hash-cache.h"
+#include "file-transfer-config.h"
+#include "log-job-tracker.h"
+#include "page-cache-io.h"
+#include "sendfile-sender.h"
+#include "stream-sender.h"
+#include "tar-stream.h"
+#include "transfer-metrics.h"
 #include "ktp-fth-debug.h"
 
 #include <QTimer>
 #include <QDebug>
 #include <QUrl>
+#include <QFileInfo>
 
 #include <KLocalizedString>
 #include <kio/global.h>
@@ -46,20 +57,46 @@ public:
     QFile* file;
     QUrl uri;
     qulonglong offset;
+    SendfileSender* sendfileSender;
+    StreamSender* streamSender;
+    DeflateReader* deflateReader;
+    TarWriter* tarWriter;
+    ReadAheadWindow* readAhead;
+    int metricsId;
+    bool firstByteRecorded;
+    bool started;
 
     void init();
+    void recordFirstByte();
+    void warmContentHashCache();
+    void startReadAhead(PageCacheIo::Mode ioMode);
     bool kill();
     void provideFile();
+    void provideSource(QIODevice *source);
 
     void __k__start();
+    void __k__emitDescription();
     void __k__onInitialOffsetDefined(qulonglong offset);
     void __k__onFileTransferChannelStateChanged(Tp::FileTransferState state, Tp::FileTransferStateChangeReason reason);
     void __k__onFileTransferChannelTransferredBytesChanged(qulonglong count);
     void __k__onProvideFileFinished(Tp::PendingOperation* op);
     void __k__onCancelOperationFinished(Tp::PendingOperation* op);
     void __k__onInvalidated();
+    void __k__onNativeTransferredBytesChanged(qulonglong position);
+    void __k__onNativeTransferFailed(const QString &errorName, const QString &errorMessage);
+    void __k__onArchiveEntryStarted(const QString &name);
 };
 
+// Name of the contact for the messages, the contact might not be known
+static QString contactName(const Tp::FileTransferChannelPtr &channel)
+{
+    const Tp::ContactPtr contact = channel->targetContact();
+    if (!contact) {
+        return QString();
+    }
+    return contact->alias().isEmpty() ? contact->id() : contact->alias();
+}
+
 HandleOutgoingFileTransferChannelJob::HandleOutgoingFileTransferChannelJob(Tp::OutgoingFileTransferChannelPtr channel,
                                                                            QObject* parent)
     : TelepathyBaseJob(*new HandleOutgoingFileTransferChannelJobPrivate(), parent)
@@ -73,17 +110,14 @@ HandleOutgoingFileTransferChannelJob::HandleOutgoingFileTransferChannelJob(Tp::O
 
 HandleOutgoingFileTransferChannelJob::~HandleOutgoingFileTransferChannelJob()
 {
-    KIO::getJobTracker()->unregisterJob(this);
+    LogJobTracker::transferTracker()->unregisterJob(this);
     qCDebug(KTP_FTH_MODULE);
 }
 
 void HandleOutgoingFileTransferChannelJob::start()
 {
     qCDebug(KTP_FTH_MODULE);
-    KIO::getJobTracker()->registerJob(this);
-    // KWidgetJobTracker has an internal timer of 500 ms, if we don't wait here
-    // when the job description is emitted it won't be ready
-    QTimer::singleShot(500, this, SLOT(__k__start()));
+    QTimer::singleShot(0, this, SLOT(__k__start()));
 }
 
 bool HandleOutgoingFileTransferChannelJob::doKill()
@@ -95,13 +129,22 @@ bool HandleOutgoingFileTransferChannelJob::doKill()
 
 HandleOutgoingFileTransferChannelJobPrivate::HandleOutgoingFileTransferChannelJobPrivate()
     : file(0),
-      offset(0)
+      offset(0),
+      sendfileSender(0),
+      streamSender(0),
+      deflateReader(0),
+      tarWriter(0),
+      readAhead(0),
+      metricsId(-1),
+      firstByteRecorded(false),
+      started(false)
 {
     qCDebug(KTP_FTH_MODULE);
 }
 
 HandleOutgoingFileTransferChannelJobPrivate::~HandleOutgoingFileTransferChannelJobPrivate()
 {
+    delete readAhead;
     qCDebug(KTP_FTH_MODULE);
 }
 
@@ -145,8 +188,10 @@ void HandleOutgoingFileTransferChannelJobPrivate::init()
     }
 
     q->setCapabilities(KJob::Killable);
+    q->setProgressUpdatesPerSecond(FileTransferConfig::instance()->progressUpdatesPerSecond());
+    q->setAverageSpeed(FileTransferConfig::instance()->averageSpeed());
     q->setTotalAmount(KJob::Bytes, channel->size());
-    q->setProcessedAmountAndCalculateSpeed(0);
+    q->setInitialProcessedAmount(0);
 
     q->connect(channel.data(),
                SIGNAL(invalidated(Tp::DBusProxy*,QString,QString)),
@@ -160,6 +205,14 @@ void HandleOutgoingFileTransferChannelJobPrivate::init()
     q->connect(channel.data(),
                SIGNAL(transferredBytesChanged(qulonglong)),
                SLOT(__k__onFileTransferChannelTransferredBytesChanged(qulonglong)));
+
+    // Registered while the job might still be queued by the scheduler, the
+    // user sees the file waiting for its turn. KWidgetJobTracker has an
+    // internal timer of 500 ms, a description emitted before the widget is
+    // ready is lost, therefore it is emitted again later.
+    LogJobTracker::transferTracker()->registerJob(q);
+    QTimer::singleShot(0, q, SLOT(__k__emitDescription()));
+    QTimer::singleShot(500, q, SLOT(__k__emitDescription()));
 }
 
 void HandleOutgoingFileTransferChannelJobPrivate::__k__start()
@@ -174,15 +227,23 @@ void HandleOutgoingFileTransferChannelJobPrivate::__k__start()
         return;
     }
 
-    Q_EMIT q->description(q, i18n("Outgoing file transfer"),
-                          qMakePair<QString, QString>(i18n("To"), channel->targetContact()->alias()),
-                          qMakePair<QString, QString>(i18n("Filename"), channel->uri()));
+    metricsId = TransferMetrics::instance()->transferId(q);
+    started = true;
 
     if (channel->state() == Tp::FileTransferStateAccepted) {
         provideFile();
     }
 }
 
+void HandleOutgoingFileTransferChannelJobPrivate::__k__emitDescription()
+{
+    Q_Q(HandleOutgoingFileTransferChannelJob);
+
+    Q_EMIT q->description(q, i18n("Outgoing file transfer"),
+                          qMakePair<QString, QString>(i18n("To"), contactName(channel)),
+                          qMakePair<QString, QString>(i18n("Filename"), channel->uri()));
+}
+
 bool HandleOutgoingFileTransferChannelJobPrivate::kill()
 {
     qCDebug(KTP_FTH_MODULE);
@@ -206,7 +267,13 @@ void HandleOutgoingFileTransferChannelJobPrivate::__k__onInitialOffsetDefined(qu
     Q_Q(HandleOutgoingFileTransferChannelJob);
 
     this->offset = offset;
-    q->setProcessedAmountAndCalculateSpeed(offset);
+    if (sendfileSender) {
+        sendfileSender->setInitialOffset(offset);
+    }
+    if (streamSender) {
+        streamSender->setInitialOffset(offset);
+    }
+    q->setInitialProcessedAmount(offset);
 }
 
 void HandleOutgoingFileTransferChannelJobPrivate::__k__onFileTransferChannelStateChanged(Tp::FileTransferState state,
@@ -231,12 +298,18 @@ void HandleOutgoingFileTransferChannelJobPrivate::__k__onFileTransferChannelStat
         QTimer::singleShot(0, q, SLOT(__k__doEmitResult()));
         break;
     case Tp::FileTransferStateCancelled:
-        q->setError(KTp::FileTransferCancelled);
-        q->setErrorText(i18n("Outgoing file transfer was canceled."));
+        // Keep the error if the transfer was cancelled by us because of it
+        if (!q->error()) {
+            q->setError(KTp::FileTransferCancelled);
+            q->setErrorText(i18n("Outgoing file transfer was canceled."));
+        }
         q->kill(KJob::Quietly);
         break;
     case Tp::FileTransferStateAccepted:
-        provideFile();
+        // A queued job provides the file when it is started
+        if (started) {
+            provideFile();
+        }
         break;
     case Tp::FileTransferStatePending:
     case Tp::FileTransferStateOpen:
@@ -253,21 +326,207 @@ void HandleOutgoingFileTransferChannelJobPrivate::provideFile()
     file = new QFile(uri.toLocalFile(), q->parent());
     qCDebug(KTP_FTH_MODULE) << "Providing file" << file->fileName();
 
-    Tp::PendingOperation* provideFileOperation = channel->provideFile(file);
+    const bool zeroCopy = FileTransferConfig::instance()->zeroCopy();
+
+    const bool archive = TransferArchive::isArchive(channel) && QFileInfo(file->fileName()).isDir();
+    const bool compressed = TransferCompression::isCompressed(channel);
+
+    // Huge files are read ahead and do not stay in the page cache. Reads
+    // never use O_DIRECT, the direct mode only applies to received data.
+    PageCacheIo::Mode ioMode = archive ? PageCacheIo::Buffered : PageCacheIo::modeFor(file->size());
+    if (ioMode == PageCacheIo::Direct) {
+        ioMode = PageCacheIo::DropBehind;
+    }
+    TransferMetrics::instance()->setIoMode(metricsId, PageCacheIo::modeName(ioMode));
+
+    // A receiver unaware of the compression would save the zlib stream, and
+    // the Size of the channel is the compressed length anyway
+    if (compressed && !TransferCompression::isSupportedBy(channel->targetContact())) {
+        qCWarning(KTP_FTH_MODULE) << "The receiver of" << file->fileName() << "does not advertise compression support";
+        q->setError(KTp::ProvideFileError);
+        q->setErrorText(i18n("The recipient cannot receive compressed files"));
+        channel->cancel();
+        QTimer::singleShot(0, q, SLOT(__k__doEmitResult()));
+        return;
+    }
+
+    if (!archive) {
+        warmContentHashCache();
+    }
+
+    if (archive || compressed) {
+        QIODevice *source = file;
+        if (archive) {
+            // The archive is produced while it is sent
+            tarWriter = new TarWriter(file->fileName(), q);
+            source = tarWriter;
+            q->connect(tarWriter,
+                       SIGNAL(entryStarted(QString)),
+                       SLOT(__k__onArchiveEntryStarted(QString)));
+        }
+
+        if (!source->open(QIODevice::ReadOnly)) {
+            qCWarning(KTP_FTH_MODULE) << "Unable to open" << file->fileName() << "-" << source->errorString();
+            q->setError(KTp::ProvideFileError);
+            q->setErrorText(i18n("Cannot provide file"));
+            QTimer::singleShot(0, q, SLOT(__k__doEmitResult()));
+            return;
+        }
+
+        if (tarWriter) {
+            // Connection managers stop at the Size, a different one would
+            // truncate the archive or never complete
+            const qulonglong size = channel->size();
+            if (!compressed && size != Q_UINT64_C(0xFFFFFFFFFFFFFFFF) && size != tarWriter->archiveSize()) {
+                qCWarning(KTP_FTH_MODULE) << "The archive of" << file->fileName() << "is" << tarWriter->archiveSize()
+                                          << "bytes long, the size of the channel is" << size;
+                q->setError(KTp::ProvideFileError);
+                q->setErrorText(i18n("The directory %1 changed since it was offered", file->fileName()));
+                channel->cancel();
+                QTimer::singleShot(0, q, SLOT(__k__doEmitResult()));
+                return;
+            }
+            q->setTotalAmount(KJob::Bytes, tarWriter->archiveSize());
+            q->setTotalAmount(KJob::Files, tarWriter->entryCount());
+        } else {
+            startReadAhead(ioMode);
+        }
+
+        if (compressed) {
+            qCDebug(KTP_FTH_MODULE) << "Sending compressed data";
+            deflateReader = new DeflateReader(source, q);
+            deflateReader->open(QIODevice::ReadOnly);
+            source = deflateReader;
+        }
+
+        provideSource(source);
+        return;
+    }
+
+    if (zeroCopy && NativeFileTransfer::isSupported(channel)) {
+        if (!file->open(QIODevice::ReadOnly | QIODevice::Unbuffered)) {
+            qCWarning(KTP_FTH_MODULE) << "Unable to open" << file->fileName() << "-" << file->errorString();
+            q->setError(KTp::ProvideFileError);
+            q->setErrorText(i18n("Cannot provide file"));
+            QTimer::singleShot(0, q, SLOT(__k__doEmitResult()));
+            return;
+        }
+
+        startReadAhead(ioMode);
+        sendfileSender = new SendfileSender(channel, file->handle(), q);
+        sendfileSender->setInitialOffset(offset);
+        sendfileSender->setMetricsId(metricsId);
+        q->connect(sendfileSender,
+                   SIGNAL(transferredBytesChanged(qulonglong)),
+                   SLOT(__k__onNativeTransferredBytesChanged(qulonglong)));
+        q->connect(sendfileSender,
+                   SIGNAL(failed(QString,QString)),
+                   SLOT(__k__onNativeTransferFailed(QString,QString)));
+        sendfileSender->provide();
+        return;
+    }
+
+    // The channel opens the file itself, unless the file descriptor is
+    // needed before or the handler sends it
+    const bool limited = BandwidthLimiter::instance()->isEnabled() && SocketStream::isSupported(channel);
+    if (ioMode != PageCacheIo::Buffered || limited) {
+        if (!file->open(QIODevice::ReadOnly)) {
+            qCWarning(KTP_FTH_MODULE) << "Unable to open" << file->fileName() << "-" << file->errorString();
+            q->setError(KTp::ProvideFileError);
+            q->setErrorText(i18n("Cannot provide file"));
+            QTimer::singleShot(0, q, SLOT(__k__doEmitResult()));
+            return;
+        }
+        startReadAhead(ioMode);
+    }
+
+    provideSource(file);
+}
+
+void HandleOutgoingFileTransferChannelJobPrivate::provideSource(QIODevice *source)
+{
+    Q_Q(HandleOutgoingFileTransferChannelJob);
+
+    // A source opened by the handler is sent on its own socket, where the
+    // bandwidth limits are enforced
+    if (source->isOpen() && SocketStream::isSupported(channel)) {
+        streamSender = new StreamSender(channel, q);
+        streamSender->setInitialOffset(offset);
+        q->connect(streamSender,
+                   SIGNAL(failed(QString,QString)),
+                   SLOT(__k__onNativeTransferFailed(QString,QString)));
+        streamSender->provide(source);
+        return;
+    }
+
+    if (BandwidthLimiter::instance()->isEnabled()) {
+        qCWarning(KTP_FTH_MODULE) << "Bandwidth limits cannot be enforced on the sockets offered for" << channel->uri();
+    }
+
+    Tp::PendingOperation* provideFileOperation = channel->provideFile(source);
     q->connect(provideFileOperation,
                SIGNAL(finished(Tp::PendingOperation*)),
                SLOT(__k__onProvideFileFinished(Tp::PendingOperation*)));
 }
 
+void HandleOutgoingFileTransferChannelJobPrivate::startReadAhead(PageCacheIo::Mode ioMode)
+{
+    if (ioMode != PageCacheIo::Buffered) {
+        qCDebug(KTP_FTH_MODULE) << "Reading" << file->fileName() << "ahead, without keeping it in the page cache";
+        readAhead = new ReadAheadWindow(file->handle(), offset);
+    }
+}
+
+// Hashes the file in the background while it is sent, so that it can be
+// announced the next time it is sent
+void HandleOutgoingFileTransferChannelJobPrivate::warmContentHashCache()
+{
+    const uint hashType = channel->contentHashType() != Tp::FileHashTypeNone ? uint(channel->contentHashType())
+                                                                            : uint(Tp::FileHashTypeSHA256);
+    const QString hash = ContentHashCache::instance()->lookup(file->fileName(), hashType);
+    if (!hash.isEmpty() && !channel->contentHash().isEmpty()
+            && hash.compare(channel->contentHash(), Qt::CaseInsensitive) != 0) {
+        qCWarning(KTP_FTH_MODULE) << file->fileName() << "changed after its hash was announced,"
+                                  << "the receiver will not be able to verify it";
+    }
+}
+
 void HandleOutgoingFileTransferChannelJobPrivate::__k__onFileTransferChannelTransferredBytesChanged(qulonglong count)
 {
-    qCDebug(KTP_FTH_MODULE);
+    // Called for every chunk, keep it cheap
     Q_Q(HandleOutgoingFileTransferChannelJob);
 
-    qCDebug(KTP_FTH_MODULE).nospace() << "Sending " << channel->fileName() << " - "
-                       << "Transferred bytes = " << offset + count << " ("
-                       << ((int)(((double)(offset + count) / channel->size()) * 100)) << "% done)";
-    q->setProcessedAmountAndCalculateSpeed(offset + count);
+    if (sendfileSender) {
+        // Progress is reported by the sender
+        return;
+    }
+
+    if (count > 0) {
+        recordFirstByte();
+    }
+    if (readAhead) {
+        readAhead->advance(file->pos());
+    }
+    if (tarWriter) {
+        q->updateProcessedAmount(tarWriter->archivePosition());
+        if (q->processedAmount(KJob::Files) != qulonglong(tarWriter->finishedEntryCount())) {
+            q->setProcessedAmount(KJob::Files, tarWriter->finishedEntryCount());
+        }
+        return;
+    }
+    if (deflateReader) {
+        q->updateProcessedAmount(deflateReader->uncompressedPosition());
+        return;
+    }
+    q->updateProcessedAmount(offset + count);
+}
+
+void HandleOutgoingFileTransferChannelJobPrivate::recordFirstByte()
+{
+    if (!firstByteRecorded) {
+        firstByteRecorded = true;
+        TransferMetrics::instance()->recordFirstByte(metricsId);
+    }
 }
 
 void HandleOutgoingFileTransferChannelJobPrivate::__k__onProvideFileFinished(Tp::PendingOperation* op)
@@ -311,4 +570,44 @@ void HandleOutgoingFileTransferChannelJobPrivate::__k__onInvalidated()
     QTimer::singleShot(0, q, SLOT(__k__doEmitResult()));
 }
 
+void HandleOutgoingFileTransferChannelJobPrivate::__k__onNativeTransferredBytesChanged(qulonglong position)
+{
+    Q_Q(HandleOutgoingFileTransferChannelJob);
+
+    if (position > offset) {
+        recordFirstByte();
+    }
+    if (readAhead) {
+        readAhead->advance(position);
+    }
+    q->updateProcessedAmount(position);
+}
+
+void HandleOutgoingFileTransferChannelJobPrivate::__k__onNativeTransferFailed(const QString &errorName, const QString &errorMessage)
+{
+    qCDebug(KTP_FTH_MODULE);
+    Q_Q(HandleOutgoingFileTransferChannelJob);
+
+    qCWarning(KTP_FTH_MODULE) << "Native file transfer failed -" << errorName << ":" << errorMessage;
+
+    if (channel->state() == Tp::FileTransferStateAccepted) {
+        // ProvideFile failed
+        q->setError(KTp::ProvideFileError);
+        q->setErrorText(i18n("Cannot provide file"));
+        QTimer::singleShot(0, q, SLOT(__k__doEmitResult()));
+        return;
+    }
+
+    q->setError(KTp::ReadFileError);
+    q->setErrorText(i18n("Unable to send the file: %1", errorMessage));
+    kill();
+}
+
+void HandleOutgoingFileTransferChannelJobPrivate::__k__onArchiveEntryStarted(const QString &name)
+{
+    Q_Q(HandleOutgoingFileTransferChannelJob);
+
+    Q_EMIT q->infoMessage(q, i18n("Sending %1", name));
+}
+
 #include "moc_handle-outgoing-file-transfer-channel-job.cpp"
@@ -38,12 +38,16 @@ class HandleOutgoingFileTransferChannelJob : public KTp::TelepathyBaseJob
 
 //     // Our Q_PRIVATE_SLOTS who perform the real job
     Q_PRIVATE_SLOT(d_func(), void __k__start())
+    Q_PRIVATE_SLOT(d_func(), void __k__emitDescription())
     Q_PRIVATE_SLOT(d_func(), void __k__onInitialOffsetDefined(qulonglong offset))
     Q_PRIVATE_SLOT(d_func(), void __k__onFileTransferChannelStateChanged(Tp::FileTransferState state, Tp::FileTransferStateChangeReason reason))
     Q_PRIVATE_SLOT(d_func(), void __k__onFileTransferChannelTransferredBytesChanged(qulonglong count))
     Q_PRIVATE_SLOT(d_func(), void __k__onProvideFileFinished(Tp::PendingOperation* op))
     Q_PRIVATE_SLOT(d_func(), void __k__onCancelOperationFinished(Tp::PendingOperation* op))
     Q_PRIVATE_SLOT(d_func(), void __k__onInvalidated())
+    Q_PRIVATE_SLOT(d_func(), void __k__onNativeTransferredBytesChanged(qulonglong position))
+    Q_PRIVATE_SLOT(d_func(), void __k__onNativeTransferFailed(const QString &errorName, const QString &errorMessage))
+    Q_PRIVATE_SLOT(d_func(), void __k__onArchiveEntryStarted(const QString &name))
 
 
 public:
@@ -0,0 +1,75 @@
+/*
+* Copyright (C) 2026 The KDE Telepathy Team
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this library; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "log-job-tracker.h"
+#include "transfer-ui.h"
+#include "ktp-fth-debug.h"
+
+#include <QCoreApplication>
+
+LogJobTracker::LogJobTracker(QObject *parent)
+    : KJobTrackerInterface(parent)
+{
+}
+
+LogJobTracker::~LogJobTracker()
+{
+}
+
+KJobTrackerInterface *LogJobTracker::transferTracker()
+{
+    if (TransferUi::instance()) {
+        return TransferUi::instance()->jobTracker();
+    }
+
+    static LogJobTracker *tracker = 0;
+    if (!tracker) {
+        tracker = new LogJobTracker(qApp);
+    }
+    return tracker;
+}
+
+void LogJobTracker::finished(KJob *job)
+{
+    if (job->error()) {
+        qCWarning(KTP_FTH_MODULE) << job << "failed:" << job->errorString();
+    } else {
+        qCDebug(KTP_FTH_MODULE) << job << "finished," << job->processedAmount(KJob::Bytes) << "bytes";
+    }
+}
+
+void LogJobTracker::description(KJob *job, const QString &title,
+                                const QPair<QString, QString> &field1,
+                                const QPair<QString, QString> &field2)
+{
+    qCDebug(KTP_FTH_MODULE) << job << title << field1.first << field1.second << field2.first << field2.second;
+}
+
+void LogJobTracker::infoMessage(KJob *job, const QString &plain, const QString &rich)
+{
+    Q_UNUSED(rich);
+    qCDebug(KTP_FTH_MODULE) << job << plain;
+}
+
+void LogJobTracker::warning(KJob *job, const QString &plain, const QString &rich)
+{
+    Q_UNUSED(rich);
+    qCWarning(KTP_FTH_MODULE) << job << plain;
+}
+
+#include "moc_log-job-tracker.cpp"
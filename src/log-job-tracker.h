@@ -0,0 +1,49 @@
+/*
+* Copyright (C) 2026 The KDE Telepathy Team
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this library; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef LOG_JOB_TRACKER_H
+#define LOG_JOB_TRACKER_H
+
+#include <kjobtrackerinterface.h>
+
+/**
+ * Job tracker that only logs what happens to the transfers, used instead of
+ * the widget job tracker when running headless.
+ */
+class LogJobTracker : public KJobTrackerInterface
+{
+    Q_OBJECT
+    Q_DISABLE_COPY(LogJobTracker)
+
+public:
+    explicit LogJobTracker(QObject *parent = 0);
+    virtual ~LogJobTracker();
+
+    /** The tracker of the user interface, or a LogJobTracker if there is none */
+    static KJobTrackerInterface *transferTracker();
+
+protected Q_SLOTS:
+    virtual void finished(KJob *job);
+    virtual void description(KJob *job, const QString &title,
+                             const QPair<QString, QString> &field1,
+                             const QPair<QString, QString> &field2);
+    virtual void infoMessage(KJob *job, const QString &plain, const QString &rich);
+    virtual void warning(KJob *job, const QString &plain, const QString &rich);
+};
+
+#endif // LOG_JOB_TRACKER_H
@@ -16,7 +16,11 @@
  */
 
 #include "filetransfer-handler.h"
+#include "content-hash-cache.h"
+#include "file-transfer-config.h"
+#include "transfer-metrics.h"
 #include "version.h"
+#include "ktp-fth-debug.h"
 
 #include <KTp/telepathy-handler-application.h>
 
@@ -24,14 +28,45 @@
 #include <KLocalizedString>
 
 #include <QDebug>
+#include <QElapsedTimer>
+#include <QFile>
 #include <QIcon>
 
 #include <TelepathyQt/ClientRegistrar>
 #include <TelepathyQt/FileTransferChannel>
 
+#include <time.h>
+#include <unistd.h>
+
+// Milliseconds since the process was executed, including the time spent by
+// the dynamic linker before main(), or -1
+static qint64 msecsSinceExec()
+{
+    QFile stat(QLatin1String("/proc/self/stat"));
+    if (!stat.open(QIODevice::ReadOnly)) {
+        return -1;
+    }
+    // The start time is the 22nd field, the 2nd one can contain spaces
+    const QByteArray line = stat.readAll();
+    const QList<QByteArray> fields = line.mid(line.lastIndexOf(')') + 2).split(' ');
+    if (fields.size() < 20) {
+        return -1;
+    }
+    const qint64 startTicks = fields.at(19).toLongLong();
+
+    struct timespec now;
+    if (clock_gettime(CLOCK_BOOTTIME, &now) < 0) {
+        return -1;
+    }
+    return qint64(now.tv_sec) * 1000 + now.tv_nsec / 1000000 - startTicks * 1000 / sysconf(_SC_CLK_TCK);
+}
+
 
 int main(int argc, char* argv[])
 {
+    QElapsedTimer startupTimer;
+    startupTimer.start();
+
     KAboutData aboutData("ktp-filetransfer-handler",
                          i18n("Telepathy File Transfer Handler"),
                          KTP_FILETRANSFER_HANDLER_VERSION,
@@ -73,7 +108,18 @@ int main(int argc, char* argv[])
     // not anywhere else. This is probably the best that we can do.
     setenv("KDE_FULL_SESSION", "true", 0);
     setenv("KDE_SESSION_VERSION", "5", 0);
-    KTp::TelepathyHandlerApplication app(argc, argv);
+    // Headless hosts usually have no display to connect to. The configuration
+    // can only be read once the application exists, so only the environment
+    // variable is honoured here.
+    const QByteArray headless = qgetenv("KTP_FTH_HEADLESS");
+    if (!headless.isEmpty() && headless != "0") {
+        setenv("QT_QPA_PLATFORM", "offscreen", 0);
+    }
+    // Stay around for a while after the last transfer, files often come in
+    // bursts and the next channel would have to wait for a cold start. An
+    // activation that never gets a channel still exits after the default
+    // initial timeout.
+    KTp::TelepathyHandlerApplication app(argc, argv, 15000, FileTransferConfig::standbyTimeout());
     app.setWindowIcon(QIcon::fromTheme(QStringLiteral("telepathy-kde")));
 
     Tp::AccountFactoryPtr accountFactory = Tp::AccountFactory::create(QDBusConnection::sessionBus());
@@ -87,6 +133,8 @@ int main(int argc, char* argv[])
 
     Tp::ContactFactoryPtr contactFactory = Tp::ContactFactory::create();
     contactFactory->addFeature(Tp::Contact::FeatureAlias);
+    // Compressed files are only sent to contacts advertising support
+    contactFactory->addFeature(Tp::Contact::FeatureCapabilities);
 
     Tp::ClientRegistrarPtr registrar = Tp::ClientRegistrar::create(accountFactory,
                                                                    connectionFactory,
@@ -98,6 +146,10 @@ int main(int argc, char* argv[])
         qWarning() << "File Transfer Handler already running. Exiting";
         return 1;
     }
+    TransferMetrics::instance()->recordStartup(msecsSinceExec(), startupTimer.elapsed());
+    qCDebug(KTP_FTH_MODULE) << "Registered" << startupTimer.elapsed() << "ms after main()";
+    TransferMetrics::instance()->registerObject();
+    ContentHashCache::instance()->registerObject();
 
     return app.exec();
 }
@@ -0,0 +1,395 @@
+/*
+* Copyright (C) 2026 The KDE Telepathy Team
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this library; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "native-file-transfer.h"
+#include "transfer-thread-pool.h"
+#include "ktp-fth-debug.h"
+
+#include <QDBusArgument>
+#include <QDBusPendingCallWatcher>
+#include <QDBusPendingReply>
+#include <QDBusVariant>
+#include <QSocketNotifier>
+#include <QThread>
+#include <QTimer>
+
+#include <TelepathyQt/Contact>
+#include <TelepathyQt/FileTransferChannel>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+static const uint InvalidAddressType = Tp::NUM_SOCKET_ADDRESS_TYPES;
+
+// Minimum interval between two progress updates sent by a pump to the main
+// thread, in milliseconds
+static const int ProgressReportInterval = 100;
+
+static uint nativeAddressType(const Tp::FileTransferChannelPtr &channel)
+{
+    const Tp::SupportedSocketMap sockets = channel->availableSocketTypes();
+
+    if (sockets.value(Tp::SocketAddressTypeUnix).contains(Tp::SocketAccessControlLocalhost)) {
+        return Tp::SocketAddressTypeUnix;
+    }
+    if (sockets.value(Tp::SocketAddressTypeAbstractUnix).contains(Tp::SocketAccessControlLocalhost)) {
+        return Tp::SocketAddressTypeAbstractUnix;
+    }
+    return InvalidAddressType;
+}
+
+NativeFileTransfer::NativeFileTransfer(const Tp::FileTransferChannelPtr &channel, int fd,
+                                       BandwidthLimiter::Direction direction, QObject *parent)
+    : QObject(parent),
+      m_channel(channel),
+      m_addressType(nativeAddressType(channel)),
+      m_file(fd),
+      m_metricsId(-1),
+      m_limiterId(BandwidthLimiter::instance()->addTransfer(direction,
+                                                            channel->targetContact() ? channel->targetContact()->id() : QString())),
+      m_pump(0),
+      m_thread(0),
+      m_position(0),
+      m_finished(false)
+{
+    connect(channel.data(),
+            SIGNAL(stateChanged(Tp::FileTransferState,Tp::FileTransferStateChangeReason)),
+            SLOT(onFileTransferChannelStateChanged(Tp::FileTransferState,Tp::FileTransferStateChangeReason)));
+}
+
+NativeFileTransfer::~NativeFileTransfer()
+{
+    stopPump();
+    BandwidthLimiter::instance()->removeTransfer(m_limiterId);
+}
+
+bool NativeFileTransfer::isSupported(const Tp::FileTransferChannelPtr &channel)
+{
+    return nativeAddressType(channel) != InvalidAddressType;
+}
+
+int NativeFileTransfer::connectUnixSocket(const QByteArray &address, uint addressType, QString *errorMessage)
+{
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+
+    // Abstract addresses include the leading NUL byte, but be tolerant with
+    // connection managers that omit it.
+    QByteArray path = address;
+    if (addressType == Tp::SocketAddressTypeAbstractUnix && !path.startsWith('\0')) {
+        path.prepend('\0');
+    }
+    if (path.size() >= (int) sizeof(addr.sun_path)) {
+        *errorMessage = QLatin1String("Socket address is too long");
+        return -1;
+    }
+    memcpy(addr.sun_path, path.constData(), path.size());
+    const socklen_t length = offsetof(struct sockaddr_un, sun_path) + path.size()
+                           + (addressType == Tp::SocketAddressTypeUnix ? 1 : 0);
+
+    const int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        *errorMessage = QString::fromLocal8Bit(strerror(errno));
+        return -1;
+    }
+    if (::connect(fd, reinterpret_cast<struct sockaddr*>(&addr), length) < 0) {
+        *errorMessage = QString::fromLocal8Bit(strerror(errno));
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+void NativeFileTransfer::setInitialOffset(qulonglong offset)
+{
+    m_position = offset;
+}
+
+void NativeFileTransfer::setMetricsId(int id)
+{
+    m_metricsId = id;
+}
+
+qulonglong NativeFileTransfer::position() const
+{
+    return m_position;
+}
+
+bool NativeFileTransfer::isFinished() const
+{
+    return m_finished;
+}
+
+void NativeFileTransfer::watchSocketRequest(const QDBusPendingCall &call)
+{
+    QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(call, this);
+    connect(watcher,
+            SIGNAL(finished(QDBusPendingCallWatcher*)),
+            SLOT(onSocketRequestFinished(QDBusPendingCallWatcher*)));
+}
+
+void NativeFileTransfer::setFailed(const QString &errorMessage)
+{
+    qCWarning(KTP_FTH_MODULE) << "Native transfer failed at" << m_position << "-" << errorMessage;
+    stopPump();
+    Q_EMIT failed(QLatin1String("org.freedesktop.Telepathy.KTp.FileTransferHandler.IOError"), errorMessage);
+}
+
+void NativeFileTransfer::onSocketRequestFinished(QDBusPendingCallWatcher *watcher)
+{
+    QDBusPendingReply<QDBusVariant> reply = *watcher;
+    watcher->deleteLater();
+
+    if (reply.isError()) {
+        qCWarning(KTP_FTH_MODULE) << "Unable to get the transfer socket -" << reply.error().name() << ":" << reply.error().message();
+        Q_EMIT failed(reply.error().name(), reply.error().message());
+        return;
+    }
+
+    m_address = qdbus_cast<QByteArray>(reply.value().variant());
+    qCDebug(KTP_FTH_MODULE) << "Transfer socket address" << m_address;
+    Q_EMIT socketReady();
+
+    if (m_channel->state() == Tp::FileTransferStateOpen) {
+        startPump();
+    }
+}
+
+void NativeFileTransfer::onFileTransferChannelStateChanged(Tp::FileTransferState state,
+                                                           Tp::FileTransferStateChangeReason reason)
+{
+    Q_UNUSED(reason);
+
+    switch (state) {
+    case Tp::FileTransferStateOpen:
+        if (!m_address.isEmpty()) {
+            startPump();
+        }
+        break;
+    case Tp::FileTransferStateCancelled:
+        stopPump();
+        break;
+    default:
+        break;
+    }
+}
+
+void NativeFileTransfer::onPumpTransferredBytesChanged(qulonglong position)
+{
+    m_position = position;
+    Q_EMIT transferredBytesChanged(m_position);
+}
+
+void NativeFileTransfer::onPumpFinished(qulonglong position)
+{
+    qCDebug(KTP_FTH_MODULE) << "Native transfer finished at" << position;
+
+    m_position = position;
+    Q_EMIT transferredBytesChanged(m_position);
+
+    stopPump();
+    m_finished = true;
+    Q_EMIT finished();
+}
+
+void NativeFileTransfer::onPumpFailed(const QString &errorMessage)
+{
+    setFailed(errorMessage);
+}
+
+void NativeFileTransfer::startPump()
+{
+    if (m_pump || m_finished) {
+        return;
+    }
+
+    m_pump = createPump();
+    m_pump->setMetricsId(m_metricsId);
+    m_pump->setLimiterId(m_limiterId);
+    m_thread = TransferThreadPool::instance()->acquireThread();
+    m_pump->moveToThread(m_thread);
+
+    connect(m_pump,
+            SIGNAL(transferredBytesChanged(qulonglong)),
+            SLOT(onPumpTransferredBytesChanged(qulonglong)));
+    connect(m_pump,
+            SIGNAL(finished(qulonglong)),
+            SLOT(onPumpFinished(qulonglong)));
+    connect(m_pump,
+            SIGNAL(failed(QString)),
+            SLOT(onPumpFailed(QString)));
+
+    QMetaObject::invokeMethod(m_pump, "start", Qt::QueuedConnection,
+                              Q_ARG(QByteArray, m_address),
+                              Q_ARG(uint, m_addressType),
+                              Q_ARG(qulonglong, m_position));
+}
+
+void NativeFileTransfer::stopPump()
+{
+    if (!m_pump) {
+        return;
+    }
+
+    disconnect(m_pump, 0, this, 0);
+    m_pump->deleteLater();
+    m_pump = 0;
+
+    TransferThreadPool::instance()->releaseThread(m_thread);
+    m_thread = 0;
+}
+
+
+NativeTransferPump::NativeTransferPump(int fd, qulonglong end, bool readFromSocket)
+    : QObject(0),
+      m_socket(-1),
+      m_file(::dup(fd)),
+      m_end(end),
+      m_position(0),
+      m_metricsId(-1),
+      m_readFromSocket(readFromSocket),
+      m_limiterId(-1),
+      m_notifier(0)
+{
+}
+
+NativeTransferPump::~NativeTransferPump()
+{
+    closeSocket();
+    if (m_file >= 0) {
+        ::close(m_file);
+    }
+}
+
+void NativeTransferPump::setMetricsId(int id)
+{
+    m_metricsId = id;
+}
+
+void NativeTransferPump::setLimiterId(int id)
+{
+    m_limiterId = id;
+}
+
+void NativeTransferPump::start(const QByteArray &address, uint addressType, qulonglong position)
+{
+    m_position = position;
+
+    QString errorMessage;
+    m_socket = NativeFileTransfer::connectUnixSocket(address, addressType, &errorMessage);
+    if (m_socket < 0) {
+        setFailed(errorMessage);
+        return;
+    }
+
+    // Connecting to a local socket does not block for any meaningful time,
+    // switch to non blocking mode only for the transfer itself.
+    if (::fcntl(m_socket, F_SETFL, ::fcntl(m_socket, F_GETFL) | O_NONBLOCK) < 0) {
+        setFailed(QString::fromLocal8Bit(strerror(errno)));
+        return;
+    }
+
+    qCDebug(KTP_FTH_MODULE) << "Connected to transfer socket in" << QThread::currentThread()->objectName()
+                            << "starting at" << m_position;
+
+    m_lastReport.start();
+    m_notifier = new QSocketNotifier(m_socket,
+                                     m_readFromSocket ? QSocketNotifier::Read : QSocketNotifier::Write,
+                                     this);
+    connect(m_notifier, SIGNAL(activated(int)), SLOT(onSocketActivated()));
+}
+
+bool NativeTransferPump::isSizeKnown() const
+{
+    return m_end != Q_UINT64_C(0xFFFFFFFFFFFFFFFF);
+}
+
+void NativeTransferPump::setPosition(qulonglong position)
+{
+    m_position = position;
+
+    // Progress is batched here, so that the main thread is not woken up for
+    // every chunk.
+    if (m_lastReport.elapsed() >= ProgressReportInterval) {
+        m_lastReport.restart();
+        Q_EMIT transferredBytesChanged(m_position);
+    }
+}
+
+qulonglong NativeTransferPump::allowance(qulonglong wanted)
+{
+    int delay = 0;
+    const qulonglong allowed = BandwidthLimiter::instance()->allowance(m_limiterId, wanted, &delay);
+    if (allowed == 0 && m_notifier) {
+        // Stop reading or writing, the connection manager will see the socket
+        // buffer filling up or emptying and slow down.
+        m_notifier->setEnabled(false);
+        QTimer::singleShot(delay, this, SLOT(onResume()));
+    }
+    return allowed;
+}
+
+void NativeTransferPump::consume(qulonglong bytes)
+{
+    BandwidthLimiter::instance()->consume(m_limiterId, bytes);
+}
+
+void NativeTransferPump::setFinished()
+{
+    closeSocket();
+    Q_EMIT finished(m_position);
+}
+
+void NativeTransferPump::setFailed(const QString &errorMessage)
+{
+    closeSocket();
+    Q_EMIT failed(errorMessage);
+}
+
+void NativeTransferPump::onSocketActivated()
+{
+    transfer();
+}
+
+void NativeTransferPump::onResume()
+{
+    if (m_notifier) {
+        m_notifier->setEnabled(true);
+    }
+}
+
+void NativeTransferPump::closeSocket()
+{
+    if (m_notifier) {
+        m_notifier->setEnabled(false);
+        m_notifier->deleteLater();
+        m_notifier = 0;
+    }
+    if (m_socket >= 0) {
+        ::close(m_socket);
+        m_socket = -1;
+    }
+}
+
+#include "moc_native-file-transfer.cpp"
@@ -0,0 +1,196 @@
+/*
+* Copyright (C) 2026 The KDE Telepathy Team
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this library; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef NATIVE_FILE_TRANSFER_H
+#define NATIVE_FILE_TRANSFER_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QElapsedTimer>
+
+#include "bandwidth-limiter.h"
+
+#include <TelepathyQt/Constants>
+#include <TelepathyQt/Types>
+
+class QDBusPendingCall;
+class QDBusPendingCallWatcher;
+class QSocketNotifier;
+class QThread;
+
+class NativeTransferPump;
+
+/**
+ * Base class for the transfer engines that move data between the connection
+ * manager socket and a local file descriptor without going through a
+ * QIODevice.
+ *
+ * The engine asks the connection manager for a Unix socket (AcceptFile or
+ * ProvideFile, depending on the direction) and, when the channel becomes
+ * Open, hands the socket address to a NativeTransferPump running in one of
+ * the threads of the TransferThreadPool. The engine itself lives in the
+ * main thread with the channel and the job.
+ *
+ * The file descriptor is not owned by the engine.
+ */
+class NativeFileTransfer : public QObject
+{
+    Q_OBJECT
+    Q_DISABLE_COPY(NativeFileTransfer)
+
+public:
+    virtual ~NativeFileTransfer();
+
+    /**
+     * Returns true if the connection manager offers a Unix socket with
+     * localhost access control for this channel.
+     */
+    static bool isSupported(const Tp::FileTransferChannelPtr &channel);
+
+    /**
+     * Connects a new blocking socket to \p address, a Unix socket of type
+     * \p addressType returned by AcceptFile or ProvideFile. Returns the
+     * socket, or -1 with \p errorMessage set.
+     */
+    static int connectUnixSocket(const QByteArray &address, uint addressType, QString *errorMessage);
+
+    void setInitialOffset(qulonglong offset);
+    /** Id of the transfer in TransferMetrics */
+    void setMetricsId(int id);
+
+    /** Absolute position in the file reached so far */
+    qulonglong position() const;
+    bool isFinished() const;
+
+Q_SIGNALS:
+    /** The connection manager returned the socket address */
+    void socketReady();
+    void transferredBytesChanged(qulonglong position);
+    void finished();
+    void failed(const QString &errorName, const QString &errorMessage);
+
+protected:
+    NativeFileTransfer(const Tp::FileTransferChannelPtr &channel, int fd,
+                       BandwidthLimiter::Direction direction, QObject *parent = 0);
+
+    /**
+     * Subclasses call this with the pending AcceptFile/ProvideFile call.
+     */
+    void watchSocketRequest(const QDBusPendingCall &call);
+    void setFailed(const QString &errorMessage);
+
+    /** Creates the pump moving the data, it will be moved to a worker thread */
+    virtual NativeTransferPump *createPump() = 0;
+
+    Tp::FileTransferChannelPtr m_channel;
+    uint m_addressType;
+    int m_file;
+
+private Q_SLOTS:
+    void onSocketRequestFinished(QDBusPendingCallWatcher *watcher);
+    void onFileTransferChannelStateChanged(Tp::FileTransferState state, Tp::FileTransferStateChangeReason reason);
+    void onPumpTransferredBytesChanged(qulonglong position);
+    void onPumpFinished(qulonglong position);
+    void onPumpFailed(const QString &errorMessage);
+
+private:
+    void startPump();
+    void stopPump();
+
+    QByteArray m_address;
+    int m_metricsId;
+    int m_limiterId;
+    NativeTransferPump *m_pump;
+    QThread *m_thread;
+    qulonglong m_position;
+    bool m_finished;
+};
+
+
+/**
+ * Moves the data between the socket and the file. Lives in a thread of the
+ * TransferThreadPool and communicates with its NativeFileTransfer only
+ * through queued signals and slots.
+ *
+ * The pump works on its own duplicate of the file descriptor.
+ */
+class NativeTransferPump : public QObject
+{
+    Q_OBJECT
+    Q_DISABLE_COPY(NativeTransferPump)
+
+public:
+    virtual ~NativeTransferPump();
+
+    void setMetricsId(int id);
+    /** Id of the transfer in the BandwidthLimiter */
+    void setLimiterId(int id);
+
+public Q_SLOTS:
+    void start(const QByteArray &address, uint addressType, qulonglong position);
+
+Q_SIGNALS:
+    void transferredBytesChanged(qulonglong position);
+    void finished(qulonglong position);
+    void failed(const QString &errorMessage);
+
+protected:
+    NativeTransferPump(int fd, qulonglong end, bool readFromSocket);
+
+    /**
+     * Called every time the socket is ready for reading (incoming) or for
+     * writing (outgoing). Must not block.
+     */
+    virtual void transfer() = 0;
+
+    /** False if the connection manager does not know the size of the file */
+    bool isSizeKnown() const;
+    void setPosition(qulonglong position);
+    void setFinished();
+    void setFailed(const QString &errorMessage);
+
+    /**
+     * Returns how many bytes may be moved now according to the
+     * BandwidthLimiter, at most \p wanted. If it returns 0 the socket is not
+     * watched anymore until the limiter allows moving data again, and
+     * transfer() must return.
+     */
+    qulonglong allowance(qulonglong wanted);
+    /** Reports \p bytes moved to the BandwidthLimiter */
+    void consume(qulonglong bytes);
+
+    int m_socket;
+    int m_file;
+    qulonglong m_end;
+    qulonglong m_position;
+    int m_metricsId;
+
+private Q_SLOTS:
+    void onSocketActivated();
+    void onResume();
+
+private:
+    void closeSocket();
+
+    bool m_readFromSocket;
+    int m_limiterId;
+    QSocketNotifier *m_notifier;
+    QElapsedTimer m_lastReport;
+};
+
+#endif // NATIVE_FILE_TRANSFER_H
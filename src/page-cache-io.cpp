@@ -0,0 +1,291 @@
+/*
+* Copyright (C) 2026 The KDE Telepathy Team
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this library; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "page-cache-io.h"
+#include "buffer-pool.h"
+#include "file-transfer-config.h"
+#include "ktp-fth-debug.h"
+
+#include <QCoreApplication>
+#include <QThreadPool>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+// Data requested ahead of the reader
+static const qint64 ReadAheadSize = 16 * 1024 * 1024;
+
+// Pages behind the reader are dropped in steps of this size
+static const qint64 ReadDropStep = 4 * 1024 * 1024;
+
+// Written data is flushed and dropped in windows of this size
+static const qint64 WriteBackWindow = 8 * 1024 * 1024;
+
+// Size of the O_DIRECT staging buffer, a page aligned buffer of the pool.
+// The chunks of the ChunkManifest are a multiple of it, so a completed chunk
+// is always on disk and never only in the buffer.
+static const qint64 DirectBufferSize = BufferPool::BufferSize;
+
+static int pwriteAll(int fd, const char *data, qint64 size, qint64 position)
+{
+    while (size > 0) {
+        const ssize_t written = ::pwrite(fd, data, size, position);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno;
+        }
+        data += written;
+        size -= written;
+        position += written;
+    }
+    return 0;
+}
+
+PageCacheIo::Mode PageCacheIo::modeFor(qulonglong size)
+{
+    FileTransferConfig *config = FileTransferConfig::instance();
+    if (config->largeFileThreshold() == 0 || size < config->largeFileThreshold()
+            || size == Q_UINT64_C(0xFFFFFFFFFFFFFFFF)) {
+        return Buffered;
+    }
+
+    const QString mode = config->largeFileIoMode();
+    if (mode == QLatin1String("direct")) {
+        return Direct;
+    }
+    if (mode == QLatin1String("dropBehind")) {
+        return DropBehind;
+    }
+    return Buffered;
+}
+
+QThreadPool *PageCacheIo::diskWriterPool()
+{
+    static QThreadPool *pool = 0;
+    if (!pool) {
+        pool = new QThreadPool(qApp);
+        pool->setMaxThreadCount(FileTransferConfig::instance()->diskWriterThreads());
+        qCDebug(KTP_FTH_MODULE) << "Using" << pool->maxThreadCount() << "disk writer threads";
+    }
+    return pool;
+}
+
+QString PageCacheIo::modeName(Mode mode)
+{
+    switch (mode) {
+    case DropBehind:
+        return QLatin1String("dropBehind");
+    case Direct:
+        return QLatin1String("direct");
+    case Buffered:
+    default:
+        return QLatin1String("buffered");
+    }
+}
+
+bool PageCacheIo::writeFully(int fd, const char *data, qint64 size, qint64 position, QString *error)
+{
+    const int result = pwriteAll(fd, data, size, position);
+    if (result != 0) {
+        *error = QString::fromLocal8Bit(strerror(result));
+        return false;
+    }
+    return true;
+}
+
+
+ReadAheadWindow::ReadAheadWindow(int fd, qint64 position)
+    : m_fd(fd),
+      m_advisedUpTo(position),
+      m_droppedUpTo(position)
+{
+    ::posix_fadvise(m_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    advance(position);
+}
+
+void ReadAheadWindow::advance(qint64 position)
+{
+    if (position + ReadAheadSize / 2 > m_advisedUpTo) {
+        const qint64 start = qMax(position, m_advisedUpTo);
+        ::posix_fadvise(m_fd, start, position + ReadAheadSize - start, POSIX_FADV_WILLNEED);
+        m_advisedUpTo = position + ReadAheadSize;
+    }
+
+    if (position - m_droppedUpTo >= ReadDropStep) {
+        ::posix_fadvise(m_fd, m_droppedUpTo, position - m_droppedUpTo, POSIX_FADV_DONTNEED);
+        m_droppedUpTo = position;
+    }
+}
+
+
+WriteBackDropper::WriteBackDropper(int fd)
+    : m_fd(fd),
+      m_previousStart(-1),
+      m_windowStart(-1),
+      m_end(-1)
+{
+}
+
+void WriteBackDropper::restart(qint64 position)
+{
+    // Whatever is left of the old windows stays in the cache
+    m_previousStart = position;
+    m_windowStart = position;
+    m_end = position;
+}
+
+void WriteBackDropper::dataWritten(qint64 position, qint64 size)
+{
+    if (position != m_end) {
+        restart(position);
+    }
+    m_end = position + size;
+    if (m_end - m_windowStart < WriteBackWindow) {
+        return;
+    }
+
+    // Start the writeback of the new window, and wait for the previous one,
+    // which had the time of a whole window to reach the disk
+    ::sync_file_range(m_fd, m_windowStart, m_end - m_windowStart, SYNC_FILE_RANGE_WRITE);
+    if (m_previousStart < m_windowStart) {
+        ::sync_file_range(m_fd, m_previousStart, m_windowStart - m_previousStart,
+                          SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+        ::posix_fadvise(m_fd, m_previousStart, m_windowStart - m_previousStart, POSIX_FADV_DONTNEED);
+    }
+    m_previousStart = m_windowStart;
+    m_windowStart = m_end;
+}
+
+
+DirectWriter::DirectWriter(int fd)
+    : m_fd(fd),
+      m_directFd(-1),
+      m_buffer(BufferPool::instance()->acquire()),
+      m_start(0),
+      m_fill(0),
+      m_flushed(0)
+{
+    // Same file, new open file description
+    char path[32];
+    snprintf(path, sizeof(path), "/proc/self/fd/%d", fd);
+    m_directFd = ::open(path, O_WRONLY | O_DIRECT | O_CLOEXEC);
+    if (m_directFd < 0) {
+        qCWarning(KTP_FTH_MODULE) << "Unable to open the file with O_DIRECT -" << strerror(errno);
+    }
+}
+
+DirectWriter::~DirectWriter()
+{
+    if (m_directFd >= 0) {
+        ::close(m_directFd);
+    }
+    BufferPool::instance()->release(m_buffer);
+}
+
+bool DirectWriter::isValid() const
+{
+    return m_directFd >= 0;
+}
+
+bool DirectWriter::write(const char *data, qint64 size, qint64 position, QString *error)
+{
+    if (position != m_start + m_fill && !restart(position, error)) {
+        return false;
+    }
+
+    while (size > 0) {
+        const qint64 count = qMin(size, DirectBufferSize - m_fill);
+        memcpy(m_buffer + m_fill, data, count);
+        m_fill += count;
+        data += count;
+        size -= count;
+        if (m_fill == DirectBufferSize && !writeBuffer(error)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool DirectWriter::flushTail(QString *error)
+{
+    if (m_fill == m_flushed) {
+        return true;
+    }
+    if (!PageCacheIo::writeFully(m_fd, m_buffer + m_flushed, m_fill - m_flushed, m_start + m_flushed, error)) {
+        return false;
+    }
+    m_flushed = m_fill;
+    return true;
+}
+
+// Starts a new buffer at the aligned position before position, with the
+// data already in the file before position
+bool DirectWriter::restart(qint64 position, QString *error)
+{
+    if (!flushTail(error)) {
+        return false;
+    }
+
+    m_start = position - position % DirectBufferSize;
+    m_fill = 0;
+    while (m_fill < position - m_start) {
+        const ssize_t count = ::pread(m_fd, m_buffer + m_fill, position - m_start - m_fill, m_start + m_fill);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            // Hole or end of the file
+            memset(m_buffer + m_fill, 0, position - m_start - m_fill);
+            break;
+        }
+        m_fill += count;
+    }
+    m_fill = position - m_start;
+    m_flushed = m_fill;
+    return true;
+}
+
+bool DirectWriter::writeBuffer(QString *error)
+{
+    int result = EINVAL;
+    if (m_directFd >= 0) {
+        result = pwriteAll(m_directFd, m_buffer, DirectBufferSize, m_start);
+        if (result == EINVAL) {
+            qCWarning(KTP_FTH_MODULE) << "O_DIRECT writes not supported, using the page cache";
+            ::close(m_directFd);
+            m_directFd = -1;
+        }
+    }
+    if (m_directFd < 0) {
+        result = pwriteAll(m_fd, m_buffer + m_flushed, DirectBufferSize - m_flushed, m_start + m_flushed);
+    }
+    if (result != 0) {
+        *error = QString::fromLocal8Bit(strerror(result));
+        return false;
+    }
+
+    m_start += DirectBufferSize;
+    m_fill = 0;
+    m_flushed = 0;
+    return true;
+}
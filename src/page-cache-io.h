@@ -0,0 +1,143 @@
+/*
+* Copyright (C) 2026 The KDE Telepathy Team
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this library; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef PAGE_CACHE_IO_H
+#define PAGE_CACHE_IO_H
+
+#include <QString>
+
+class QThreadPool;
+
+/**
+ * Keeps huge transfers from flushing the page cache.
+ *
+ * Files of at least FileTransferConfig::largeFileThreshold() bytes are read
+ * with a sequential readahead window, and the pages already sent are
+ * dropped. Received data is either written back and dropped behind the
+ * writer (DropBehind) or written with O_DIRECT from an aligned buffer
+ * (Direct). Smaller files use the page cache normally.
+ */
+namespace PageCacheIo
+{
+    enum Mode {
+        Buffered,
+        DropBehind,
+        Direct
+    };
+
+    /** Mode for a file of \p size bytes, Buffered if unknown. Main thread only */
+    Mode modeFor(qulonglong size);
+    QString modeName(Mode mode);
+
+    /** pwrite() of the whole buffer, retried on short writes and EINTR */
+    bool writeFully(int fd, const char *data, qint64 size, qint64 position, QString *error);
+
+    /**
+     * Threads doing the blocking disk writes and syncs, so that they never
+     * happen in the main thread. Created by the first call, which must be
+     * from the main thread.
+     */
+    QThreadPool *diskWriterPool();
+}
+
+/**
+ * Readahead of a file read sequentially, e.g. by sendfile(). advance() is
+ * called with the position reached by the reader: the next window is
+ * requested with WILLNEED and the pages before the position are dropped.
+ */
+class ReadAheadWindow
+{
+public:
+    /** Marks \p fd as sequential, \p fd is not owned */
+    ReadAheadWindow(int fd, qint64 position);
+
+    void advance(qint64 position);
+
+private:
+    int m_fd;
+    qint64 m_advisedUpTo;
+    qint64 m_droppedUpTo;
+};
+
+/**
+ * Drops the pages of a file written sequentially once they are on disk.
+ *
+ * Writeback of every window is started as soon as it is complete, and the
+ * window before it is waited for and dropped, so that the writer rarely
+ * blocks on the disk. To be used from the writing thread only.
+ */
+class WriteBackDropper
+{
+public:
+    /** \p fd is not owned */
+    explicit WriteBackDropper(int fd);
+
+    /** \p size bytes were written at \p position */
+    void dataWritten(qint64 position, qint64 size);
+
+private:
+    void restart(qint64 position);
+
+    int m_fd;
+    qint64 m_previousStart;
+    qint64 m_windowStart;
+    qint64 m_end;
+};
+
+/**
+ * Writes a file with O_DIRECT through an aligned staging buffer, one buffer
+ * of the BufferPool (BufferPool::BufferSize, 256 KiB).
+ *
+ * Data must mostly be written sequentially. Only full buffers go to the
+ * direct descriptor; the partially filled buffer is written through the
+ * normal descriptor by flushTail(), and written again with O_DIRECT once it
+ * is full. If the file system refuses O_DIRECT the writer falls back to the
+ * normal descriptor. To be used from one thread at a time.
+ */
+class DirectWriter
+{
+public:
+    /**
+     * Opens a second, direct, descriptor on the file of \p fd. \p fd is not
+     * owned, it is used for the unaligned parts.
+     */
+    explicit DirectWriter(int fd);
+    ~DirectWriter();
+
+    bool isValid() const;
+
+    bool write(const char *data, qint64 size, qint64 position, QString *error);
+    /** Makes the data still in the staging buffer visible in the file */
+    bool flushTail(QString *error);
+
+private:
+    Q_DISABLE_COPY(DirectWriter)
+
+    bool restart(qint64 position, QString *error);
+    bool writeBuffer(QString *error);
+
+    int m_fd;
+    int m_directFd;
+    char *m_buffer;
+    qint64 m_start;
+    qint64 m_fill;
+    // Part of the buffer already written through m_fd
+    qint64 m_flushed;
+};
+
+#endif // PAGE_CACHE_IO_H
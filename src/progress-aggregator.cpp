@@ -0,0 +1,87 @@
+/*
+* Copyright (C) 2026 The KDE Telepathy Team
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this library; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "progress-aggregator.h"
+
+ProgressAggregator::ProgressAggregator(QObject *parent)
+    : QObject(parent),
+      m_updatesPerSecond(0),
+      m_amount(0),
+      m_pending(false)
+{
+    connect(&m_timer, SIGNAL(timeout()), SLOT(onTimeout()));
+}
+
+ProgressAggregator::~ProgressAggregator()
+{
+}
+
+int ProgressAggregator::updatesPerSecond() const
+{
+    return m_updatesPerSecond;
+}
+
+void ProgressAggregator::setUpdatesPerSecond(int updates)
+{
+    m_updatesPerSecond = updates;
+    if (m_updatesPerSecond > 0) {
+        m_timer.setInterval(1000 / qMin(m_updatesPerSecond, 1000));
+    } else {
+        m_timer.stop();
+        flush();
+    }
+}
+
+void ProgressAggregator::update(qulonglong amount)
+{
+    m_amount = amount;
+
+    if (m_updatesPerSecond <= 0 || !m_timer.isActive()) {
+        // Nothing delivered recently, deliver now and start collecting
+        m_pending = false;
+        Q_EMIT processedAmountChanged(m_amount);
+        if (m_updatesPerSecond > 0) {
+            m_timer.start();
+        }
+        return;
+    }
+
+    m_pending = true;
+}
+
+void ProgressAggregator::flush()
+{
+    if (m_pending) {
+        m_pending = false;
+        Q_EMIT processedAmountChanged(m_amount);
+    }
+}
+
+void ProgressAggregator::onTimeout()
+{
+    if (!m_pending) {
+        // No updates during the last tick, go idle
+        m_timer.stop();
+        return;
+    }
+
+    m_pending = false;
+    Q_EMIT processedAmountChanged(m_amount);
+}
+
+#include "moc_progress-aggregator.cpp"
@@ -0,0 +1,63 @@
+/*
+* Copyright (C) 2026 The KDE Telepathy Team
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this library; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef PROGRESS_AGGREGATOR_H
+#define PROGRESS_AGGREGATOR_H
+
+#include <QObject>
+#include <QTimer>
+
+/**
+ * Coalesces the processed amount updates of a job.
+ *
+ * The first update is delivered immediately, the following ones are
+ * collected and at most the latest one is delivered every tick, so that
+ * processedAmountChanged() is emitted at most updatesPerSecond() times per
+ * second, however fast the updates come.
+ */
+class ProgressAggregator : public QObject
+{
+    Q_OBJECT
+    Q_DISABLE_COPY(ProgressAggregator)
+
+public:
+    explicit ProgressAggregator(QObject *parent = 0);
+    virtual ~ProgressAggregator();
+
+    int updatesPerSecond() const;
+    /** A value less or equal to 0 disables the coalescing */
+    void setUpdatesPerSecond(int updates);
+
+    void update(qulonglong amount);
+    /** Delivers the pending update, if any, immediately */
+    void flush();
+
+Q_SIGNALS:
+    void processedAmountChanged(qulonglong amount);
+
+private Q_SLOTS:
+    void onTimeout();
+
+private:
+    QTimer m_timer;
+    int m_updatesPerSecond;
+    qulonglong m_amount;
+    bool m_pending;
+};
+
+#endif // PROGRESS_AGGREGATOR_H
@@ -0,0 +1,110 @@
+/*
+* Copyright (C) 2026 The KDE Telepathy Team
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this library; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "sendfile-sender.h"
+#include "ktp-fth-debug.h"
+
+#include <QDBusVariant>
+
+#include <TelepathyQt/OutgoingFileTransferChannel>
+
+#include <errno.h>
+#include <string.h>
+#include <sys/sendfile.h>
+
+// Maximum amount of data handed to the kernel with a single sendfile() call
+static const size_t SendfileChunkSize = 1024 * 1024;
+
+// Maximum number of chunks sent every time the socket is writable, so that a
+// fast receiver does not starve the other transfers of the thread.
+static const int MaxChunksPerActivation = 16;
+
+SendfilePump::SendfilePump(int fd, qulonglong end)
+    : NativeTransferPump(fd, end, false)
+{
+}
+
+void SendfilePump::transfer()
+{
+    for (int i = 0; i < MaxChunksPerActivation; ++i) {
+        size_t chunk = SendfileChunkSize;
+        if (isSizeKnown()) {
+            if (m_position >= m_end) {
+                setFinished();
+                return;
+            }
+            chunk = qMin<qulonglong>(chunk, m_end - m_position);
+        }
+        chunk = allowance(chunk);
+        if (chunk == 0) {
+            return;
+        }
+
+        off_t offset = m_position;
+        const ssize_t sent = ::sendfile(m_socket, m_file, &offset, chunk);
+        if (sent == 0) {
+            // End of file
+            if (isSizeKnown()) {
+                setFailed(QLatin1String("File is shorter than expected"));
+            } else {
+                setFinished();
+            }
+            return;
+        }
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN) {
+                return;
+            }
+            setFailed(QString::fromLocal8Bit(strerror(errno)));
+            return;
+        }
+        consume(sent);
+        setPosition(offset);
+    }
+}
+
+
+SendfileSender::SendfileSender(const Tp::OutgoingFileTransferChannelPtr &channel, int fd, QObject *parent)
+    : NativeFileTransfer(channel, fd, BandwidthLimiter::Upload, parent)
+{
+}
+
+SendfileSender::~SendfileSender()
+{
+}
+
+void SendfileSender::provide()
+{
+    qCDebug(KTP_FTH_MODULE) << "Providing file with sendfile()";
+
+    Tp::Client::ChannelTypeFileTransferInterface *fileTransferInterface =
+        m_channel->interface<Tp::Client::ChannelTypeFileTransferInterface>();
+    watchSocketRequest(fileTransferInterface->ProvideFile(m_addressType,
+                                                          Tp::SocketAccessControlLocalhost,
+                                                          QDBusVariant(QVariant(QString()))));
+}
+
+NativeTransferPump *SendfileSender::createPump()
+{
+    return new SendfilePump(m_file, m_channel->size());
+}
+
+#include "moc_sendfile-sender.cpp"
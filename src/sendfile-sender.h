@@ -0,0 +1,64 @@
+/*
+* Copyright (C) 2026 The KDE Telepathy Team
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this library; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef SENDFILE_SENDER_H
+#define SENDFILE_SENDER_H
+
+#include "native-file-transfer.h"
+
+/**
+ * Sends an outgoing file transfer writing the file into the connection
+ * manager socket with sendfile(), so that the data is never copied to user
+ * space. The data is sent from a thread of the TransferThreadPool.
+ */
+class SendfileSender : public NativeFileTransfer
+{
+    Q_OBJECT
+    Q_DISABLE_COPY(SendfileSender)
+
+public:
+    SendfileSender(const Tp::OutgoingFileTransferChannelPtr &channel, int fd, QObject *parent = 0);
+    virtual ~SendfileSender();
+
+    /**
+     * Calls ProvideFile on the channel. The file is sent starting from the
+     * initial offset defined by the connection manager.
+     */
+    void provide();
+
+protected:
+    virtual NativeTransferPump *createPump();
+};
+
+
+/**
+ * Sends the file to the socket with sendfile(). \p end is the size of the
+ * file, if it is unknown the pump stops at the end of the file.
+ */
+class SendfilePump : public NativeTransferPump
+{
+    Q_DISABLE_COPY(SendfilePump)
+
+public:
+    SendfilePump(int fd, qulonglong end);
+
+protected:
+    virtual void transfer();
+};
+
+#endif // SENDFILE_SENDER_H
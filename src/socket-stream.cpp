@@ -0,0 +1,278 @@
+/*
+* Copyright (C) 2026 The KDE Telepathy Team
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this library; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "socket-stream.h"
+#include "buffer-pool.h"
+#include "native-file-transfer.h"
+#include "ktp-fth-debug.h"
+
+#include <QDBusArgument>
+#include <QDBusPendingCallWatcher>
+#include <QDBusPendingReply>
+#include <QDBusVariant>
+#include <QHostAddress>
+#include <QLocalSocket>
+#include <QTcpSocket>
+#include <QTimer>
+
+#include <TelepathyQt/Contact>
+#include <TelepathyQt/FileTransferChannel>
+
+static const uint InvalidAddressType = Tp::NUM_SOCKET_ADDRESS_TYPES;
+
+// Data the socket reads ahead of the transfer; once it is full the socket
+// stops reading and the kernel buffer fills up
+static const qint64 SocketBufferSize = BufferPool::BufferSize;
+
+static uint streamAddressType(const Tp::FileTransferChannelPtr &channel)
+{
+    const Tp::SupportedSocketMap sockets = channel->availableSocketTypes();
+    const uint addressTypes[] = {
+        Tp::SocketAddressTypeUnix,
+        Tp::SocketAddressTypeAbstractUnix,
+        Tp::SocketAddressTypeIPv4,
+        Tp::SocketAddressTypeIPv6
+    };
+
+    for (uint i = 0; i < sizeof(addressTypes) / sizeof(addressTypes[0]); ++i) {
+        if (sockets.value(addressTypes[i]).contains(Tp::SocketAccessControlLocalhost)) {
+            return addressTypes[i];
+        }
+    }
+    return InvalidAddressType;
+}
+
+SocketStream::SocketStream(const Tp::FileTransferChannelPtr &channel, BandwidthLimiter::Direction direction,
+                           QObject *parent)
+    : QObject(parent),
+      m_channel(channel),
+      m_addressType(streamAddressType(channel)),
+      m_socket(0),
+      m_position(0),
+      m_socketClosed(false),
+      m_limiterId(BandwidthLimiter::instance()->addTransfer(direction,
+                                                            channel->targetContact() ? channel->targetContact()->id() : QString())),
+      m_limiterTimer(new QTimer(this)),
+      m_finished(false)
+{
+    m_limiterTimer->setSingleShot(true);
+    connect(m_limiterTimer, SIGNAL(timeout()), SLOT(onTransfer()));
+    connect(channel.data(),
+            SIGNAL(stateChanged(Tp::FileTransferState,Tp::FileTransferStateChangeReason)),
+            SLOT(onFileTransferChannelStateChanged(Tp::FileTransferState,Tp::FileTransferStateChangeReason)));
+}
+
+SocketStream::~SocketStream()
+{
+    closeSocket();
+    BandwidthLimiter::instance()->removeTransfer(m_limiterId);
+}
+
+bool SocketStream::isSupported(const Tp::FileTransferChannelPtr &channel)
+{
+    return streamAddressType(channel) != InvalidAddressType;
+}
+
+void SocketStream::setInitialOffset(qulonglong offset)
+{
+    m_position = offset;
+}
+
+qulonglong SocketStream::position() const
+{
+    return m_position;
+}
+
+bool SocketStream::isFinished() const
+{
+    return m_finished;
+}
+
+void SocketStream::watchSocketRequest(const QDBusPendingCall &call)
+{
+    QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(call, this);
+    connect(watcher,
+            SIGNAL(finished(QDBusPendingCallWatcher*)),
+            SLOT(onSocketRequestFinished(QDBusPendingCallWatcher*)));
+}
+
+qint64 SocketStream::allowance(qint64 wanted)
+{
+    int delay = 0;
+    const qint64 allowed = BandwidthLimiter::instance()->allowance(m_limiterId, wanted, &delay);
+    if (allowed == 0 && !m_limiterTimer->isActive()) {
+        m_limiterTimer->start(delay);
+    }
+    return allowed;
+}
+
+void SocketStream::consume(qint64 bytes)
+{
+    BandwidthLimiter::instance()->consume(m_limiterId, bytes);
+}
+
+void SocketStream::setFinished()
+{
+    qCDebug(KTP_FTH_MODULE) << "Socket stream finished at" << m_position;
+
+    closeSocket();
+    m_finished = true;
+    Q_EMIT finished();
+}
+
+void SocketStream::setFailed(const QString &errorMessage)
+{
+    qCWarning(KTP_FTH_MODULE) << "Socket stream failed at" << m_position << "-" << errorMessage;
+
+    closeSocket();
+    Q_EMIT failed(QLatin1String("org.freedesktop.Telepathy.KTp.FileTransferHandler.IOError"), errorMessage);
+}
+
+void SocketStream::closeSocket()
+{
+    if (!m_socket) {
+        return;
+    }
+
+    m_limiterTimer->stop();
+    m_socket->disconnect(this);
+    m_socket->close();
+    m_socket->deleteLater();
+    m_socket = 0;
+}
+
+void SocketStream::onTransfer()
+{
+    if (m_socket && !m_finished) {
+        transfer();
+    }
+}
+
+void SocketStream::onSocketRequestFinished(QDBusPendingCallWatcher *watcher)
+{
+    QDBusPendingReply<QDBusVariant> reply = *watcher;
+    watcher->deleteLater();
+
+    if (reply.isError()) {
+        qCWarning(KTP_FTH_MODULE) << "Unable to get the transfer socket -" << reply.error().name() << ":" << reply.error().message();
+        Q_EMIT failed(reply.error().name(), reply.error().message());
+        return;
+    }
+
+    m_address = reply.value().variant();
+    if (m_channel->state() == Tp::FileTransferStateOpen) {
+        connectSocket();
+    }
+}
+
+void SocketStream::onFileTransferChannelStateChanged(Tp::FileTransferState state,
+                                                     Tp::FileTransferStateChangeReason reason)
+{
+    Q_UNUSED(reason);
+
+    switch (state) {
+    case Tp::FileTransferStateOpen:
+        if (m_address.isValid()) {
+            connectSocket();
+        }
+        break;
+    case Tp::FileTransferStateCancelled:
+        closeSocket();
+        break;
+    default:
+        break;
+    }
+}
+
+void SocketStream::connectSocket()
+{
+    if (m_socket || m_finished) {
+        return;
+    }
+
+    if (m_addressType == Tp::SocketAddressTypeIPv4 || m_addressType == Tp::SocketAddressTypeIPv6) {
+        QString address;
+        quint16 port;
+        if (m_addressType == Tp::SocketAddressTypeIPv4) {
+            const Tp::SocketAddressIPv4 ipv4 = qdbus_cast<Tp::SocketAddressIPv4>(m_address);
+            address = ipv4.address;
+            port = ipv4.port;
+        } else {
+            const Tp::SocketAddressIPv6 ipv6 = qdbus_cast<Tp::SocketAddressIPv6>(m_address);
+            address = ipv6.address;
+            port = ipv6.port;
+        }
+        qCDebug(KTP_FTH_MODULE) << "Transfer socket address" << address << port;
+
+        QTcpSocket *socket = new QTcpSocket(this);
+        socket->setReadBufferSize(SocketBufferSize);
+        connect(socket, SIGNAL(connected()), SLOT(onTransfer()));
+        connect(socket, SIGNAL(disconnected()), SLOT(onSocketDisconnected()));
+        connect(socket, SIGNAL(error(QAbstractSocket::SocketError)), SLOT(onSocketError()));
+        m_socket = socket;
+        socket->connectToHost(QHostAddress(address), port);
+    } else {
+        const QByteArray address = qdbus_cast<QByteArray>(m_address);
+        qCDebug(KTP_FTH_MODULE) << "Transfer socket address" << address;
+
+        // QLocalSocket cannot connect to abstract addresses
+        QString errorMessage;
+        const int fd = NativeFileTransfer::connectUnixSocket(address, m_addressType, &errorMessage);
+        if (fd < 0) {
+            setFailed(errorMessage);
+            return;
+        }
+
+        QLocalSocket *socket = new QLocalSocket(this);
+        socket->setReadBufferSize(SocketBufferSize);
+        connect(socket, SIGNAL(disconnected()), SLOT(onSocketDisconnected()));
+        connect(socket, SIGNAL(error(QLocalSocket::LocalSocketError)), SLOT(onSocketError()));
+        m_socket = socket;
+        socket->setSocketDescriptor(fd);
+        // Already connected
+        QMetaObject::invokeMethod(this, "onTransfer", Qt::QueuedConnection);
+    }
+
+    connect(m_socket, SIGNAL(readyRead()), SLOT(onTransfer()));
+    connect(m_socket, SIGNAL(bytesWritten(qint64)), SLOT(onTransfer()));
+}
+
+void SocketStream::onSocketDisconnected()
+{
+    // The data still buffered by the socket can be read
+    m_socketClosed = true;
+    onTransfer();
+}
+
+void SocketStream::onSocketError()
+{
+    // The connection manager closing the socket is the normal end of the data
+    QLocalSocket *localSocket = qobject_cast<QLocalSocket*>(m_socket);
+    QAbstractSocket *tcpSocket = qobject_cast<QAbstractSocket*>(m_socket);
+    if ((localSocket && localSocket->error() == QLocalSocket::PeerClosedError)
+            || (tcpSocket && tcpSocket->error() == QAbstractSocket::RemoteHostClosedError)) {
+        onSocketDisconnected();
+        return;
+    }
+
+    if (m_socket) {
+        setFailed(m_socket->errorString());
+    }
+}
+
+#include "moc_socket-stream.cpp"
@@ -0,0 +1,125 @@
+/*
+* Copyright (C) 2026 The KDE Telepathy Team
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this library; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef SOCKET_STREAM_H
+#define SOCKET_STREAM_H
+
+#include "bandwidth-limiter.h"
+
+#include <QObject>
+#include <QVariant>
+
+#include <TelepathyQt/Constants>
+#include <TelepathyQt/Types>
+
+class QDBusPendingCall;
+class QDBusPendingCallWatcher;
+class QIODevice;
+class QTimer;
+
+/**
+ * Base class for the transfer engines that move data between the connection
+ * manager socket and a QIODevice, e.g. when it is compressed or hashed on
+ * the way, on a socket opened by the handler instead of TelepathyQt.
+ *
+ * Owning the socket lets the engine stop reading or writing while the other
+ * side of the data cannot keep up, or while the BandwidthLimiter has no
+ * tokens left: the socket buffer and then the kernel buffer fill up or
+ * empty, and the connection manager slows down.
+ *
+ * Unix sockets are preferred, IPv4 and IPv6 sockets are used otherwise, all
+ * with localhost access control. Unlike NativeFileTransfer everything runs
+ * in the main thread, where the devices live.
+ */
+class SocketStream : public QObject
+{
+    Q_OBJECT
+    Q_DISABLE_COPY(SocketStream)
+
+public:
+    virtual ~SocketStream();
+
+    /**
+     * Returns true if the connection manager offers a socket with localhost
+     * access control the handler can open for this channel.
+     */
+    static bool isSupported(const Tp::FileTransferChannelPtr &channel);
+
+    void setInitialOffset(qulonglong offset);
+
+    /** Absolute position in the data on the socket reached so far */
+    qulonglong position() const;
+    bool isFinished() const;
+
+Q_SIGNALS:
+    void finished();
+    void failed(const QString &errorName, const QString &errorMessage);
+
+protected:
+    SocketStream(const Tp::FileTransferChannelPtr &channel, BandwidthLimiter::Direction direction,
+                 QObject *parent = 0);
+
+    /**
+     * Subclasses call this with the pending AcceptFile/ProvideFile call.
+     */
+    void watchSocketRequest(const QDBusPendingCall &call);
+
+    /**
+     * Moves data, called every time the socket or the device on the other
+     * side is ready again. Must not block.
+     */
+    virtual void transfer() = 0;
+
+    /**
+     * Returns how many bytes may be moved now, at most \p wanted. If it
+     * returns 0, transfer() is called again when the limiter has tokens.
+     */
+    qint64 allowance(qint64 wanted);
+    void consume(qint64 bytes);
+
+    void setFinished();
+    void setFailed(const QString &errorMessage);
+    void closeSocket();
+
+    Tp::FileTransferChannelPtr m_channel;
+    uint m_addressType;
+    // Connected socket, 0 before and after the transfer
+    QIODevice *m_socket;
+    qulonglong m_position;
+    // The connection manager closed its end of the socket
+    bool m_socketClosed;
+
+protected Q_SLOTS:
+    void onTransfer();
+
+private Q_SLOTS:
+    void onSocketRequestFinished(QDBusPendingCallWatcher *watcher);
+    void onFileTransferChannelStateChanged(Tp::FileTransferState state, Tp::FileTransferStateChangeReason reason);
+    void onSocketDisconnected();
+    void onSocketError();
+
+private:
+    void connectSocket();
+
+    QVariant m_address;
+    int m_limiterId;
+    QTimer *m_limiterTimer;
+    bool m_finished;
+};
+
+#endif // SOCKET_STREAM_H
@@ -0,0 +1,108 @@
+/*
+* Copyright (C) 2026 The KDE Telepathy Team
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this library; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "speed-estimator.h"
+
+#include <cmath>
+
+const qint64 SpeedEstimator::SampleInterval;
+const qint64 SpeedEstimator::TimeConstant;
+
+SpeedEstimator::SpeedEstimator()
+    : m_mode(Instantaneous),
+      m_lastTime(0),
+      m_startAmount(0),
+      m_lastAmount(0),
+      m_rate(0),
+      m_hasRate(false)
+{
+}
+
+SpeedEstimator::Mode SpeedEstimator::mode() const
+{
+    return m_mode;
+}
+
+void SpeedEstimator::setMode(Mode mode)
+{
+    m_mode = mode;
+}
+
+bool SpeedEstimator::isStarted() const
+{
+    return m_timer.isValid();
+}
+
+void SpeedEstimator::start(qulonglong amount)
+{
+    m_timer.start();
+    m_lastTime = 0;
+    m_startAmount = amount;
+    m_lastAmount = amount;
+    m_rate = 0;
+    m_hasRate = false;
+}
+
+bool SpeedEstimator::addSample(qulonglong amount)
+{
+    if (!m_timer.isValid() || amount < m_lastAmount) {
+        start(amount);
+        return false;
+    }
+
+    const qint64 now = m_timer.elapsed();
+    const qint64 interval = now - m_lastTime;
+    if (interval < SampleInterval) {
+        return false;
+    }
+
+    if (m_mode == Average) {
+        m_rate = (amount - m_startAmount) * 1000.0 / now;
+    } else {
+        const double sample = (amount - m_lastAmount) * 1000.0 / interval;
+        if (!m_hasRate) {
+            m_rate = sample;
+        } else {
+            const double alpha = 1.0 - std::exp(-double(interval) / TimeConstant);
+            m_rate += alpha * (sample - m_rate);
+        }
+    }
+
+    m_hasRate = true;
+    m_lastTime = now;
+    m_lastAmount = amount;
+    return true;
+}
+
+qulonglong SpeedEstimator::speed() const
+{
+    return m_hasRate ? qulonglong(m_rate + 0.5) : 0;
+}
+
+qint64 SpeedEstimator::eta(qulonglong total) const
+{
+    if (speed() == 0 || total == Q_UINT64_C(0xFFFFFFFFFFFFFFFF) || total < m_lastAmount) {
+        return -1;
+    }
+    return qint64((total - m_lastAmount) * 1000.0 / m_rate);
+}
+
+qint64 SpeedEstimator::elapsed() const
+{
+    return m_timer.isValid() ? m_timer.elapsed() : 0;
+}
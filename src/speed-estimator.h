@@ -0,0 +1,88 @@
+/*
+* Copyright (C) 2026 The KDE Telepathy Team
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this library; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef SPEED_ESTIMATOR_H
+#define SPEED_ESTIMATOR_H
+
+#include <QElapsedTimer>
+
+/**
+ * Estimates the speed of a transfer from the amount of data processed.
+ *
+ * Time is measured with a monotonic clock and samples are taken at most
+ * every SampleInterval milliseconds. In Instantaneous mode the speed is an
+ * exponentially weighted moving average of the speed measured on every
+ * sample; the weight of a sample depends on its duration, so that irregular
+ * sampling does not bias the result. In Average mode the speed is the
+ * average since start().
+ */
+class SpeedEstimator
+{
+public:
+    enum Mode {
+        Instantaneous,
+        Average
+    };
+
+    /** Minimum time between two samples, in milliseconds */
+    static const qint64 SampleInterval = 250;
+
+    /**
+     * Time constant of the moving average, in milliseconds. About 63% of the
+     * weight is given to the samples taken in the last TimeConstant ms.
+     */
+    static const qint64 TimeConstant = 3000;
+
+    SpeedEstimator();
+
+    Mode mode() const;
+    void setMode(Mode mode);
+
+    bool isStarted() const;
+    /** Restarts the estimate, \p amount is the amount already processed */
+    void start(qulonglong amount);
+
+    /**
+     * Adds a sample. Returns true if the estimate was updated, false if the
+     * sample came too early and was not used.
+     */
+    bool addSample(qulonglong amount);
+
+    /** Bytes per second */
+    qulonglong speed() const;
+
+    /**
+     * Estimated time to reach \p total at the current speed, in
+     * milliseconds, or -1 if unknown (no speed or unknown total)
+     */
+    qint64 eta(qulonglong total) const;
+
+    /** Time since start(), in milliseconds */
+    qint64 elapsed() const;
+
+private:
+    Mode m_mode;
+    QElapsedTimer m_timer;
+    qint64 m_lastTime;
+    qulonglong m_startAmount;
+    qulonglong m_lastAmount;
+    double m_rate;
+    bool m_hasRate;
+};
+
+#endif // SPEED_ESTIMATOR_H
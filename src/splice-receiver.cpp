@@ -0,0 +1,179 @@
+/*
+* Copyright (C) 2026 The KDE Telepathy Team
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this library; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "splice-receiver.h"
+#include "chunk-manifest.h"
+#include "page-cache-io.h"
+#include "transfer-metrics.h"
+#include "ktp-fth-debug.h"
+
+#include <QDBusVariant>
+#include <QElapsedTimer>
+
+#include <TelepathyQt/IncomingFileTransferChannel>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+// Size requested for the pipe between the socket and the file. Unprivileged
+// processes are allowed up to /proc/sys/fs/pipe-max-size (1 MiB by default).
+static const int RequestedPipeSize = 1024 * 1024;
+
+// Maximum number of pipe loads moved every time the socket is readable, so
+// that a fast sender does not starve the other transfers of the thread.
+static const int MaxSplicesPerActivation = 16;
+
+SplicePump::SplicePump(int fd, qulonglong end, const QSharedPointer<ChunkManifest> &manifest, bool dropBehind)
+    : NativeTransferPump(fd, end, true),
+      m_pipeSize(0),
+      m_manifest(manifest),
+      m_dropper(dropBehind ? new WriteBackDropper(m_file) : 0)
+{
+    if (::pipe2(m_pipe, O_CLOEXEC) < 0) {
+        qCWarning(KTP_FTH_MODULE) << "Unable to create pipe -" << strerror(errno);
+        m_pipe[0] = m_pipe[1] = -1;
+        return;
+    }
+    ::fcntl(m_pipe[1], F_SETPIPE_SZ, RequestedPipeSize);
+    m_pipeSize = ::fcntl(m_pipe[1], F_GETPIPE_SZ);
+    if (m_pipeSize <= 0) {
+        m_pipeSize = 64 * 1024;
+    }
+}
+
+SplicePump::~SplicePump()
+{
+    delete m_dropper;
+    if (m_pipe[0] >= 0) {
+        ::close(m_pipe[0]);
+        ::close(m_pipe[1]);
+    }
+}
+
+void SplicePump::transfer()
+{
+    if (m_pipe[0] < 0) {
+        setFailed(QLatin1String("Unable to create pipe"));
+        return;
+    }
+
+    for (int i = 0; i < MaxSplicesPerActivation; ++i) {
+        size_t chunk = m_pipeSize;
+        if (isSizeKnown()) {
+            if (m_position >= m_end) {
+                setFinished();
+                return;
+            }
+            chunk = qMin<qulonglong>(chunk, m_end - m_position);
+        }
+        chunk = allowance(chunk);
+        if (chunk == 0) {
+            return;
+        }
+
+        const ssize_t in = ::splice(m_socket, NULL, m_pipe[1], NULL, chunk,
+                                    SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (in == 0) {
+            // The connection manager closed the socket
+            setFinished();
+            return;
+        }
+        if (in < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN) {
+                return;
+            }
+            setFailed(QString::fromLocal8Bit(strerror(errno)));
+            return;
+        }
+        consume(in);
+
+        // The pipe is always drained completely, so that the next splice
+        // from the socket never blocks.
+        QElapsedTimer writeTimer;
+        writeTimer.start();
+        loff_t offset = m_position;
+        ssize_t left = in;
+        while (left > 0) {
+            const ssize_t out = ::splice(m_pipe[0], NULL, m_file, &offset, left, SPLICE_F_MOVE);
+            if (out < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                setFailed(QString::fromLocal8Bit(strerror(errno)));
+                return;
+            }
+            left -= out;
+        }
+        TransferMetrics::instance()->recordDiskWrite(m_metricsId, writeTimer.nsecsElapsed());
+        if (m_manifest) {
+            m_manifest->dataWritten(offset);
+        }
+        if (m_dropper) {
+            // After the manifest, which reads the data back
+            m_dropper->dataWritten(m_position, offset - m_position);
+        }
+        setPosition(offset);
+    }
+}
+
+
+SpliceReceiver::SpliceReceiver(const Tp::IncomingFileTransferChannelPtr &channel, int fd, QObject *parent)
+    : NativeFileTransfer(channel, fd, BandwidthLimiter::Download, parent),
+      m_dropBehind(false)
+{
+}
+
+SpliceReceiver::~SpliceReceiver()
+{
+}
+
+void SpliceReceiver::accept(qulonglong offset)
+{
+    qCDebug(KTP_FTH_MODULE) << "Accepting file with splice() at offset" << offset;
+
+    setInitialOffset(offset);
+
+    Tp::Client::ChannelTypeFileTransferInterface *fileTransferInterface =
+        m_channel->interface<Tp::Client::ChannelTypeFileTransferInterface>();
+    watchSocketRequest(fileTransferInterface->AcceptFile(m_addressType,
+                                                         Tp::SocketAccessControlLocalhost,
+                                                         QDBusVariant(QVariant(QString())),
+                                                         offset));
+}
+
+void SpliceReceiver::setChunkManifest(const QSharedPointer<ChunkManifest> &manifest)
+{
+    m_manifest = manifest;
+}
+
+void SpliceReceiver::setDropBehind(bool dropBehind)
+{
+    m_dropBehind = dropBehind;
+}
+
+NativeTransferPump *SpliceReceiver::createPump()
+{
+    return new SplicePump(m_file, m_channel->size(), m_manifest, m_dropBehind);
+}
+
+#include "moc_splice-receiver.cpp"
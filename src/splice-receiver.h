@@ -0,0 +1,94 @@
+/*
+* Copyright (C) 2026 The KDE Telepathy Team
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this library; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef SPLICE_RECEIVER_H
+#define SPLICE_RECEIVER_H
+
+#include "native-file-transfer.h"
+
+#include <QSharedPointer>
+
+class ChunkManifest;
+class WriteBackDropper;
+
+/**
+ * Receives an incoming file transfer moving the data from the connection
+ * manager socket to the file with splice(), through a pipe, so that the
+ * received data is never copied to user space. The splicing happens in a
+ * thread of the TransferThreadPool.
+ */
+class SpliceReceiver : public NativeFileTransfer
+{
+    Q_OBJECT
+    Q_DISABLE_COPY(SpliceReceiver)
+
+public:
+    SpliceReceiver(const Tp::IncomingFileTransferChannelPtr &channel, int fd, QObject *parent = 0);
+    virtual ~SpliceReceiver();
+
+    /**
+     * Calls AcceptFile on the channel. The data will be written to the file
+     * starting from the initial offset defined by the connection manager.
+     */
+    void accept(qulonglong offset);
+
+    /**
+     * Records the chunks written in \p manifest. The data is read back from
+     * the file, since it never goes through user space.
+     */
+    void setChunkManifest(const QSharedPointer<ChunkManifest> &manifest);
+
+    /**
+     * Drops the pages of the file once they are on disk, see
+     * WriteBackDropper. Must be called before accept().
+     */
+    void setDropBehind(bool dropBehind);
+
+protected:
+    virtual NativeTransferPump *createPump();
+
+private:
+    QSharedPointer<ChunkManifest> m_manifest;
+    bool m_dropBehind;
+};
+
+
+/**
+ * Moves the data from the socket to the file through a pipe with splice(),
+ * without copying it to user space. \p end is the size of the file, the
+ * pump stops there or when the socket is closed.
+ */
+class SplicePump : public NativeTransferPump
+{
+    Q_DISABLE_COPY(SplicePump)
+
+public:
+    SplicePump(int fd, qulonglong end, const QSharedPointer<ChunkManifest> &manifest, bool dropBehind);
+    virtual ~SplicePump();
+
+protected:
+    virtual void transfer();
+
+private:
+    int m_pipe[2];
+    int m_pipeSize;
+    QSharedPointer<ChunkManifest> m_manifest;
+    WriteBackDropper *m_dropper;
+};
+
+#endif // SPLICE_RECEIVER_H
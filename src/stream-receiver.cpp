@@ -0,0 +1,104 @@
+/*
+* Copyright (C) 2026 The KDE Telepathy Team
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this library; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "stream-receiver.h"
+#include "buffer-pool.h"
+#include "write-behind-file.h"
+#include "ktp-fth-debug.h"
+
+#include <QDBusVariant>
+
+#include <TelepathyQt/IncomingFileTransferChannel>
+
+StreamReceiver::StreamReceiver(const Tp::IncomingFileTransferChannelPtr &channel, QObject *parent)
+    : SocketStream(channel, BandwidthLimiter::Download, parent),
+      m_buffer(0)
+{
+}
+
+StreamReceiver::~StreamReceiver()
+{
+    BufferPool::instance()->release(m_buffer);
+}
+
+void StreamReceiver::setWriteQueue(WriteBehindFile *writeQueue)
+{
+    m_writeQueue = writeQueue;
+    if (writeQueue) {
+        connect(writeQueue, SIGNAL(spaceAvailable()), SLOT(onTransfer()));
+    }
+}
+
+void StreamReceiver::accept(qulonglong offset, QIODevice *output)
+{
+    qCDebug(KTP_FTH_MODULE) << "Accepting file on a handler socket at offset" << offset;
+
+    setInitialOffset(offset);
+    m_output = output;
+
+    Tp::Client::ChannelTypeFileTransferInterface *fileTransferInterface =
+        m_channel->interface<Tp::Client::ChannelTypeFileTransferInterface>();
+    watchSocketRequest(fileTransferInterface->AcceptFile(m_addressType,
+                                                         Tp::SocketAccessControlLocalhost,
+                                                         QDBusVariant(QVariant(QString())),
+                                                         offset));
+}
+
+void StreamReceiver::transfer()
+{
+    if (!m_output) {
+        closeSocket();
+        return;
+    }
+    if (!m_buffer) {
+        m_buffer = BufferPool::instance()->acquire();
+    }
+
+    while (m_socket->bytesAvailable() > 0) {
+        if (m_writeQueue && m_writeQueue->isFull()) {
+            // Continued by spaceAvailable(). Meanwhile the socket buffer and
+            // then the kernel one fill up, and the sender slows down.
+            return;
+        }
+
+        // Continued by the limiter
+        const qint64 allowed = allowance(BufferPool::BufferSize);
+        if (allowed == 0) {
+            return;
+        }
+
+        const qint64 count = m_socket->read(m_buffer, allowed);
+        if (count <= 0) {
+            break;
+        }
+        consume(count);
+        m_position += count;
+        if (m_output->write(m_buffer, count) != count) {
+            // The output reports its errors itself
+            closeSocket();
+            return;
+        }
+    }
+
+    const qulonglong size = m_channel->size();
+    if (m_socketClosed || (size != Q_UINT64_C(0xFFFFFFFFFFFFFFFF) && m_position >= size)) {
+        setFinished();
+    }
+}
+
+#include "moc_stream-receiver.cpp"
@@ -0,0 +1,66 @@
+/*
+* Copyright (C) 2026 The KDE Telepathy Team
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this library; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef STREAM_RECEIVER_H
+#define STREAM_RECEIVER_H
+
+#include "socket-stream.h"
+
+#include <QPointer>
+
+class WriteBehindFile;
+
+/**
+ * Receives an incoming file transfer into a QIODevice, e.g. a
+ * WriteBehindFile or an InflateWriter in front of it. The socket is only
+ * read while the write queue of the WriteBehindFile has room, so a disk
+ * slower than the network slows the sender down instead of filling the
+ * memory.
+ */
+class StreamReceiver : public SocketStream
+{
+    Q_OBJECT
+    Q_DISABLE_COPY(StreamReceiver)
+
+public:
+    explicit StreamReceiver(const Tp::IncomingFileTransferChannelPtr &channel, QObject *parent = 0);
+    virtual ~StreamReceiver();
+
+    /**
+     * Stops reading while \p writeQueue is full, see WriteBehindFile::isFull().
+     * The data does not have to be written to it directly.
+     */
+    void setWriteQueue(WriteBehindFile *writeQueue);
+
+    /**
+     * Calls AcceptFile on the channel. The data received is written to
+     * \p output, which must be open and is not owned.
+     */
+    void accept(qulonglong offset, QIODevice *output);
+
+protected:
+    virtual void transfer();
+
+private:
+    QPointer<QIODevice> m_output;
+    QPointer<WriteBehindFile> m_writeQueue;
+    // From the BufferPool, while the transfer is in progress
+    char *m_buffer;
+};
+
+#endif // STREAM_RECEIVER_H
@@ -0,0 +1,166 @@
+/*
+* Copyright (C) 2026 The KDE Telepathy Team
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this library; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "stream-sender.h"
+#include "buffer-pool.h"
+#include "ktp-fth-debug.h"
+
+#include <QDBusVariant>
+
+#include <TelepathyQt/OutgoingFileTransferChannel>
+
+// Data written to the socket and not sent yet, above which the source is not
+// read
+static const qint64 MaxBytesToWrite = BufferPool::BufferSize;
+
+StreamSender::StreamSender(const Tp::OutgoingFileTransferChannelPtr &channel, QObject *parent)
+    : SocketStream(channel, BandwidthLimiter::Upload, parent),
+      m_buffer(0),
+      m_bufferStart(0),
+      m_bufferEnd(0),
+      m_sourceAtPosition(false),
+      m_sourceAtEnd(false)
+{
+}
+
+StreamSender::~StreamSender()
+{
+    BufferPool::instance()->release(m_buffer);
+}
+
+void StreamSender::provide(QIODevice *source)
+{
+    qCDebug(KTP_FTH_MODULE) << "Providing file on a handler socket";
+
+    m_source = source;
+
+    Tp::Client::ChannelTypeFileTransferInterface *fileTransferInterface =
+        m_channel->interface<Tp::Client::ChannelTypeFileTransferInterface>();
+    watchSocketRequest(fileTransferInterface->ProvideFile(m_addressType,
+                                                          Tp::SocketAccessControlLocalhost,
+                                                          QDBusVariant(QVariant(QString()))));
+}
+
+void StreamSender::transfer()
+{
+    if (!m_source) {
+        closeSocket();
+        return;
+    }
+    if (!m_buffer) {
+        m_buffer = BufferPool::instance()->acquire();
+    }
+    if (!m_sourceAtPosition && !skipToPosition()) {
+        return;
+    }
+
+    const qulonglong size = m_channel->size();
+    const bool sizeKnown = size != Q_UINT64_C(0xFFFFFFFFFFFFFFFF);
+
+    while (m_socket->bytesToWrite() < MaxBytesToWrite) {
+        if (m_bufferStart == m_bufferEnd) {
+            if (m_sourceAtEnd || (sizeKnown && m_position >= size)) {
+                break;
+            }
+
+            qint64 wanted = BufferPool::BufferSize;
+            if (sizeKnown) {
+                wanted = qMin<qulonglong>(wanted, size - m_position);
+            }
+            // Sequential sources may return -1 at their end
+            const qint64 count = m_source->read(m_buffer, wanted);
+            if (count < 0 && !m_source->atEnd()) {
+                setFailed(m_source->errorString());
+                return;
+            }
+            if (count <= 0) {
+                m_sourceAtEnd = true;
+                break;
+            }
+            m_bufferStart = 0;
+            m_bufferEnd = count;
+        }
+
+        // Continued by the limiter
+        const qint64 allowed = allowance(m_bufferEnd - m_bufferStart);
+        if (allowed == 0) {
+            return;
+        }
+
+        const qint64 written = m_socket->write(m_buffer + m_bufferStart, allowed);
+        if (written < 0) {
+            setFailed(m_socket->errorString());
+            return;
+        }
+        consume(written);
+        m_bufferStart += written;
+        m_position += written;
+    }
+
+    if (m_bufferStart < m_bufferEnd || m_socket->bytesToWrite() > 0) {
+        // Continued by bytesWritten()
+        return;
+    }
+    if (sizeKnown && m_position < size) {
+        if (m_sourceAtEnd) {
+            setFailed(QLatin1String("File is shorter than expected"));
+        }
+        return;
+    }
+    if (sizeKnown && !m_sourceAtEnd) {
+        // Compressors may only notice their end when asked for more. Data
+        // left means the receiver would get a truncated file or stream.
+        char extra;
+        if (m_source->read(&extra, 1) > 0) {
+            setFailed(QLatin1String("File is longer than expected"));
+            return;
+        }
+        m_sourceAtEnd = true;
+    }
+    if (sizeKnown || m_sourceAtEnd) {
+        // Closing the socket ends the data for the connection manager
+        setFinished();
+    }
+}
+
+bool StreamSender::skipToPosition()
+{
+    if (!m_source->isSequential()) {
+        if (!m_source->seek(m_position)) {
+            setFailed(m_source->errorString());
+            return false;
+        }
+        m_sourceAtPosition = true;
+        return true;
+    }
+
+    // Sequential sources are read up to the offset, as TelepathyQt does
+    qulonglong skipped = 0;
+    while (skipped < m_position) {
+        const qint64 count = m_source->read(m_buffer, qMin<qulonglong>(BufferPool::BufferSize, m_position - skipped));
+        if (count <= 0) {
+            setFailed(QLatin1String("File is shorter than the initial offset"));
+            return false;
+        }
+        skipped += count;
+    }
+    m_sourceAtPosition = true;
+    return true;
+}
+
+#include "moc_stream-sender.cpp"
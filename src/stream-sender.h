@@ -0,0 +1,65 @@
+/*
+* Copyright (C) 2026 The KDE Telepathy Team
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this library; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef STREAM_SENDER_H
+#define STREAM_SENDER_H
+
+#include "socket-stream.h"
+
+#include <QPointer>
+
+/**
+ * Sends an outgoing file transfer from a QIODevice, e.g. a TarWriter or a
+ * DeflateReader producing the data while it is sent. The source is only
+ * read while the socket has room and the BandwidthLimiter allows it.
+ */
+class StreamSender : public SocketStream
+{
+    Q_OBJECT
+    Q_DISABLE_COPY(StreamSender)
+
+public:
+    explicit StreamSender(const Tp::OutgoingFileTransferChannelPtr &channel, QObject *parent = 0);
+    virtual ~StreamSender();
+
+    /**
+     * Calls ProvideFile on the channel. The data is read from \p source,
+     * which must be open and is not owned, starting from the initial offset
+     * defined by the connection manager. When the size of the channel is
+     * known exactly that much is sent, a source ending before or after it
+     * fails the transfer.
+     */
+    void provide(QIODevice *source);
+
+protected:
+    virtual void transfer();
+
+private:
+    bool skipToPosition();
+
+    QPointer<QIODevice> m_source;
+    // From the BufferPool, while the transfer is in progress
+    char *m_buffer;
+    // Data read from the source and not written to the socket yet
+    qint64 m_bufferStart;
+    qint64 m_bufferEnd;
+    bool m_sourceAtPosition;
+    bool m_sourceAtEnd;
+};
+
+#endif // STREAM_SENDER_H
@@ -0,0 +1,588 @@
+/*
+* Copyright (C) 2026 The KDE Telepathy Team
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this library; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "tar-stream.h"
+#include "ktp-fth-debug.h"
+
+#include <QDBusArgument>
+#include <QDir>
+#include <QDirIterator>
+#include <QFileInfo>
+
+#include <TelepathyQt/Constants>
+#include <TelepathyQt/FileTransferChannel>
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+
+static const int BlockSize = 512;
+
+// Offsets and sizes of the fields of a ustar header
+static const int NameOffset = 0;
+static const int NameSize = 100;
+static const int ModeOffset = 100;
+static const int UidOffset = 108;
+static const int GidOffset = 116;
+static const int IdSize = 8;
+static const int SizeOffset = 124;
+static const int SizeSize = 12;
+static const int MtimeOffset = 136;
+static const int MtimeSize = 12;
+static const int ChecksumOffset = 148;
+static const int ChecksumSize = 8;
+static const int TypeOffset = 156;
+static const int MagicOffset = 257;
+static const int PrefixOffset = 345;
+static const int PrefixSize = 155;
+
+static const char RegularType = '0';
+static const char OldRegularType = '\0';
+static const char DirectoryType = '5';
+static const char LongNameType = 'L';
+
+static qint64 paddingFor(qint64 size)
+{
+    return (BlockSize - size % BlockSize) % BlockSize;
+}
+
+static QByteArray archiveName(const QString &name, bool isDir)
+{
+    QByteArray result = QFile::encodeName(name);
+    if (isDir) {
+        result += '/';
+    }
+    return result;
+}
+
+// Bytes taken by the headers of an entry, including the GNU long name
+static qint64 headerSize(const QByteArray &name)
+{
+    if (name.size() <= NameSize) {
+        return BlockSize;
+    }
+    const qint64 longName = name.size() + 1;
+    return BlockSize + longName + paddingFor(longName) + BlockSize;
+}
+
+// Writes \p value in octal, or in base-256 (GNU extension) if it does not fit
+static void writeNumber(char *field, int size, qulonglong value)
+{
+    if (value >> (3 * (size - 1)) == 0) {
+        for (int i = size - 2; i >= 0; --i) {
+            field[i] = '0' + (value & 7);
+            value >>= 3;
+        }
+        field[size - 1] = '\0';
+        return;
+    }
+
+    for (int i = size - 1; i > 0; --i) {
+        field[i] = char(value & 0xFF);
+        value >>= 8;
+    }
+    field[0] = char(0x80);
+}
+
+static qulonglong readNumber(const char *field, int size)
+{
+    qulonglong value = 0;
+    if (field[0] & 0x80) {
+        value = field[0] & 0x7F;
+        for (int i = 1; i < size; ++i) {
+            value = (value << 8) | uchar(field[i]);
+        }
+        return value;
+    }
+
+    int i = 0;
+    while (i < size && field[i] == ' ') {
+        ++i;
+    }
+    for (; i < size && field[i] >= '0' && field[i] <= '7'; ++i) {
+        value = (value << 3) | (field[i] - '0');
+    }
+    return value;
+}
+
+static uint checksum(const char *header)
+{
+    // The checksum field itself counts as spaces
+    uint sum = 0;
+    for (int i = 0; i < BlockSize; ++i) {
+        sum += (i >= ChecksumOffset && i < ChecksumOffset + ChecksumSize) ? uint(' ') : uchar(header[i]);
+    }
+    return sum;
+}
+
+static QByteArray makeHeader(const QByteArray &name, char type, qint64 size, uint mode, qint64 mtime)
+{
+    QByteArray header(BlockSize, '\0');
+    char *h = header.data();
+
+    memcpy(h + NameOffset, name.constData(), qMin(name.size(), NameSize));
+    writeNumber(h + ModeOffset, IdSize, mode & 07777);
+    writeNumber(h + UidOffset, IdSize, 0);
+    writeNumber(h + GidOffset, IdSize, 0);
+    writeNumber(h + SizeOffset, SizeSize, size);
+    writeNumber(h + MtimeOffset, MtimeSize, mtime);
+    h[TypeOffset] = type;
+    memcpy(h + MagicOffset, "ustar\0" "00", 8);
+
+    const uint sum = checksum(h);
+    writeNumber(h + ChecksumOffset, ChecksumSize - 1, sum);
+    h[ChecksumOffset + ChecksumSize - 1] = ' ';
+    return header;
+}
+
+bool TransferArchive::isArchive(const Tp::FileTransferChannelPtr &channel)
+{
+    const QVariant value = channel->immutableProperties().value(
+        TP_QT_IFACE_CHANNEL_INTERFACE_FILE_TRANSFER_METADATA + QLatin1String(".Metadata"));
+    if (!value.isValid()) {
+        return false;
+    }
+
+    const Tp::Metadata metadata = qdbus_cast<Tp::Metadata>(value);
+    return metadata.value(QLatin1String("x-ktp-archive")).contains(QLatin1String("tar"));
+}
+
+
+TarWriter::TarWriter(const QString &directory, QObject *parent)
+    : QIODevice(parent),
+      m_directory(directory),
+      m_index(0),
+      m_pendingPosition(0),
+      m_left(0),
+      m_padding(0),
+      m_finished(false),
+      m_contentSize(0),
+      m_contentPosition(0),
+      m_archiveSize(0),
+      m_archivePosition(0)
+{
+}
+
+TarWriter::~TarWriter()
+{
+}
+
+bool TarWriter::open(OpenMode mode)
+{
+    if ((mode & ReadWrite) != ReadOnly) {
+        setErrorString(QLatin1String("TarWriter is read-only"));
+        return false;
+    }
+
+    const QDir root(m_directory);
+    QDirIterator it(m_directory, QDir::AllEntries | QDir::NoDotAndDotDot | QDir::Hidden | QDir::System,
+                    QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        const QString path = it.next();
+
+        struct stat st;
+        if (::lstat(QFile::encodeName(path).constData(), &st) < 0
+                || !(S_ISREG(st.st_mode) || S_ISDIR(st.st_mode))) {
+            qCDebug(KTP_FTH_MODULE) << "Not archiving" << path;
+            continue;
+        }
+
+        Entry entry;
+        entry.name = root.relativeFilePath(path);
+        entry.path = path;
+        entry.isDir = S_ISDIR(st.st_mode);
+        entry.size = entry.isDir ? 0 : st.st_size;
+        entry.mode = st.st_mode;
+        entry.mtime = st.st_mtime;
+        m_entries.append(entry);
+        m_contentSize += entry.size;
+        m_archiveSize += headerSize(archiveName(entry.name, entry.isDir)) + entry.size + paddingFor(entry.size);
+    }
+    // End of archive
+    m_archiveSize += 2 * BlockSize;
+    qCDebug(KTP_FTH_MODULE) << "Archiving" << m_entries.size() << "entries," << m_contentSize << "bytes,"
+                            << m_archiveSize << "bytes of archive";
+
+    return QIODevice::open(mode | Unbuffered);
+}
+
+bool TarWriter::isSequential() const
+{
+    return true;
+}
+
+bool TarWriter::atEnd() const
+{
+    return m_finished && m_pendingPosition >= m_pending.size();
+}
+
+qint64 TarWriter::bytesAvailable() const
+{
+    return atEnd() ? 0 : BlockSize;
+}
+
+int TarWriter::entryCount() const
+{
+    return m_entries.size();
+}
+
+qulonglong TarWriter::contentSize() const
+{
+    return m_contentSize;
+}
+
+int TarWriter::finishedEntryCount() const
+{
+    return (m_left > 0) ? m_index - 1 : m_index;
+}
+
+qulonglong TarWriter::contentPosition() const
+{
+    return m_contentPosition;
+}
+
+qulonglong TarWriter::archiveSize() const
+{
+    return m_archiveSize;
+}
+
+qulonglong TarWriter::archivePosition() const
+{
+    return m_archivePosition;
+}
+
+bool TarWriter::startEntry(const Entry &entry)
+{
+    const QByteArray name = archiveName(entry.name, entry.isDir);
+
+    m_pending.clear();
+    m_pendingPosition = 0;
+    if (name.size() > NameSize) {
+        const QByteArray longName = name + '\0';
+        m_pending += makeHeader("././@LongLink", LongNameType, longName.size(), 0644, 0);
+        m_pending += longName;
+        m_pending += QByteArray(paddingFor(longName.size()), '\0');
+    }
+    m_pending += makeHeader(name, entry.isDir ? DirectoryType : RegularType, entry.size, entry.mode, entry.mtime);
+
+    m_left = entry.size;
+    m_padding = paddingFor(entry.size);
+    if (m_left > 0) {
+        m_file.setFileName(entry.path);
+        if (!m_file.open(QIODevice::ReadOnly)) {
+            setErrorString(m_file.errorString());
+            return false;
+        }
+    }
+
+    Q_EMIT entryStarted(entry.name);
+    return true;
+}
+
+qint64 TarWriter::readData(char *data, qint64 maxSize)
+{
+    qint64 done = 0;
+
+    while (done < maxSize) {
+        if (m_pendingPosition < m_pending.size()) {
+            const int count = qMin<qint64>(maxSize - done, m_pending.size() - m_pendingPosition);
+            memcpy(data + done, m_pending.constData() + m_pendingPosition, count);
+            m_pendingPosition += count;
+            done += count;
+            continue;
+        }
+
+        if (m_left > 0) {
+            qint64 count = m_file.read(data + done, qMin(maxSize - done, m_left));
+            if (count < 0) {
+                setErrorString(m_file.errorString());
+                return -1;
+            }
+            if (count == 0) {
+                // The file shrank since the header was written, the size
+                // announced there must be respected anyway
+                count = qMin(maxSize - done, m_left);
+                memset(data + done, 0, count);
+            }
+            m_left -= count;
+            done += count;
+            m_contentPosition += count;
+
+            if (m_left == 0) {
+                m_file.close();
+                m_pending = QByteArray(m_padding, '\0');
+                m_pendingPosition = 0;
+            }
+            continue;
+        }
+
+        if (m_finished) {
+            break;
+        }
+
+        if (m_index < m_entries.size()) {
+            if (!startEntry(m_entries.at(m_index++))) {
+                return -1;
+            }
+        } else {
+            // End of archive
+            m_pending = QByteArray(2 * BlockSize, '\0');
+            m_pendingPosition = 0;
+            m_finished = true;
+        }
+    }
+
+    if (done == 0 && atEnd()) {
+        return -1;
+    }
+    m_archivePosition += done;
+    return done;
+}
+
+qint64 TarWriter::writeData(const char *data, qint64 maxSize)
+{
+    Q_UNUSED(data);
+    Q_UNUSED(maxSize);
+    return -1;
+}
+
+
+TarReader::TarReader(const QString &directory, QObject *parent)
+    : QIODevice(parent),
+      m_directory(directory),
+      m_state(HeaderState),
+      m_left(0),
+      m_padding(0),
+      m_mtime(0),
+      m_mode(0),
+      m_zeroBlocks(0),
+      m_entryCount(0),
+      m_contentPosition(0)
+{
+}
+
+TarReader::~TarReader()
+{
+}
+
+bool TarReader::open(OpenMode mode)
+{
+    if ((mode & ReadWrite) != WriteOnly) {
+        setErrorString(QLatin1String("TarReader is write-only"));
+        return false;
+    }
+    if (!QDir().mkpath(m_directory)) {
+        setErrorString(QLatin1String("Unable to create ") + m_directory);
+        return false;
+    }
+    return QIODevice::open(mode | Unbuffered);
+}
+
+bool TarReader::isSequential() const
+{
+    return true;
+}
+
+bool TarReader::isFinished() const
+{
+    return m_state == EndState;
+}
+
+int TarReader::entryCount() const
+{
+    return m_entryCount;
+}
+
+qulonglong TarReader::contentPosition() const
+{
+    return m_contentPosition;
+}
+
+qint64 TarReader::readData(char *data, qint64 maxSize)
+{
+    Q_UNUSED(data);
+    Q_UNUSED(maxSize);
+    return -1;
+}
+
+qint64 TarReader::writeData(const char *data, qint64 maxSize)
+{
+    const char *p = data;
+    qint64 left = maxSize;
+
+    while (left > 0) {
+        switch (m_state) {
+        case HeaderState:
+        {
+            const int count = qMin<qint64>(left, BlockSize - m_header.size());
+            m_header.append(p, count);
+            p += count;
+            left -= count;
+            if (m_header.size() == BlockSize) {
+                if (!processHeader()) {
+                    return -1;
+                }
+                m_header.clear();
+            }
+            break;
+        }
+        case DataState:
+        case LongNameState:
+        {
+            const qint64 count = qMin(left, m_left);
+            if (m_state == LongNameState) {
+                m_longName.append(p, count);
+            } else if (m_file.isOpen()) {
+                if (m_file.write(p, count) != count) {
+                    setFailed(m_file.errorString());
+                    return -1;
+                }
+                m_contentPosition += count;
+            }
+            p += count;
+            left -= count;
+            m_left -= count;
+            if (m_left == 0 && !finishEntry()) {
+                return -1;
+            }
+            break;
+        }
+        case PaddingState:
+        {
+            const qint64 count = qMin(left, m_padding);
+            p += count;
+            left -= count;
+            m_padding -= count;
+            if (m_padding == 0) {
+                m_state = HeaderState;
+            }
+            break;
+        }
+        case EndState:
+            // Archives are often padded after the end marker
+            left = 0;
+            break;
+        }
+    }
+
+    return maxSize;
+}
+
+bool TarReader::processHeader()
+{
+    const char *h = m_header.constData();
+
+    if (m_header.count('\0') == BlockSize) {
+        // Two empty blocks mark the end of the archive
+        if (++m_zeroBlocks == 2) {
+            qCDebug(KTP_FTH_MODULE) << "End of archive," << m_entryCount << "entries";
+            m_state = EndState;
+            Q_EMIT finished();
+        }
+        return true;
+    }
+    m_zeroBlocks = 0;
+
+    if (readNumber(h + ChecksumOffset, ChecksumSize) != checksum(h)) {
+        setFailed(QLatin1String("Corrupted archive header"));
+        return false;
+    }
+
+    const char type = h[TypeOffset];
+    const qint64 size = readNumber(h + SizeOffset, SizeSize);
+    m_left = size;
+    m_padding = paddingFor(size);
+
+    if (type == LongNameType) {
+        m_longName.clear();
+        m_state = LongNameState;
+        return size > 0 || finishEntry();
+    }
+
+    QByteArray name;
+    if (!m_longName.isEmpty()) {
+        name = m_longName;
+        name.truncate(qstrnlen(name.constData(), name.size()));
+        m_longName.clear();
+    } else {
+        name = QByteArray(h + NameOffset, qstrnlen(h + NameOffset, NameSize));
+        if (memcmp(h + MagicOffset, "ustar", 5) == 0 && h[PrefixOffset]) {
+            name.prepend(QByteArray(h + PrefixOffset, qstrnlen(h + PrefixOffset, PrefixSize)) + '/');
+        }
+    }
+
+    const QString relativePath = QFile::decodeName(name);
+    const QStringList components = relativePath.split(QLatin1Char('/'), QString::SkipEmptyParts);
+    if (relativePath.startsWith(QLatin1Char('/')) || components.contains(QLatin1String(".."))) {
+        setFailed(QLatin1String("Refusing to extract ") + relativePath);
+        return false;
+    }
+    const QString path = m_directory + QLatin1Char('/') + components.join(QLatin1String("/"));
+
+    m_mode = readNumber(h + ModeOffset, IdSize);
+    m_mtime = readNumber(h + MtimeOffset, MtimeSize);
+    m_state = DataState;
+
+    if (type == DirectoryType) {
+        if (!QDir().mkpath(path)) {
+            setFailed(QLatin1String("Unable to create ") + path);
+            return false;
+        }
+        m_entryCount++;
+        Q_EMIT entryStarted(relativePath);
+    } else if (type == RegularType || type == OldRegularType) {
+        QDir().mkpath(QFileInfo(path).absolutePath());
+        m_file.setFileName(path);
+        if (!m_file.open(QIODevice::WriteOnly)) {
+            setFailed(m_file.errorString());
+            return false;
+        }
+        m_entryCount++;
+        Q_EMIT entryStarted(relativePath);
+    } else {
+        // Links, devices... the data, if any, is skipped
+        qCDebug(KTP_FTH_MODULE) << "Skipping archive entry" << relativePath << "of type" << type;
+    }
+
+    return size > 0 || finishEntry();
+}
+
+bool TarReader::finishEntry()
+{
+    if (m_file.isOpen()) {
+        m_file.close();
+        const QByteArray path = QFile::encodeName(m_file.fileName());
+        ::chmod(path.constData(), m_mode & 0777);
+        const struct timespec times[2] = { { 0, UTIME_OMIT }, { time_t(m_mtime), 0 } };
+        ::utimensat(AT_FDCWD, path.constData(), times, 0);
+    }
+
+    m_state = m_padding > 0 ? PaddingState : HeaderState;
+    return true;
+}
+
+void TarReader::setFailed(const QString &errorMessage)
+{
+    if (m_file.isOpen()) {
+        m_file.close();
+    }
+    setErrorString(errorMessage);
+    Q_EMIT writeFailed(errorMessage);
+}
+
+#include "moc_tar-stream.cpp"
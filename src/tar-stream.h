@@ -0,0 +1,170 @@
+/*
+* Copyright (C) 2026 The KDE Telepathy Team
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this library; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef TAR_STREAM_H
+#define TAR_STREAM_H
+
+#include <QIODevice>
+#include <QByteArray>
+#include <QFile>
+#include <QList>
+
+#include <TelepathyQt/Types>
+
+/**
+ * Transfer of whole directories as a tar stream.
+ *
+ * Requested by the sender with the x-ktp-archive key of the channel Metadata
+ * set to "tar", the URI of the channel being a local directory. The archive
+ * is produced while it is sent and unpacked while it is received, nothing is
+ * stored on disk in between. It can be combined with compression.
+ */
+class TransferArchive
+{
+public:
+    /** True if the data of \p channel is a tar stream */
+    static bool isArchive(const Tp::FileTransferChannelPtr &channel);
+};
+
+
+/**
+ * Read-only sequential device producing a ustar archive, with GNU long
+ * names, of the content of a directory. The tree is scanned when the device
+ * is opened; files and directories are archived, other entries are skipped.
+ */
+class TarWriter : public QIODevice
+{
+    Q_OBJECT
+    Q_DISABLE_COPY(TarWriter)
+
+public:
+    explicit TarWriter(const QString &directory, QObject *parent = 0);
+    virtual ~TarWriter();
+
+    virtual bool open(OpenMode mode);
+    virtual bool isSequential() const;
+    virtual bool atEnd() const;
+    virtual qint64 bytesAvailable() const;
+
+    int entryCount() const;
+    /** Sum of the sizes of the archived files */
+    qulonglong contentSize() const;
+    /** Entries whose data has been read completely */
+    int finishedEntryCount() const;
+    qulonglong contentPosition() const;
+    /**
+     * Exact length of the archive, known once the device is open. It is the
+     * Size of the channel, unless the archive is compressed.
+     */
+    qulonglong archiveSize() const;
+    qulonglong archivePosition() const;
+
+Q_SIGNALS:
+    void entryStarted(const QString &name);
+
+protected:
+    virtual qint64 readData(char *data, qint64 maxSize);
+    virtual qint64 writeData(const char *data, qint64 maxSize);
+
+private:
+    struct Entry {
+        QString name;
+        QString path;
+        bool isDir;
+        qint64 size;
+        uint mode;
+        qint64 mtime;
+    };
+
+    bool startEntry(const Entry &entry);
+
+    QString m_directory;
+    QList<Entry> m_entries;
+    int m_index;
+    QByteArray m_pending;
+    int m_pendingPosition;
+    QFile m_file;
+    qint64 m_left;
+    qint64 m_padding;
+    bool m_finished;
+    qulonglong m_contentSize;
+    qulonglong m_contentPosition;
+    qulonglong m_archiveSize;
+    qulonglong m_archivePosition;
+};
+
+
+/**
+ * Write-only sequential device unpacking the tar stream written to it into
+ * a directory. Entries whose path is absolute or goes up the tree are
+ * refused. finished() is emitted at the end of the archive, writeFailed()
+ * when it is corrupted or cannot be written.
+ */
+class TarReader : public QIODevice
+{
+    Q_OBJECT
+    Q_DISABLE_COPY(TarReader)
+
+public:
+    explicit TarReader(const QString &directory, QObject *parent = 0);
+    virtual ~TarReader();
+
+    virtual bool open(OpenMode mode);
+    virtual bool isSequential() const;
+
+    bool isFinished() const;
+    int entryCount() const;
+    qulonglong contentPosition() const;
+
+Q_SIGNALS:
+    void entryStarted(const QString &name);
+    void finished();
+    void writeFailed(const QString &errorMessage);
+
+protected:
+    virtual qint64 readData(char *data, qint64 maxSize);
+    virtual qint64 writeData(const char *data, qint64 maxSize);
+
+private:
+    enum State {
+        HeaderState,
+        DataState,
+        LongNameState,
+        PaddingState,
+        EndState
+    };
+
+    bool processHeader();
+    bool finishEntry();
+    void setFailed(const QString &errorMessage);
+
+    QString m_directory;
+    State m_state;
+    QByteArray m_header;
+    QByteArray m_longName;
+    QFile m_file;
+    qint64 m_left;
+    qint64 m_padding;
+    qint64 m_mtime;
+    uint m_mode;
+    int m_zeroBlocks;
+    int m_entryCount;
+    qulonglong m_contentPosition;
+};
+
+#endif // TAR_STREAM_H
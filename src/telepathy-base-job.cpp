@@ -19,18 +19,21 @@
  */
 
 #include "telepathy-base-job_p.h"
+#include "progress-aggregator.h"
 #include "ktp-fth-debug.h"
 
 #include <TelepathyQt/PendingOperation>
 
 #include <KLocalizedString>
 #include <QDebug>
+#include <QTimer>
 
 using namespace KTp;
 
 TelepathyBaseJobPrivate::TelepathyBaseJobPrivate()
     : q_ptr(0)
-    , alreadyProcessed(0)
+    , progressAggregator(0)
+    , speedTimer(0)
 {
 }
 
@@ -54,6 +57,17 @@ TelepathyBaseJob::TelepathyBaseJob(TelepathyBaseJobPrivate& dd, QObject* parent)
     , d_ptr(&dd)
 {
     d_ptr->q_ptr = this;
+
+    d_ptr->progressAggregator = new ProgressAggregator(this);
+    connect(d_ptr->progressAggregator, SIGNAL(processedAmountChanged(qulonglong)),
+            this, SLOT(__k__onProcessedAmountAggregated(qulonglong)));
+
+    // Samples are also taken when no data arrives, so that the speed drops
+    // to 0 while the transfer is stalled
+    d_ptr->speedTimer = new QTimer(this);
+    d_ptr->speedTimer->setInterval(SpeedEstimator::SampleInterval);
+    connect(d_ptr->speedTimer, SIGNAL(timeout()), this, SLOT(__k__onSpeedTimeout()));
+    connect(this, SIGNAL(finished(KJob*)), d_ptr->speedTimer, SLOT(stop()));
 }
 
 TelepathyBaseJob::~TelepathyBaseJob()
@@ -63,26 +77,68 @@ TelepathyBaseJob::~TelepathyBaseJob()
 
 void TelepathyBaseJob::setProcessedAmountAndCalculateSpeed(qulonglong amount)
 {
-    qCDebug(KTP_FTH_MODULE) << amount;
+    qCDebug(KTP_FTH_MODULE) << amount << "of" << totalAmount(Bytes);
     Q_D(TelepathyBaseJob);
 
-    //If the transfer is starting
-    if (amount == 0) {
-        d->time = QTime::currentTime();
+    if (!d->speedEstimator.isStarted()) {
+        d->speedEstimator.start(amount);
+        d->speedTimer->start();
+    } else if (d->speedEstimator.addSample(amount)) {
+        emitSpeed(d->speedEstimator.speed());
     }
+    setProcessedAmount(Bytes, amount);
+}
 
-    //If a least 1 second has passed since last update
-    int secondsSinceLastTime = d->time.secsTo(QTime::currentTime());
-    if (secondsSinceLastTime > 0) {
-        float speed = (amount - d->alreadyProcessed) / secondsSinceLastTime;
-        emitSpeed(speed);
+void TelepathyBaseJob::setInitialProcessedAmount(qulonglong amount)
+{
+    qCDebug(KTP_FTH_MODULE) << amount;
+    Q_D(TelepathyBaseJob);
 
-        d->time = QTime::currentTime();
-        d->alreadyProcessed = amount;
-    }
+    // Data that was already there (i.e. resumed transfers) does not count
+    // for the speed
+    d->speedEstimator.start(amount);
+    d->speedTimer->start();
     setProcessedAmount(Bytes, amount);
 }
 
+void TelepathyBaseJob::setAverageSpeed(bool average)
+{
+    Q_D(TelepathyBaseJob);
+    d->speedEstimator.setMode(average ? SpeedEstimator::Average : SpeedEstimator::Instantaneous);
+}
+
+qint64 TelepathyBaseJob::eta() const
+{
+    Q_D(const TelepathyBaseJob);
+    return d->speedEstimator.eta(totalAmount(Bytes));
+}
+
+void TelepathyBaseJob::updateProcessedAmount(qulonglong amount)
+{
+    Q_D(TelepathyBaseJob);
+    d->progressAggregator->update(amount);
+}
+
+void TelepathyBaseJob::setProgressUpdatesPerSecond(int updates)
+{
+    Q_D(TelepathyBaseJob);
+    d->progressAggregator->setUpdatesPerSecond(updates);
+}
+
+void TelepathyBaseJobPrivate::__k__onProcessedAmountAggregated(qulonglong amount)
+{
+    Q_Q(TelepathyBaseJob);
+    q->setProcessedAmountAndCalculateSpeed(amount);
+}
+
+void TelepathyBaseJobPrivate::__k__onSpeedTimeout()
+{
+    Q_Q(TelepathyBaseJob);
+    if (speedEstimator.addSample(q->processedAmount(KJob::Bytes))) {
+        q->emitSpeed(speedEstimator.speed());
+    }
+}
+
 void TelepathyBaseJobPrivate::__k__tpOperationFinished(Tp::PendingOperation* op)
 {
     // First of all check if the operation is in our list
@@ -133,6 +189,9 @@ void TelepathyBaseJobPrivate::__k__doEmitResult()
         q->setErrorText(errorMessage);
     }
 
+    // Deliver the last progress update, if it was held back
+    progressAggregator->flush();
+
     // The job has been finished
     q->emitResult();
 }
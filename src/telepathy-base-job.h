@@ -75,6 +75,14 @@ enum JobError {
     ProvideFileError = 115,
     /** Cannot cancel file transfer */
     CancelFileTransferError = 116,
+    /** Cannot write the received file */
+    WriteFileError = 117,
+    /** Cannot read the file to send */
+    ReadFileError = 118,
+    /** Not enough space to save the received file */
+    NotEnoughSpaceError = 119,
+    /** The received file does not match the hash announced by the sender */
+    ContentHashMismatchError = 120,
     /** Telepathy triggered an error */
     TelepathyErrorError = 200,
     /** KTp Error */
@@ -87,9 +95,20 @@ class TelepathyBaseJob : public KJob
     Q_OBJECT
     Q_DISABLE_COPY(TelepathyBaseJob)
     Q_DECLARE_PRIVATE(TelepathyBaseJob)
+    Q_PROPERTY(qint64 eta READ eta)
 
     Q_PRIVATE_SLOT(d_func(), void __k__tpOperationFinished(Tp::PendingOperation*))
     Q_PRIVATE_SLOT(d_func(), void __k__doEmitResult())
+    Q_PRIVATE_SLOT(d_func(), void __k__onProcessedAmountAggregated(qulonglong amount))
+    Q_PRIVATE_SLOT(d_func(), void __k__onSpeedTimeout())
+
+public:
+    /**
+     * Estimated time to completion in milliseconds, from the remaining
+     * amount and the reported speed, or -1 while the speed is 0 or the
+     * total is unknown
+     */
+    qint64 eta() const;
 
 protected:
     explicit TelepathyBaseJob(TelepathyBaseJobPrivate &dd, QObject *parent = 0);
@@ -97,6 +116,27 @@ protected:
 
     void setProcessedAmountAndCalculateSpeed(qulonglong amount);
 
+    /**
+     * Sets the amount processed when the transfer starts (i.e. the offset
+     * of a resumed transfer) and restarts the speed estimation from there.
+     */
+    void setInitialProcessedAmount(qulonglong amount);
+
+    /**
+     * By default the speed is a moving average of the recent speed, if
+     * \p average is true the average since the start is used instead.
+     */
+    void setAverageSpeed(bool average);
+
+    /**
+     * Like setProcessedAmountAndCalculateSpeed(), but the updates are
+     * coalesced and delivered at most \p updates times per second, see
+     * setProgressUpdatesPerSecond(). Meant for updates received for every
+     * chunk of data.
+     */
+    void updateProcessedAmount(qulonglong amount);
+    void setProgressUpdatesPerSecond(int updates);
+
     TelepathyBaseJobPrivate * const d_ptr;
 };
 
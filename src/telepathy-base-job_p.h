@@ -21,8 +21,10 @@
 #define LIBKTP_TELEPATHY_BASE_JOB_P_H
 
 #include "telepathy-base-job.h"
+#include "speed-estimator.h"
 
-#include <QTime>
+class ProgressAggregator;
+class QTimer;
 
 namespace Tp
 {
@@ -43,16 +45,19 @@ public:
     TelepathyBaseJobPrivate();
     virtual ~TelepathyBaseJobPrivate();
 
-    QTime time;
-    qulonglong alreadyProcessed;
+    SpeedEstimator speedEstimator;
     QList< Tp::PendingOperation* > operations;
     QList< QPair< QString, QString > > telepathyErrors;
+    ProgressAggregator* progressAggregator;
+    QTimer* speedTimer;
 
     void addOperation(Tp::PendingOperation* op);
 
     // Operation Q_PRIVATE_SLOTS
     void __k__tpOperationFinished(Tp::PendingOperation* op);
     void __k__doEmitResult();
+    void __k__onProcessedAmountAggregated(qulonglong amount);
+    void __k__onSpeedTimeout();
 };
 
 } // namespace KTp
@@ -0,0 +1,974 @@
+/*
+* Copyright (C) 2026 The KDE Telepathy Team
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this library; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/*
+ * Throughput benchmark of the data paths used by the transfer jobs.
+ *
+ * It measures the I/O primitives, not whole transfers: there is no D-Bus
+ * session, no connection manager and no channel, and FileTransferHandler and
+ * the transfer jobs are not run. Negotiation, dialogs, scheduling, space
+ * reservation, hashing, the journal and the progress reporting are therefore
+ * not measured, and neither is StreamSender.
+ *
+ * A peer thread plays the connection manager: it listens on a local socket,
+ * like a connection manager does after AcceptFile/ProvideFile, and sends or
+ * receives synthetic data with blocking calls. The handler side is driven
+ * exactly as the jobs drive it:
+ *
+ *  - splice: SplicePump, incoming data over an abstract Unix socket
+ *  - sendfile: SendfilePump, outgoing data over an abstract Unix socket
+ *  - write-behind: incoming data read from a QTcpSocket in buffer sized
+ *    blocks, as StreamReceiver does, and written to a WriteBehindFile
+ *  - inflate: the same with compressed data going through an InflateWriter
+ *
+ * For every file size it reports the speed, the time until the first byte
+ * reached its destination and the CPU time used by the handler side. The CPU
+ * time is the one of the whole process minus the one of the peer thread,
+ * measured with its own thread CPU clock, so that the disk writer threads
+ * are included but the work of the stand-in connection manager is not.
+ */
+
+#include "buffer-pool.h"
+#include "compression-device.h"
+#include "page-cache-io.h"
+#include "sendfile-sender.h"
+#include "splice-receiver.h"
+#include "transfer-thread-pool.h"
+#include "write-behind-file.h"
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QFile>
+#include <QFileInfo>
+#include <QHostAddress>
+#include <QScopedPointer>
+#include <QTcpSocket>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include <QThread>
+
+#include <TelepathyQt/Constants>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+#include <zlib.h>
+
+// Size of the synthetic data repeated by the peer
+static const int PatternSize = 1024 * 1024;
+
+// The first chunk is small, so that the time to first byte does not depend
+// on the size of the socket buffers
+static const int FirstChunkSize = 4096;
+
+// Amount read from the socket at once and read ahead by the socket on the
+// QIODevice paths, as StreamReceiver does
+static const int SocketReadSize = BufferPool::BufferSize;
+
+// Interval between two checks of the received file for its first byte, in ns
+static const long FirstBytePollInterval = 20 * 1000;
+
+// Give up waiting for the first byte after this long, in ns
+static const qint64 FirstByteTimeout = Q_INT64_C(30) * 1000 * 1000 * 1000;
+
+// Space left free on the file system used for the files, in bytes
+static const qint64 SpaceMargin = 64 * 1024 * 1024;
+
+static const double Gibibyte = 1024.0 * 1024.0 * 1024.0;
+
+// Value of \p clock in nanoseconds
+static qint64 cpuClock(clockid_t clock)
+{
+    struct timespec ts;
+    if (clock_gettime(clock, &ts) < 0) {
+        return 0;
+    }
+    return qint64(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+// Half random, half repetitive data, so that compression has some work to do
+static QByteArray makePattern()
+{
+    static const char text[] = "KDE Telepathy file transfer benchmark. ";
+    QByteArray pattern(PatternSize, Qt::Uninitialized);
+    quint64 state = Q_UINT64_C(0x9E3779B97F4A7C15);
+    for (int i = 0; i < PatternSize; ++i) {
+        if ((i / 4096) % 2 == 0) {
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+            pattern[i] = char(state);
+        } else {
+            pattern[i] = text[i % (sizeof(text) - 1)];
+        }
+    }
+    return pattern;
+}
+
+static bool sendAll(int socket, const char *data, qint64 size)
+{
+    while (size > 0) {
+        const ssize_t count = ::send(socket, data, size, MSG_NOSIGNAL);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += count;
+        size -= count;
+    }
+    return true;
+}
+
+// Listens on an abstract Unix socket, as connection managers offering
+// SocketAddressTypeAbstractUnix do. Returns -1 on failure.
+static int listenUnix(const QByteArray &name)
+{
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    memcpy(addr.sun_path + 1, name.constData(), name.size());
+    const socklen_t length = offsetof(struct sockaddr_un, sun_path) + 1 + name.size();
+
+    const int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    if (::bind(fd, reinterpret_cast<struct sockaddr*>(&addr), length) < 0 || ::listen(fd, 1) < 0) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Listens on the loopback interface, as connection managers offering IPv4
+// sockets to TelepathyQt do. Returns -1 on failure.
+static int listenTcp(quint16 *port)
+{
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(addr);
+
+    const int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    if (::bind(fd, reinterpret_cast<struct sockaddr*>(&addr), length) < 0
+            || ::listen(fd, 1) < 0
+            || ::getsockname(fd, reinterpret_cast<struct sockaddr*>(&addr), &length) < 0) {
+        ::close(fd);
+        return -1;
+    }
+    *port = ntohs(addr.sin_port);
+    return fd;
+}
+
+// Writes \p size bytes of \p pattern to a new file and drops it from the page
+// cache, so that it is read from the disk like a file picked by the user
+static bool createSourceFile(const QString &fileName, qint64 size, const QByteArray &pattern, QString *error)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        *error = file.errorString();
+        return false;
+    }
+    qint64 left = size;
+    while (left > 0) {
+        const qint64 count = qMin<qint64>(left, pattern.size());
+        if (file.write(pattern.constData(), count) != count) {
+            *error = file.errorString();
+            return false;
+        }
+        left -= count;
+    }
+    file.flush();
+    ::fdatasync(file.handle());
+    ::posix_fadvise(file.handle(), 0, 0, POSIX_FADV_DONTNEED);
+    return true;
+}
+
+
+/**
+ * Connection manager side of a transfer: accepts the connection of the
+ * handler on \p listener and sends or receives the data with blocking calls.
+ * All the times are taken on the clock of the benchmark, in nanoseconds.
+ */
+class Peer : public QThread
+{
+public:
+    enum Role {
+        Send,
+        SendCompressed,
+        Receive
+    };
+
+    Peer(int listener, Role role, qint64 size, const QByteArray &pattern, const QElapsedTimer &clock);
+
+    /**
+     * When sending, the first byte is considered received once \p fileName is
+     * not empty anymore. Otherwise it is when the first byte is received.
+     */
+    void setWatchedFile(const QString &fileName);
+
+    qint64 cpuTime() const;
+    qint64 firstByteAt() const;
+    qint64 lastByteAt() const;
+    qint64 transferred() const;
+    QString errorString() const;
+
+protected:
+    virtual void run();
+
+private:
+    bool send(int socket);
+    bool sendCompressed(int socket);
+    bool receive(int socket);
+    void waitForWatchedFile();
+    void setError(const char *operation);
+
+    int m_listener;
+    Role m_role;
+    qint64 m_size;
+    QByteArray m_pattern;
+    QElapsedTimer m_clock;
+    QString m_watchedFile;
+    qint64 m_cpuTime;
+    qint64 m_firstByteAt;
+    qint64 m_lastByteAt;
+    qint64 m_transferred;
+    QString m_error;
+};
+
+Peer::Peer(int listener, Role role, qint64 size, const QByteArray &pattern, const QElapsedTimer &clock)
+    : m_listener(listener),
+      m_role(role),
+      m_size(size),
+      m_pattern(pattern),
+      m_clock(clock),
+      m_cpuTime(0),
+      m_firstByteAt(-1),
+      m_lastByteAt(-1),
+      m_transferred(0)
+{
+}
+
+void Peer::setWatchedFile(const QString &fileName)
+{
+    m_watchedFile = fileName;
+}
+
+qint64 Peer::cpuTime() const
+{
+    return m_cpuTime;
+}
+
+qint64 Peer::firstByteAt() const
+{
+    return m_firstByteAt;
+}
+
+qint64 Peer::lastByteAt() const
+{
+    return m_lastByteAt;
+}
+
+qint64 Peer::transferred() const
+{
+    return m_transferred;
+}
+
+QString Peer::errorString() const
+{
+    return m_error;
+}
+
+void Peer::run()
+{
+    const qint64 cpuStart = cpuClock(CLOCK_THREAD_CPUTIME_ID);
+
+    // Fails when the listener is shut down because the handler gave up
+    const int socket = ::accept(m_listener, 0, 0);
+    if (socket < 0) {
+        setError("accept");
+    } else {
+        switch (m_role) {
+        case Send:
+            send(socket);
+            break;
+        case SendCompressed:
+            sendCompressed(socket);
+            break;
+        case Receive:
+            receive(socket);
+            break;
+        }
+        ::close(socket);
+    }
+
+    m_cpuTime = cpuClock(CLOCK_THREAD_CPUTIME_ID) - cpuStart;
+}
+
+bool Peer::send(int socket)
+{
+    bool first = true;
+    while (m_transferred < m_size) {
+        const qint64 offset = m_transferred % m_pattern.size();
+        qint64 count = qMin<qint64>(m_size - m_transferred, m_pattern.size() - offset);
+        if (first) {
+            count = qMin<qint64>(count, FirstChunkSize);
+        }
+        if (!sendAll(socket, m_pattern.constData() + offset, count)) {
+            setError("send");
+            return false;
+        }
+        m_transferred += count;
+        if (first) {
+            first = false;
+            waitForWatchedFile();
+        }
+    }
+    m_lastByteAt = m_clock.nsecsElapsed();
+    return true;
+}
+
+bool Peer::sendCompressed(int socket)
+{
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    if (deflateInit(&stream, Z_BEST_SPEED) != Z_OK) {
+        m_error = QLatin1String("Unable to initialize compression");
+        return false;
+    }
+
+    QByteArray output(PatternSize, Qt::Uninitialized);
+    qint64 consumed = 0;
+    bool first = true;
+    int flush;
+    do {
+        const qint64 offset = consumed % m_pattern.size();
+        qint64 count = qMin<qint64>(m_size - consumed, m_pattern.size() - offset);
+        if (first) {
+            count = qMin<qint64>(count, FirstChunkSize);
+        }
+        consumed += count;
+        // The first chunk is flushed, otherwise zlib keeps it until it has
+        // enough data
+        flush = consumed == m_size ? Z_FINISH : (first ? Z_SYNC_FLUSH : Z_NO_FLUSH);
+
+        stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(m_pattern.constData() + offset));
+        stream.avail_in = count;
+        do {
+            stream.next_out = reinterpret_cast<Bytef*>(output.data());
+            stream.avail_out = output.size();
+            deflate(&stream, flush);
+            const qint64 produced = output.size() - stream.avail_out;
+            if (!sendAll(socket, output.constData(), produced)) {
+                deflateEnd(&stream);
+                setError("send");
+                return false;
+            }
+            m_transferred += produced;
+        } while (stream.avail_out == 0);
+
+        if (first) {
+            first = false;
+            waitForWatchedFile();
+        }
+    } while (flush != Z_FINISH);
+
+    deflateEnd(&stream);
+    m_lastByteAt = m_clock.nsecsElapsed();
+    return true;
+}
+
+bool Peer::receive(int socket)
+{
+    QByteArray buffer(PatternSize, Qt::Uninitialized);
+    Q_FOREVER {
+        const ssize_t count = ::recv(socket, buffer.data(), buffer.size(), 0);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            setError("recv");
+            return false;
+        }
+        if (count == 0) {
+            return true;
+        }
+        m_lastByteAt = m_clock.nsecsElapsed();
+        if (m_transferred == 0) {
+            m_firstByteAt = m_lastByteAt;
+        }
+        m_transferred += count;
+    }
+}
+
+void Peer::waitForWatchedFile()
+{
+    if (m_watchedFile.isEmpty()) {
+        return;
+    }
+
+    const QByteArray path = QFile::encodeName(m_watchedFile);
+    const qint64 deadline = m_clock.nsecsElapsed() + FirstByteTimeout;
+    struct timespec interval = { 0, FirstBytePollInterval };
+    struct stat st;
+    while (m_clock.nsecsElapsed() < deadline) {
+        if (::stat(path.constData(), &st) == 0 && st.st_size > 0) {
+            m_firstByteAt = m_clock.nsecsElapsed();
+            return;
+        }
+        ::nanosleep(&interval, 0);
+    }
+}
+
+void Peer::setError(const char *operation)
+{
+    m_error = QString::fromLatin1("%1: %2").arg(QLatin1String(operation), QString::fromLocal8Bit(strerror(errno)));
+}
+
+
+struct Measurement
+{
+    Measurement()
+        : elapsed(-1),
+          firstByte(-1),
+          handlerCpu(0),
+          peerCpu(0)
+    {
+    }
+
+    // Until the last byte reached its destination, in nanoseconds
+    qint64 elapsed;
+    // -1 if unknown
+    qint64 firstByte;
+    qint64 handlerCpu;
+    qint64 peerCpu;
+    QString ioMode;
+    QString error;
+};
+
+
+class Benchmark : public QObject
+{
+    Q_OBJECT
+    Q_DISABLE_COPY(Benchmark)
+
+public:
+    enum Path {
+        SplicePath,
+        SendfilePath,
+        WriteBehindPath,
+        InflatePath
+    };
+
+    Benchmark(const QString &directory, PageCacheIo::Mode ioMode);
+
+    static QString pathName(Path path);
+
+    Measurement run(Path path, qint64 size);
+
+private Q_SLOTS:
+    void onPumpFinished(qulonglong position);
+    void onFailed(const QString &errorMessage);
+    void onSocketReadyRead();
+    void onSocketDisconnected();
+    void onOutputDrained();
+
+private:
+    Measurement runPump(Path path, qint64 size, const QString &fileName);
+    Measurement runDevice(Path path, qint64 size, const QString &fileName);
+    void checkDeviceFinished();
+    void finish();
+
+    QString m_directory;
+    PageCacheIo::Mode m_ioMode;
+    QByteArray m_pattern;
+    QElapsedTimer m_clock;
+    QEventLoop m_loop;
+    int m_sockets;
+
+    // State of the running measurement
+    qint64 m_finishedAt;
+    QString m_error;
+    QTcpSocket *m_socket;
+    QIODevice *m_output;
+    WriteBehindFile *m_writeBehindFile;
+    InflateWriter *m_inflateWriter;
+};
+
+Benchmark::Benchmark(const QString &directory, PageCacheIo::Mode ioMode)
+    : m_directory(directory),
+      m_ioMode(ioMode),
+      m_pattern(makePattern()),
+      m_sockets(0),
+      m_finishedAt(-1),
+      m_socket(0),
+      m_output(0),
+      m_writeBehindFile(0),
+      m_inflateWriter(0)
+{
+    m_clock.start();
+}
+
+QString Benchmark::pathName(Path path)
+{
+    switch (path) {
+    case SplicePath:
+        return QLatin1String("splice");
+    case SendfilePath:
+        return QLatin1String("sendfile");
+    case WriteBehindPath:
+        return QLatin1String("write-behind");
+    case InflatePath:
+    default:
+        return QLatin1String("inflate");
+    }
+}
+
+Measurement Benchmark::run(Path path, qint64 size)
+{
+    Measurement result;
+
+    struct statvfs vfs;
+    if (::statvfs(QFile::encodeName(m_directory).constData(), &vfs) == 0
+            && qint64(vfs.f_bavail) * qint64(vfs.f_frsize) < size + SpaceMargin) {
+        result.error = QLatin1String("skipped, not enough space");
+        return result;
+    }
+
+    const QString fileName = m_directory + QLatin1Char('/') + pathName(path) + QLatin1Char('-') + QString::number(size);
+    m_finishedAt = -1;
+    m_error.clear();
+
+    if (path == SplicePath || path == SendfilePath) {
+        result = runPump(path, size, fileName);
+    } else {
+        result = runDevice(path, size, fileName);
+    }
+
+    QFile::remove(fileName);
+    return result;
+}
+
+Measurement Benchmark::runPump(Path path, qint64 size, const QString &fileName)
+{
+    Measurement result;
+
+    if (path == SendfilePath && !createSourceFile(fileName, size, m_pattern, &result.error)) {
+        return result;
+    }
+    const int fd = ::open(QFile::encodeName(fileName).constData(),
+                          path == SendfilePath ? O_RDONLY | O_CLOEXEC : O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                          0644);
+    if (fd < 0) {
+        result.error = QString::fromLocal8Bit(strerror(errno));
+        return result;
+    }
+
+    const QByteArray address = "ktp-fth-benchmark-" + QByteArray::number(QCoreApplication::applicationPid())
+                             + '-' + QByteArray::number(++m_sockets);
+    const int listener = listenUnix(address);
+    if (listener < 0) {
+        result.error = QString::fromLocal8Bit(strerror(errno));
+        ::close(fd);
+        return result;
+    }
+
+    Peer peer(listener, path == SendfilePath ? Peer::Receive : Peer::Send, size, m_pattern, m_clock);
+    NativeTransferPump *pump;
+    if (path == SendfilePath) {
+        pump = new SendfilePump(fd, size);
+        result.ioMode = PageCacheIo::modeName(PageCacheIo::Buffered);
+    } else {
+        // Spliced data never goes through a user space buffer, as in the job
+        const PageCacheIo::Mode ioMode = m_ioMode == PageCacheIo::Buffered ? PageCacheIo::Buffered
+                                                                           : PageCacheIo::DropBehind;
+        pump = new SplicePump(fd, size, QSharedPointer<ChunkManifest>(), ioMode == PageCacheIo::DropBehind);
+        result.ioMode = PageCacheIo::modeName(ioMode);
+        peer.setWatchedFile(fileName);
+    }
+    // The pump works on its own copy
+    ::close(fd);
+
+    QThread *thread = TransferThreadPool::instance()->acquireThread();
+    pump->moveToThread(thread);
+    connect(pump, SIGNAL(finished(qulonglong)), SLOT(onPumpFinished(qulonglong)));
+    connect(pump, SIGNAL(failed(QString)), SLOT(onFailed(QString)));
+
+    const qint64 cpuStart = cpuClock(CLOCK_PROCESS_CPUTIME_ID);
+    const qint64 start = m_clock.nsecsElapsed();
+    peer.start();
+    QMetaObject::invokeMethod(pump, "start", Qt::QueuedConnection,
+                              Q_ARG(QByteArray, address),
+                              Q_ARG(uint, uint(Tp::SocketAddressTypeAbstractUnix)),
+                              Q_ARG(qulonglong, 0));
+    m_loop.exec();
+
+    disconnect(pump, 0, this, 0);
+    pump->deleteLater();
+    TransferThreadPool::instance()->releaseThread(thread);
+    // Unblocks the peer if the pump never connected
+    ::shutdown(listener, SHUT_RDWR);
+    peer.wait();
+    ::close(listener);
+
+    result.peerCpu = peer.cpuTime();
+    result.handlerCpu = cpuClock(CLOCK_PROCESS_CPUTIME_ID) - cpuStart - result.peerCpu;
+    if (peer.firstByteAt() >= 0) {
+        result.firstByte = peer.firstByteAt() - start;
+    }
+
+    if (!m_error.isEmpty()) {
+        result.error = m_error;
+    } else if (path == SendfilePath) {
+        result.elapsed = peer.lastByteAt() - start;
+        if (peer.transferred() != size) {
+            result.error = QString::fromLatin1("%1 bytes received instead of %2").arg(peer.transferred()).arg(size);
+        }
+    } else {
+        result.elapsed = m_finishedAt - start;
+        if (QFileInfo(fileName).size() != size) {
+            result.error = QString::fromLatin1("%1 bytes written instead of %2").arg(QFileInfo(fileName).size()).arg(size);
+        }
+    }
+    if (result.error.isEmpty() && !peer.errorString().isEmpty()) {
+        result.error = peer.errorString();
+    }
+    return result;
+}
+
+Measurement Benchmark::runDevice(Path path, qint64 size, const QString &fileName)
+{
+    Measurement result;
+
+    quint16 port = 0;
+    const int listener = listenTcp(&port);
+    if (listener < 0) {
+        result.error = QString::fromLocal8Bit(strerror(errno));
+        return result;
+    }
+
+    // Opened as the job opens the .part file
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Unbuffered)) {
+        result.error = file.errorString();
+        ::close(listener);
+        return result;
+    }
+    WriteBehindFile writeBehindFile(file.handle());
+    result.ioMode = PageCacheIo::modeName(writeBehindFile.setIoMode(m_ioMode));
+    writeBehindFile.open(QIODevice::WriteOnly | QIODevice::Unbuffered);
+    QScopedPointer<InflateWriter> inflateWriter;
+    if (path == InflatePath) {
+        inflateWriter.reset(new InflateWriter(&writeBehindFile));
+        inflateWriter->open(QIODevice::WriteOnly);
+        connect(inflateWriter.data(), SIGNAL(writeFailed(QString)), SLOT(onFailed(QString)));
+    }
+    QTcpSocket socket;
+    socket.setReadBufferSize(SocketReadSize);
+    connect(&socket, SIGNAL(readyRead()), SLOT(onSocketReadyRead()));
+    connect(&writeBehindFile, SIGNAL(spaceAvailable()), SLOT(onSocketReadyRead()));
+    connect(&socket, SIGNAL(disconnected()), SLOT(onSocketDisconnected()));
+    connect(&writeBehindFile, SIGNAL(drained()), SLOT(onOutputDrained()));
+    connect(&writeBehindFile, SIGNAL(writeFailed(QString)), SLOT(onFailed(QString)));
+
+    m_socket = &socket;
+    m_writeBehindFile = &writeBehindFile;
+    m_inflateWriter = inflateWriter.data();
+    m_output = m_inflateWriter ? static_cast<QIODevice*>(m_inflateWriter) : &writeBehindFile;
+
+    Peer peer(listener, path == InflatePath ? Peer::SendCompressed : Peer::Send, size, m_pattern, m_clock);
+    peer.setWatchedFile(fileName);
+
+    const qint64 cpuStart = cpuClock(CLOCK_PROCESS_CPUTIME_ID);
+    const qint64 start = m_clock.nsecsElapsed();
+    peer.start();
+    socket.connectToHost(QHostAddress(QHostAddress::LocalHost), port);
+    if (socket.waitForConnected()) {
+        m_loop.exec();
+    } else {
+        m_error = socket.errorString();
+    }
+
+    socket.disconnect(this);
+    writeBehindFile.disconnect(this);
+    socket.abort();
+    ::shutdown(listener, SHUT_RDWR);
+    peer.wait();
+    ::close(listener);
+    m_socket = 0;
+    m_output = 0;
+    m_writeBehindFile = 0;
+    m_inflateWriter = 0;
+
+    result.peerCpu = peer.cpuTime();
+    result.handlerCpu = cpuClock(CLOCK_PROCESS_CPUTIME_ID) - cpuStart - result.peerCpu;
+    if (peer.firstByteAt() >= 0) {
+        result.firstByte = peer.firstByteAt() - start;
+    }
+
+    if (!m_error.isEmpty()) {
+        result.error = m_error;
+    } else {
+        result.elapsed = m_finishedAt - start;
+        if (QFileInfo(fileName).size() != size) {
+            result.error = QString::fromLatin1("%1 bytes written instead of %2").arg(QFileInfo(fileName).size()).arg(size);
+        }
+    }
+    if (result.error.isEmpty() && !peer.errorString().isEmpty()) {
+        result.error = peer.errorString();
+    }
+    return result;
+}
+
+void Benchmark::onPumpFinished(qulonglong position)
+{
+    Q_UNUSED(position);
+    finish();
+}
+
+void Benchmark::onFailed(const QString &errorMessage)
+{
+    if (m_error.isEmpty()) {
+        m_error = errorMessage;
+    }
+    m_loop.quit();
+}
+
+void Benchmark::onSocketReadyRead()
+{
+    if (!m_socket) {
+        return;
+    }
+
+    // As StreamReceiver does for the channels
+    QByteArray buffer(SocketReadSize, Qt::Uninitialized);
+    while (m_socket->bytesAvailable() > 0) {
+        if (m_writeBehindFile->isFull()) {
+            return;
+        }
+        const qint64 count = m_socket->read(buffer.data(), buffer.size());
+        if (count <= 0) {
+            break;
+        }
+        if (m_output->write(buffer.constData(), count) != count) {
+            onFailed(m_output->errorString());
+            return;
+        }
+    }
+    checkDeviceFinished();
+}
+
+void Benchmark::onSocketDisconnected()
+{
+    // Data might still be buffered
+    onSocketReadyRead();
+}
+
+void Benchmark::onOutputDrained()
+{
+    checkDeviceFinished();
+}
+
+void Benchmark::checkDeviceFinished()
+{
+    // The socket might have been closed while the disk was behind, with
+    // data left to read
+    if (!m_socket || m_socket->state() != QAbstractSocket::UnconnectedState
+            || m_socket->bytesAvailable() > 0) {
+        return;
+    }
+    if (m_inflateWriter && !m_inflateWriter->isFinished()) {
+        return;
+    }
+    if (m_writeBehindFile->isDrained()) {
+        finish();
+    }
+}
+
+void Benchmark::finish()
+{
+    if (m_finishedAt < 0) {
+        m_finishedAt = m_clock.nsecsElapsed();
+    }
+    m_loop.quit();
+}
+
+
+// Parses sizes like 1K, 16M or 10G, in powers of 1024. Returns -1 if invalid.
+static qint64 parseSize(const QString &text)
+{
+    QString number = text.trimmed().toUpper();
+    qint64 unit = 1;
+    if (number.endsWith(QLatin1Char('K'))) {
+        unit = Q_INT64_C(1024);
+    } else if (number.endsWith(QLatin1Char('M'))) {
+        unit = Q_INT64_C(1024) * 1024;
+    } else if (number.endsWith(QLatin1Char('G'))) {
+        unit = Q_INT64_C(1024) * 1024 * 1024;
+    }
+    if (unit > 1) {
+        number.chop(1);
+    }
+    bool ok;
+    const qint64 value = number.toLongLong(&ok);
+    return ok && value > 0 ? value * unit : -1;
+}
+
+static QString formatSize(qint64 size)
+{
+    if (size >= Q_INT64_C(1024) * 1024 * 1024 && size % (Q_INT64_C(1024) * 1024 * 1024) == 0) {
+        return QString::number(size / (Q_INT64_C(1024) * 1024 * 1024)) + QLatin1String(" GiB");
+    }
+    if (size >= 1024 * 1024 && size % (1024 * 1024) == 0) {
+        return QString::number(size / (1024 * 1024)) + QLatin1String(" MiB");
+    }
+    if (size >= 1024 && size % 1024 == 0) {
+        return QString::number(size / 1024) + QLatin1String(" KiB");
+    }
+    return QString::number(size) + QLatin1String(" B");
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    app.setApplicationName(QLatin1String("ktp-filetransfer-handler-benchmark"));
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QLatin1String("Measures the data paths of the file transfer handler against a local stand-in connection manager"));
+    parser.addHelpOption();
+    QCommandLineOption directoryOption(QLatin1String("directory"),
+                                       QLatin1String("Directory where the files are written, on the file system to measure"),
+                                       QLatin1String("path"), QDir::tempPath());
+    QCommandLineOption sizesOption(QLatin1String("sizes"),
+                                   QLatin1String("Comma separated file sizes, with K, M or G suffixes"),
+                                   QLatin1String("sizes"), QLatin1String("1K,64K,1M,16M,256M,1G,10G"));
+    QCommandLineOption pathsOption(QLatin1String("paths"),
+                                   QLatin1String("Comma separated data paths: splice, sendfile, write-behind, inflate"),
+                                   QLatin1String("paths"), QLatin1String("splice,sendfile,write-behind,inflate"));
+    QCommandLineOption ioModeOption(QLatin1String("io-mode"),
+                                    QLatin1String("Page cache mode of the received files: buffered, dropBehind or direct"),
+                                    QLatin1String("mode"), QLatin1String("buffered"));
+    parser.addOption(directoryOption);
+    parser.addOption(sizesOption);
+    parser.addOption(pathsOption);
+    parser.addOption(ioModeOption);
+    parser.process(app);
+
+    QTextStream out(stdout);
+    out.setFieldAlignment(QTextStream::AlignLeft);
+    QTextStream err(stderr);
+
+    QList<qint64> sizes;
+    Q_FOREACH (const QString &text, parser.value(sizesOption).split(QLatin1Char(',')')) {
+        if (text.trimmed().isEmpty()) {
+            continue;
+        }
+        const qint64 size = parseSize(text);
+        if (size < 0) {
+            err << "Invalid size " << text << '\n';
+            return 2;
+        }
+        sizes << size;
+    }
+
+    QList<Benchmark::Path> paths;
+    Q_FOREACH (const QString &text, parser.value(pathsOption).split(QLatin1Char(',')')) {
+        if (text.trimmed().isEmpty()) {
+            continue;
+        }
+        bool found = false;
+        for (int path = Benchmark::SplicePath; path <= Benchmark::InflatePath; ++path) {
+            if (Benchmark::pathName(Benchmark::Path(path)) == text.trimmed()) {
+                paths << Benchmark::Path(path);
+                found = true;
+            }
+        }
+        if (!found) {
+            err << "Invalid data path " << text << '\n';
+            return 2;
+        }
+    }
+
+    PageCacheIo::Mode ioMode = PageCacheIo::Buffered;
+    const QString ioModeName = parser.value(ioModeOption);
+    if (ioModeName == PageCacheIo::modeName(PageCacheIo::DropBehind)) {
+        ioMode = PageCacheIo::DropBehind;
+    } else if (ioModeName == PageCacheIo::modeName(PageCacheIo::Direct)) {
+        ioMode = PageCacheIo::Direct;
+    } else if (ioModeName != PageCacheIo::modeName(PageCacheIo::Buffered)) {
+        err << "Invalid I/O mode " << ioModeName << '\n';
+        return 2;
+    }
+
+    QTemporaryDir directory(parser.value(directoryOption) + QLatin1String("/ktp-fth-benchmark-XXXXXX"));
+    if (!directory.isValid()) {
+        err << "Unable to create a directory in " << parser.value(directoryOption) << '\n';
+        return 2;
+    }
+
+    Benchmark benchmark(directory.path(), ioMode);
+    int failures = 0;
+
+    out << qSetFieldWidth(14)
+        << "path" << "size" << "io mode" << "MiB/s" << "first byte ms" << "CPU ms" << "CPU s/GiB" << "peer s/GiB"
+        << qSetFieldWidth(0) << '\n';
+    Q_FOREACH (Benchmark::Path path, paths) {
+        Q_FOREACH (qint64 size, sizes) {
+            const Measurement result = benchmark.run(path, size);
+            out << qSetFieldWidth(14) << Benchmark::pathName(path) << formatSize(size);
+            if (!result.error.isEmpty()) {
+                out << qSetFieldWidth(0) << result.error << '\n';
+                out.flush();
+                if (!result.error.startsWith(QLatin1String("skipped"))) {
+                    ++failures;
+                }
+                continue;
+            }
+            const double gibibytes = size / Gibibyte;
+            out << result.ioMode
+                << QString::number(size / (1024.0 * 1024.0) / (qMax<qint64>(result.elapsed, 1) / 1e9), 'f', 1)
+                << (result.firstByte >= 0 ? QString::number(result.firstByte / 1e6, 'f', 3) : QString::fromLatin1("-"))
+                << QString::number(result.handlerCpu / 1e6, 'f', 2)
+                << QString::number(result.handlerCpu / 1e9 / gibibytes, 'f', 3)
+                << QString::number(result.peerCpu / 1e9 / gibibytes, 'f', 3)
+                << qSetFieldWidth(0) << '\n';
+            out.flush();
+        }
+    }
+
+    return failures > 0 ? 1 : 0;
+}
+
+#include "transfer-benchmark.moc"
@@ -0,0 +1,356 @@
+/*
+* Copyright (C) 2026 The KDE Telepathy Team
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this library; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "transfer-journal.h"
+#include "chunk-manifest.h"
+#include "page-cache-io.h"
+#include "ktp-fth-debug.h"
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutex>
+#include <QRunnable>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QThreadPool>
+#include <QTimer>
+
+#include <TelepathyQt/IncomingFileTransferChannel>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+// Delay before the pending changes are appended, in ms
+static const int FlushDelay = 2000;
+
+// Entries not updated for this long are dropped, in days
+static const int MaxEntryAge = 7;
+
+// Appends the batches to the journal file, from the disk writer threads
+class JournalWriter
+{
+public:
+    explicit JournalWriter(int fd)
+        : fd(fd),
+          writing(false)
+    {
+    }
+
+    ~JournalWriter()
+    {
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+
+    void writePending();
+
+    // Held while a batch is written, so that the batches stay in order
+    QMutex writeMutex;
+    QMutex mutex;
+    int fd;
+    QByteArray pending;
+    // A task is running or scheduled
+    bool writing;
+};
+
+// A single write and a single flush for the whole batch; a record cut by a
+// crash is ignored when the journal is loaded
+void JournalWriter::writePending()
+{
+    QMutexLocker writeLocker(&writeMutex);
+    QByteArray batch;
+    {
+        QMutexLocker locker(&mutex);
+        batch.swap(pending);
+    }
+    if (batch.isEmpty()) {
+        return;
+    }
+
+    const char *data = batch.constData();
+    qint64 left = batch.size();
+    while (left > 0) {
+        const ssize_t written = ::write(fd, data, left);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            qCWarning(KTP_FTH_MODULE) << "Unable to write the transfer journal -" << strerror(errno);
+            break;
+        }
+        data += written;
+        left -= written;
+    }
+    ::fdatasync(fd);
+}
+
+class JournalWriteTask : public QRunnable
+{
+public:
+    explicit JournalWriteTask(const QSharedPointer<JournalWriter> &writer)
+        : m_writer(writer)
+    {
+    }
+
+    virtual void run()
+    {
+        Q_FOREVER {
+            m_writer->writePending();
+            QMutexLocker locker(&m_writer->mutex);
+            if (m_writer->pending.isEmpty()) {
+                m_writer->writing = false;
+                return;
+            }
+        }
+    }
+
+private:
+    QSharedPointer<JournalWriter> m_writer;
+};
+
+static QJsonObject toJson(const TransferJournal::Entry &entry)
+{
+    QJsonObject record;
+    record.insert(QLatin1String("op"), QLatin1String("begin"));
+    record.insert(QLatin1String("key"), entry.key);
+    record.insert(QLatin1String("contact"), entry.contact);
+    record.insert(QLatin1String("fileName"), entry.fileName);
+    record.insert(QLatin1String("url"), entry.url.toString());
+    record.insert(QLatin1String("part"), entry.partFileName);
+    record.insert(QLatin1String("size"), double(entry.size));
+    record.insert(QLatin1String("offset"), double(entry.offset));
+    record.insert(QLatin1String("hashType"), double(entry.contentHashType));
+    record.insert(QLatin1String("hash"), entry.contentHash);
+    record.insert(QLatin1String("time"), entry.updated.toString(Qt::ISODate));
+    return record;
+}
+
+static QByteArray toLine(const QJsonObject &record)
+{
+    return QJsonDocument(record).toJson(QJsonDocument::Compact) + '\n';
+}
+
+TransferJournal *TransferJournal::instance()
+{
+    static TransferJournal *journal = 0;
+    if (!journal) {
+        journal = new TransferJournal(qApp);
+    }
+    return journal;
+}
+
+TransferJournal::TransferJournal(QObject *parent)
+    : QObject(parent),
+      m_flushTimer(new QTimer(this))
+{
+    const QString directory = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
+    QDir().mkpath(directory);
+    m_fileName = directory + QLatin1String("/transfer-journal");
+
+    m_flushTimer->setSingleShot(true);
+    m_flushTimer->setInterval(FlushDelay);
+    connect(m_flushTimer, SIGNAL(timeout()), SLOT(flush()));
+
+    load();
+
+    const int fd = ::open(QFile::encodeName(m_fileName).constData(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        qCWarning(KTP_FTH_MODULE) << "Unable to open the transfer journal" << m_fileName << "-" << strerror(errno);
+    } else {
+        m_writer = QSharedPointer<JournalWriter>(new JournalWriter(fd));
+    }
+}
+
+TransferJournal::~TransferJournal()
+{
+    // The disk writer threads might already be gone, write what is left here
+    collectPending();
+    if (m_writer) {
+        QMutexLocker locker(&m_writer->mutex);
+        m_writer->pending += m_pending;
+        locker.unlock();
+        m_writer->writePending();
+    }
+}
+
+QString TransferJournal::key(const Tp::IncomingFileTransferChannelPtr &channel)
+{
+    return QString::fromLatin1(ChunkManifest::identity(channel).toHex());
+}
+
+bool TransferJournal::find(const QString &key, Entry *entry) const
+{
+    QHash<QString, Entry>::const_iterator it = m_entries.constFind(key);
+    if (it == m_entries.constEnd()) {
+        return false;
+    }
+    *entry = *it;
+    if (m_pendingOffsets.contains(key)) {
+        entry->offset = m_pendingOffsets.value(key);
+    }
+    return true;
+}
+
+void TransferJournal::begin(const Entry &entry)
+{
+    Entry newEntry = entry;
+    newEntry.updated = QDateTime::currentDateTimeUtc();
+    m_entries.insert(newEntry.key, newEntry);
+    m_pendingOffsets.remove(newEntry.key);
+    append(toLine(toJson(newEntry)));
+}
+
+void TransferJournal::updateOffset(const QString &key, qulonglong offset)
+{
+    if (!m_entries.contains(key)) {
+        return;
+    }
+    m_pendingOffsets.insert(key, offset);
+    scheduleFlush();
+}
+
+void TransferJournal::end(const QString &key)
+{
+    if (m_entries.remove(key) == 0) {
+        return;
+    }
+    m_pendingOffsets.remove(key);
+
+    QJsonObject record;
+    record.insert(QLatin1String("op"), QLatin1String("end"));
+    record.insert(QLatin1String("key"), key);
+    append(toLine(record));
+}
+
+void TransferJournal::append(const QByteArray &record)
+{
+    m_pending += record;
+    scheduleFlush();
+}
+
+void TransferJournal::scheduleFlush()
+{
+    if (!m_flushTimer->isActive()) {
+        m_flushTimer->start();
+    }
+}
+
+void TransferJournal::flush()
+{
+    collectPending();
+    if (m_pending.isEmpty() || !m_writer) {
+        m_pending.clear();
+        return;
+    }
+
+    // Written and synced by a disk writer thread, the main thread never
+    // waits for the disk
+    QMutexLocker locker(&m_writer->mutex);
+    m_writer->pending += m_pending;
+    m_pending.clear();
+    if (!m_writer->writing) {
+        m_writer->writing = true;
+        PageCacheIo::diskWriterPool()->start(new JournalWriteTask(m_writer));
+    }
+}
+
+void TransferJournal::collectPending()
+{
+    m_flushTimer->stop();
+
+    const QString now = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+    QHash<QString, qulonglong>::const_iterator it = m_pendingOffsets.constBegin();
+    for (; it != m_pendingOffsets.constEnd(); ++it) {
+        m_entries[it.key()].offset = it.value();
+        QJsonObject record;
+        record.insert(QLatin1String("op"), QLatin1String("offset"));
+        record.insert(QLatin1String("key"), it.key());
+        record.insert(QLatin1String("offset"), double(it.value()));
+        record.insert(QLatin1String("time"), now);
+        m_pending += toLine(record);
+    }
+    m_pendingOffsets.clear();
+}
+
+void TransferJournal::load()
+{
+    QFile file(m_fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return;
+    }
+
+    while (!file.atEnd()) {
+        const QJsonObject record = QJsonDocument::fromJson(file.readLine()).object();
+        const QString op = record.value(QLatin1String("op")).toString();
+        const QString key = record.value(QLatin1String("key")).toString();
+        if (key.isEmpty()) {
+            continue;
+        }
+
+        if (op == QLatin1String("begin")) {
+            Entry entry;
+            entry.key = key;
+            entry.contact = record.value(QLatin1String("contact")).toString();
+            entry.fileName = record.value(QLatin1String("fileName")).toString();
+            entry.url = QUrl(record.value(QLatin1String("url")).toString());
+            entry.partFileName = record.value(QLatin1String("part")).toString();
+            entry.size = record.value(QLatin1String("size")).toDouble();
+            entry.offset = record.value(QLatin1String("offset")).toDouble();
+            entry.contentHashType = record.value(QLatin1String("hashType")).toDouble();
+            entry.contentHash = record.value(QLatin1String("hash")).toString();
+            entry.updated = QDateTime::fromString(record.value(QLatin1String("time")).toString(), Qt::ISODate);
+            m_entries.insert(key, entry);
+        } else if (op == QLatin1String("offset") && m_entries.contains(key)) {
+            Entry &entry = m_entries[key];
+            entry.offset = record.value(QLatin1String("offset")).toDouble();
+            entry.updated = QDateTime::fromString(record.value(QLatin1String("time")).toString(), Qt::ISODate);
+        } else if (op == QLatin1String("end")) {
+            m_entries.remove(key);
+        }
+    }
+    file.close();
+
+    // Rewrite the journal with the live entries only
+    const QDateTime oldest = QDateTime::currentDateTimeUtc().addDays(-MaxEntryAge);
+    QSaveFile compacted(m_fileName);
+    if (!compacted.open(QIODevice::WriteOnly)) {
+        qCWarning(KTP_FTH_MODULE) << "Unable to compact the transfer journal -" << compacted.errorString();
+        return;
+    }
+    QHash<QString, Entry>::iterator it = m_entries.begin();
+    while (it != m_entries.end()) {
+        if (!it->updated.isValid() || it->updated < oldest || !QFileInfo::exists(it->partFileName)) {
+            it = m_entries.erase(it);
+            continue;
+        }
+        compacted.write(toLine(toJson(*it)));
+        ++it;
+    }
+    compacted.commit();
+
+    qCDebug(KTP_FTH_MODULE) << "Transfer journal loaded," << m_entries.size() << "interrupted transfers";
+}
+
+#include "moc_transfer-journal.cpp"
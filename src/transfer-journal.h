@@ -0,0 +1,104 @@
+/*
+* Copyright (C) 2026 The KDE Telepathy Team
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this library; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef TRANSFER_JOURNAL_H
+#define TRANSFER_JOURNAL_H
+
+#include <QObject>
+#include <QDateTime>
+#include <QHash>
+#include <QSharedPointer>
+#include <QString>
+#include <QUrl>
+
+#include <TelepathyQt/Types>
+
+class QTimer;
+class JournalWriter;
+
+/**
+ * Append only journal of the incoming transfers in progress, saved in the
+ * application data directory, so that transfers interrupted by a crash of
+ * the handler or by a lost connection can be resumed without asking the
+ * user when the same file is offered again.
+ *
+ * Changes are kept in memory and appended to the journal in batches, at most
+ * once every few seconds, with a single flush to disk done by a disk writer
+ * thread (see PageCacheIo::diskWriterPool()). The journal is
+ * compacted when it is loaded; entries not updated for a week are dropped.
+ *
+ * Must be used from the main thread only.
+ */
+class TransferJournal : public QObject
+{
+    Q_OBJECT
+    Q_DISABLE_COPY(TransferJournal)
+
+public:
+    struct Entry
+    {
+        /** Identity of the remote file, see key() */
+        QString key;
+        QString contact;
+        QString fileName;
+        QUrl url;
+        QString partFileName;
+        qulonglong size;
+        qulonglong offset;
+        uint contentHashType;
+        QString contentHash;
+        QDateTime updated;
+    };
+
+    static TransferJournal *instance();
+
+    /** Identifies the remote file offered on \p channel */
+    static QString key(const Tp::IncomingFileTransferChannelPtr &channel);
+
+    bool find(const QString &key, Entry *entry) const;
+
+    void begin(const Entry &entry);
+    /** Cheap, can be called for every chunk received */
+    void updateOffset(const QString &key, qulonglong offset);
+    /** The transfer was completed or abandoned */
+    void end(const QString &key);
+
+public Q_SLOTS:
+    /** Appends the pending changes to the journal */
+    void flush();
+
+private:
+    explicit TransferJournal(QObject *parent = 0);
+    virtual ~TransferJournal();
+
+    void load();
+    void append(const QByteArray &record);
+    void scheduleFlush();
+    /** Moves the pending offsets to the pending records */
+    void collectPending();
+
+    QString m_fileName;
+    QSharedPointer<JournalWriter> m_writer;
+    QHash<QString, Entry> m_entries;
+    // Records waiting to be appended, and keys whose offset changed
+    QByteArray m_pending;
+    QHash<QString, qulonglong> m_pendingOffsets;
+    QTimer *m_flushTimer;
+};
+
+#endif // TRANSFER_JOURNAL_H
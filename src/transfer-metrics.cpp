@@ -0,0 +1,390 @@
+/*
+* Copyright (C) 2026 The KDE Telepathy Team
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this library; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "transfer-metrics.h"
+#include "buffer-pool.h"
+#include "ktp-fth-debug.h"
+
+#include <QCoreApplication>
+#include <QDBusConnection>
+#include <QMutexLocker>
+
+#include <time.h>
+
+// A transfer is considered stalled if no data moved for this long, in ms
+static const qint64 StallThreshold = 2000;
+
+// Number of finished transfers kept in the history
+static const int MaxHistory = 100;
+
+// Upper bounds of the disk write latency buckets, in microseconds. The last
+// bucket collects everything slower.
+static const qint64 LatencyBuckets[] = { 100, 1000, 10000, 100000, 1000000 };
+static const int LatencyBucketCount = sizeof(LatencyBuckets) / sizeof(LatencyBuckets[0]) + 1;
+
+// CPU time used by the whole process so far, in microseconds
+static qint64 processCpuTime()
+{
+    struct timespec ts;
+    if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts) < 0) {
+        return 0;
+    }
+    return qint64(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+struct TransferMetrics::Record
+{
+    int id;
+    Direction direction;
+    QString fileName;
+    QString contact;
+    qulonglong size;
+    qint64 handledAt;
+    qint64 firstByteAt;
+    qint64 lastProgressAt;
+    qint64 finishedAt;
+    qint64 cpuAtFirstByte;
+    qint64 cpuAtFinish;
+    qulonglong firstAmount;
+    qulonglong bytes;
+    unsigned long speed;
+    qint64 eta;
+    int stalls;
+    QString ioMode;
+    qlonglong latencies[LatencyBucketCount];
+    int error;
+    QString errorString;
+};
+
+TransferMetrics *TransferMetrics::instance()
+{
+    static TransferMetrics *metrics = 0;
+    if (!metrics) {
+        metrics = new TransferMetrics(qApp);
+    }
+    return metrics;
+}
+
+TransferMetrics::TransferMetrics(QObject *parent)
+    : QObject(parent),
+      m_nextId(1),
+      m_startupSinceExec(-1),
+      m_startupSinceMain(-1),
+      m_uiLoad(-1)
+{
+    m_clock.start();
+}
+
+TransferMetrics::~TransferMetrics()
+{
+    qDeleteAll(m_active);
+    qDeleteAll(m_history);
+}
+
+bool TransferMetrics::registerObject()
+{
+    if (!QDBusConnection::sessionBus().registerObject(QLatin1String("/org/kde/KTp/FileTransferHandler/Metrics"),
+                                                      this,
+                                                      QDBusConnection::ExportScriptableSlots)) {
+        qCWarning(KTP_FTH_MODULE) << "Unable to export transfer metrics on the session bus";
+        return false;
+    }
+    return true;
+}
+
+int TransferMetrics::addTransfer(KJob *job, Direction direction, const QString &fileName,
+                                 const QString &contact, qulonglong size)
+{
+    Record *record = new Record;
+    record->direction = direction;
+    record->fileName = fileName;
+    record->contact = contact;
+    record->size = size;
+    record->handledAt = m_clock.elapsed();
+    record->firstByteAt = -1;
+    record->lastProgressAt = -1;
+    record->finishedAt = -1;
+    record->cpuAtFirstByte = 0;
+    record->cpuAtFinish = 0;
+    record->firstAmount = 0;
+    record->bytes = 0;
+    record->speed = 0;
+    record->eta = -1;
+    record->stalls = 0;
+    record->ioMode = QLatin1String("buffered");
+    for (int i = 0; i < LatencyBucketCount; ++i) {
+        record->latencies[i] = 0;
+    }
+    record->error = 0;
+
+    {
+        QMutexLocker locker(&m_mutex);
+        record->id = m_nextId++;
+        m_active.insert(record->id, record);
+        m_jobs.insert(job, record->id);
+    }
+
+    connect(job,
+            SIGNAL(processedAmount(KJob*,KJob::Unit,qulonglong)),
+            SLOT(onProcessedAmount(KJob*,KJob::Unit,qulonglong)));
+    connect(job,
+            SIGNAL(speed(KJob*,ulong)),
+            SLOT(onSpeed(KJob*,ulong)));
+    connect(job,
+            SIGNAL(result(KJob*)),
+            SLOT(onResult(KJob*)));
+
+    return record->id;
+}
+
+int TransferMetrics::transferId(KJob *job) const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_jobs.value(job, -1);
+}
+
+void TransferMetrics::recordFirstByte(int id)
+{
+    QMutexLocker locker(&m_mutex);
+    Record *record = m_active.value(id);
+    if (record && record->firstByteAt < 0) {
+        record->firstByteAt = m_clock.elapsed();
+        record->lastProgressAt = record->firstByteAt;
+        record->cpuAtFirstByte = processCpuTime();
+        qCDebug(KTP_FTH_MODULE) << "First byte of" << record->fileName << "after"
+                                << record->firstByteAt - record->handledAt << "ms";
+    }
+}
+
+void TransferMetrics::recordDiskWrite(int id, qint64 nsecs)
+{
+    const qint64 usecs = nsecs / 1000;
+    int bucket = 0;
+    while (bucket < LatencyBucketCount - 1 && usecs >= LatencyBuckets[bucket]) {
+        ++bucket;
+    }
+
+    QMutexLocker locker(&m_mutex);
+    Record *record = m_active.value(id);
+    if (record) {
+        record->latencies[bucket]++;
+    }
+}
+
+void TransferMetrics::setIoMode(int id, const QString &mode)
+{
+    QMutexLocker locker(&m_mutex);
+    Record *record = m_active.value(id);
+    if (record) {
+        record->ioMode = mode;
+    }
+}
+
+void TransferMetrics::onProcessedAmount(KJob *job, KJob::Unit unit, qulonglong amount)
+{
+    if (unit != KJob::Bytes) {
+        return;
+    }
+
+    QMutexLocker locker(&m_mutex);
+    Record *record = m_active.value(m_jobs.value(job, -1));
+    if (!record) {
+        return;
+    }
+
+    if (record->firstByteAt < 0) {
+        // Initial offset, no data moved yet
+        record->firstAmount = amount;
+    } else if (amount > record->bytes) {
+        const qint64 now = m_clock.elapsed();
+        if (record->lastProgressAt >= 0 && now - record->lastProgressAt > StallThreshold) {
+            record->stalls++;
+        }
+        record->lastProgressAt = now;
+    }
+    record->bytes = amount;
+}
+
+void TransferMetrics::onSpeed(KJob *job, unsigned long speed)
+{
+    // Published by KTp::TelepathyBaseJob
+    const QVariant eta = job->property("eta");
+
+    QMutexLocker locker(&m_mutex);
+    Record *record = m_active.value(m_jobs.value(job, -1));
+    if (record) {
+        record->speed = speed;
+        record->eta = eta.isValid() ? eta.toLongLong() : -1;
+    }
+}
+
+void TransferMetrics::onResult(KJob *job)
+{
+    QMutexLocker locker(&m_mutex);
+    const int id = m_jobs.take(job);
+    Record *record = m_active.take(id);
+    if (!record) {
+        return;
+    }
+
+    record->finishedAt = m_clock.elapsed();
+    record->cpuAtFinish = processCpuTime();
+    // A stall is otherwise counted when the data moves again
+    if (record->lastProgressAt >= 0 && record->finishedAt - record->lastProgressAt > StallThreshold) {
+        record->stalls++;
+    }
+    record->error = job->error();
+    record->errorString = job->errorString();
+
+    m_history.append(record);
+    while (m_history.size() > MaxHistory) {
+        delete m_history.takeFirst();
+    }
+}
+
+QVariantMap TransferMetrics::toVariantMap(const Record *record) const
+{
+    const qint64 now = record->finishedAt >= 0 ? record->finishedAt : m_clock.elapsed();
+
+    QVariantMap map;
+    map.insert(QLatin1String("id"), record->id);
+    map.insert(QLatin1String("direction"), record->direction == Incoming ? QLatin1String("incoming") : QLatin1String("outgoing"));
+    map.insert(QLatin1String("fileName"), record->fileName);
+    map.insert(QLatin1String("contact"), record->contact);
+    map.insert(QLatin1String("size"), record->size);
+    map.insert(QLatin1String("bytes"), record->bytes);
+    map.insert(QLatin1String("speed"), qulonglong(record->speed));
+    // No estimate while nothing moves
+    if (record->finishedAt < 0 && record->eta >= 0) {
+        map.insert(QLatin1String("eta"), record->eta);
+    }
+    map.insert(QLatin1String("timeToFirstByte"), record->firstByteAt >= 0 ? record->firstByteAt - record->handledAt : qint64(-1));
+    map.insert(QLatin1String("duration"), now - record->handledAt);
+    if (record->firstByteAt >= 0 && now > record->firstByteAt) {
+        map.insert(QLatin1String("averageSpeed"),
+                   qulonglong((record->bytes - record->firstAmount) * 1000.0 / (now - record->firstByteAt)));
+    }
+    map.insert(QLatin1String("stalls"), record->stalls);
+    map.insert(QLatin1String("ioMode"), record->ioMode);
+
+    // The CPU time is the one of the whole process while the data was
+    // moving, so it is only meaningful when a single transfer is running.
+    if (record->firstByteAt >= 0) {
+        const qint64 cpu = (record->finishedAt >= 0 ? record->cpuAtFinish : processCpuTime())
+                         - record->cpuAtFirstByte;
+        const qulonglong bytes = record->bytes - record->firstAmount;
+        map.insert(QLatin1String("cpuTime"), cpu);
+        if (bytes > 0) {
+            map.insert(QLatin1String("cpuTimePerGigabyte"),
+                       qint64(cpu * (1024.0 * 1024.0 * 1024.0) / bytes));
+        }
+    }
+
+    QVariantList latencies;
+    for (int i = 0; i < LatencyBucketCount; ++i) {
+        latencies << record->latencies[i];
+    }
+    map.insert(QLatin1String("diskWriteLatency"), latencies);
+
+    map.insert(QLatin1String("finished"), record->finishedAt >= 0);
+    if (record->error) {
+        map.insert(QLatin1String("error"), record->error);
+        map.insert(QLatin1String("errorString"), record->errorString);
+    }
+    return map;
+}
+
+QVariantList TransferMetrics::activeTransfers() const
+{
+    QMutexLocker locker(&m_mutex);
+    QVariantList transfers;
+    Q_FOREACH (const Record *record, m_active) {
+        transfers << toVariantMap(record);
+    }
+    return transfers;
+}
+
+QVariantList TransferMetrics::finishedTransfers() const
+{
+    QMutexLocker locker(&m_mutex);
+    QVariantList transfers;
+    Q_FOREACH (const Record *record, m_history) {
+        transfers << toVariantMap(record);
+    }
+    return transfers;
+}
+
+QVariantMap TransferMetrics::transfer(int id) const
+{
+    QMutexLocker locker(&m_mutex);
+    if (const Record *record = m_active.value(id)) {
+        return toVariantMap(record);
+    }
+    Q_FOREACH (const Record *record, m_history) {
+        if (record->id == id) {
+            return toVariantMap(record);
+        }
+    }
+    return QVariantMap();
+}
+
+QVariantList TransferMetrics::diskWriteLatencyBuckets() const
+{
+    QVariantList buckets;
+    for (int i = 0; i < LatencyBucketCount - 1; ++i) {
+        buckets << LatencyBuckets[i];
+    }
+    return buckets;
+}
+
+void TransferMetrics::clearHistory()
+{
+    QMutexLocker locker(&m_mutex);
+    qDeleteAll(m_history);
+    m_history.clear();
+}
+
+void TransferMetrics::recordStartup(qint64 sinceExec, qint64 sinceMain)
+{
+    QMutexLocker locker(&m_mutex);
+    m_startupSinceExec = sinceExec;
+    m_startupSinceMain = sinceMain;
+}
+
+void TransferMetrics::recordUiLoad(qint64 msecs)
+{
+    QMutexLocker locker(&m_mutex);
+    m_uiLoad = msecs;
+}
+
+QVariantMap TransferMetrics::startupTimes() const
+{
+    QMutexLocker locker(&m_mutex);
+    QVariantMap times;
+    times.insert(QLatin1String("sinceExec"), m_startupSinceExec);
+    times.insert(QLatin1String("sinceMain"), m_startupSinceMain);
+    times.insert(QLatin1String("uiLoad"), m_uiLoad);
+    return times;
+}
+
+QVariantMap TransferMetrics::bufferPool() const
+{
+    return BufferPool::instance()->statistics();
+}
+
+#include "moc_transfer-metrics.cpp"
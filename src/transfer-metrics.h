@@ -0,0 +1,117 @@
+/*
+* Copyright (C) 2026 The KDE Telepathy Team
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this library; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef TRANSFER_METRICS_H
+#define TRANSFER_METRICS_H
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QVariantList>
+#include <QVariantMap>
+
+#include <KJob>
+
+/**
+ * Collects performance metrics of the transfers handled by this process and
+ * exports them on the session bus, on the object
+ * /org/kde/KTp/FileTransferHandler/Metrics.
+ *
+ * Transfers are added when the channel is handled. Progress and results are
+ * tracked through the signals of the job; the data paths report the first
+ * byte and the disk write latencies directly. recordFirstByte() and
+ * recordDiskWrite() can be called from any thread.
+ *
+ * Times are in milliseconds, except cpuTime and cpuTimePerGigabyte which are
+ * in microseconds.
+ */
+class TransferMetrics : public QObject
+{
+    Q_OBJECT
+    Q_CLASSINFO("D-Bus Interface", "org.kde.KTp.FileTransferHandler.Metrics")
+    Q_DISABLE_COPY(TransferMetrics)
+
+public:
+    enum Direction {
+        Incoming,
+        Outgoing
+    };
+
+    static TransferMetrics *instance();
+
+    /** Exports the metrics on the session bus */
+    bool registerObject();
+
+    /** Returns the id of the new transfer */
+    int addTransfer(KJob *job, Direction direction, const QString &fileName,
+                    const QString &contact, qulonglong size);
+    /** Returns the id of the transfer handled by \p job, or -1 */
+    int transferId(KJob *job) const;
+
+    void recordFirstByte(int id);
+    void recordDiskWrite(int id, qint64 nsecs);
+    /** How the file uses the page cache, see PageCacheIo::modeName() */
+    void setIoMode(int id, const QString &mode);
+
+    /**
+     * Time from the exec of the process and from the start of main() to the
+     * registration of the handler on the bus
+     */
+    void recordStartup(qint64 sinceExec, qint64 sinceMain);
+    /** Time spent loading the user interface plugin */
+    void recordUiLoad(qint64 msecs);
+
+public Q_SLOTS:
+    Q_SCRIPTABLE QVariantList activeTransfers() const;
+    Q_SCRIPTABLE QVariantList finishedTransfers() const;
+    Q_SCRIPTABLE QVariantMap transfer(int id) const;
+    /** Upper bounds of the disk write latency histogram buckets, in microseconds */
+    Q_SCRIPTABLE QVariantList diskWriteLatencyBuckets() const;
+    Q_SCRIPTABLE void clearHistory();
+    /** sinceExec, sinceMain and uiLoad, -1 if not known (yet) */
+    Q_SCRIPTABLE QVariantMap startupTimes() const;
+    /** Usage of the shared transfer buffers, see BufferPool::statistics() */
+    Q_SCRIPTABLE QVariantMap bufferPool() const;
+
+private Q_SLOTS:
+    void onProcessedAmount(KJob *job, KJob::Unit unit, qulonglong amount);
+    void onSpeed(KJob *job, unsigned long speed);
+    void onResult(KJob *job);
+
+private:
+    struct Record;
+
+    explicit TransferMetrics(QObject *parent = 0);
+    virtual ~TransferMetrics();
+
+    QVariantMap toVariantMap(const Record *record) const;
+
+    mutable QMutex m_mutex;
+    QElapsedTimer m_clock;
+    int m_nextId;
+    QHash<KJob*, int> m_jobs;
+    QHash<int, Record*> m_active;
+    QList<Record*> m_history;
+    qint64 m_startupSinceExec;
+    qint64 m_startupSinceMain;
+    qint64 m_uiLoad;
+};
+
+#endif // TRANSFER_METRICS_H
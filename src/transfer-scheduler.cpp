@@ -0,0 +1,167 @@
+/*
+* Copyright (C) 2026 The KDE Telepathy Team
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this library; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "transfer-scheduler.h"
+#include "ktp-fth-debug.h"
+
+#include <KJob>
+
+#include <algorithm>
+
+TransferScheduler::TransferScheduler(QObject *parent)
+    : QObject(parent),
+      m_maxActiveTransfers(0),
+      m_sequence(0)
+{
+}
+
+TransferScheduler::~TransferScheduler()
+{
+}
+
+int TransferScheduler::maxActiveTransfers() const
+{
+    return m_maxActiveTransfers;
+}
+
+void TransferScheduler::setMaxActiveTransfers(int max)
+{
+    if (m_maxActiveTransfers == max) {
+        return;
+    }
+
+    m_maxActiveTransfers = qMax(0, max);
+    Q_FOREACH (const QString &account, m_accounts.keys()) {
+        startJobs(account);
+    }
+}
+
+void TransferScheduler::enqueue(KJob *job, const QString &account, qulonglong size, Priority priority)
+{
+    Entry entry;
+    entry.job = job;
+    // Files of unknown size, UINT64_MAX, are started after all the known ones
+    entry.size = size;
+    entry.priority = priority;
+    entry.sequence = m_sequence++;
+
+    AccountQueue &queue = m_accounts[account];
+    queue.pending.insert(std::upper_bound(queue.pending.begin(), queue.pending.end(), entry, lessThan), entry);
+    m_jobAccounts.insert(job, account);
+
+    // finished() is emitted also when the job is killed quietly, i.e. when
+    // the channel is cancelled while the job is still queued.
+    connect(job, SIGNAL(finished(KJob*)), SLOT(onJobFinished(KJob*)));
+
+    startJobs(account);
+}
+
+void TransferScheduler::releaseSlot(KJob *job)
+{
+    if (!m_running.remove(job)) {
+        return;
+    }
+
+    qCDebug(KTP_FTH_MODULE) << "Transfer waiting, its slot is released";
+    const QString account = m_jobAccounts.value(job);
+    m_waiting.insert(job);
+    m_accounts[account].active--;
+    startJobs(account);
+}
+
+void TransferScheduler::requestSlot(KJob *job)
+{
+    if (!m_waiting.contains(job)) {
+        // It never released its slot
+        Q_EMIT slotGranted(job);
+        return;
+    }
+
+    const QString account = m_jobAccounts.value(job);
+    AccountQueue &queue = m_accounts[account];
+    if (!queue.resuming.contains(job)) {
+        queue.resuming.append(job);
+    }
+    startJobs(account);
+}
+
+void TransferScheduler::onJobFinished(KJob *job)
+{
+    if (!m_jobAccounts.contains(job)) {
+        return;
+    }
+
+    const QString account = m_jobAccounts.take(job);
+    AccountQueue &queue = m_accounts[account];
+
+    if (m_running.remove(job)) {
+        queue.active--;
+    } else if (m_waiting.remove(job)) {
+        queue.resuming.removeAll(job);
+    } else {
+        for (int i = 0; i < queue.pending.size(); ++i) {
+            if (queue.pending.at(i).job == job) {
+                queue.pending.removeAt(i);
+                break;
+            }
+        }
+    }
+
+    startJobs(account);
+}
+
+void TransferScheduler::startJobs(const QString &account)
+{
+    AccountQueue &queue = m_accounts[account];
+
+    while (!queue.resuming.isEmpty()
+            && (m_maxActiveTransfers <= 0 || queue.active < m_maxActiveTransfers)) {
+        KJob *job = queue.resuming.takeFirst();
+        m_waiting.remove(job);
+        queue.active++;
+        m_running.insert(job);
+        Q_EMIT slotGranted(job);
+    }
+
+    while (!queue.pending.isEmpty()
+            && (m_maxActiveTransfers <= 0 || queue.active < m_maxActiveTransfers)) {
+        const Entry entry = queue.pending.takeFirst();
+        queue.active++;
+        m_running.insert(entry.job);
+        entry.job->start();
+    }
+
+    if (!queue.pending.isEmpty()) {
+        qCDebug(KTP_FTH_MODULE) << queue.pending.size() << "transfers queued for" << account;
+    } else if (queue.active == 0 && queue.resuming.isEmpty()) {
+        m_accounts.remove(account);
+    }
+}
+
+bool TransferScheduler::lessThan(const Entry &left, const Entry &right)
+{
+    if (left.priority != right.priority) {
+        return left.priority < right.priority;
+    }
+    if (left.size != right.size) {
+        return left.size < right.size;
+    }
+    return left.sequence < right.sequence;
+}
+
+#include "moc_transfer-scheduler.cpp"
@@ -0,0 +1,110 @@
+/*
+* Copyright (C) 2026 The KDE Telepathy Team
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this library; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef TRANSFER_SCHEDULER_H
+#define TRANSFER_SCHEDULER_H
+
+#include <QObject>
+#include <QHash>
+#include <QList>
+#include <QSet>
+#include <QString>
+
+class KJob;
+
+/**
+ * Decides when the jobs handling the file transfer channels are started.
+ *
+ * At most maxActiveTransfers() jobs are running for each account, the other
+ * ones wait in a queue without being started, so their channels are left
+ * untouched until their turn comes. Queued jobs are started by priority
+ * class first, and then shortest file first. Jobs of the same class whose
+ * size is the same are started in arrival order.
+ *
+ * A running job waiting for the user or for disk space gives its slot back
+ * with releaseSlot(), and asks for one again with requestSlot() before it
+ * moves any data. slotGranted() tells when it can continue; such jobs are
+ * served before the ones that were not started yet.
+ */
+class TransferScheduler : public QObject
+{
+    Q_OBJECT
+    Q_DISABLE_COPY(TransferScheduler)
+
+public:
+    enum Priority {
+        HighPriority,
+        NormalPriority,
+        LowPriority
+    };
+
+    explicit TransferScheduler(QObject *parent = 0);
+    virtual ~TransferScheduler();
+
+    int maxActiveTransfers() const;
+    /** Maximum number of running jobs per account, 0 means no limit */
+    void setMaxActiveTransfers(int max);
+
+    /**
+     * Starts \p job now or when a slot is free for \p account. \p size is the
+     * size of the file, UINT64_MAX if unknown.
+     */
+    void enqueue(KJob *job, const QString &account, qulonglong size, Priority priority);
+
+public Q_SLOTS:
+    /** The running \p job is waiting, another job can use its slot */
+    void releaseSlot(KJob *job);
+    /** \p job needs a slot again, slotGranted() is emitted when it has one */
+    void requestSlot(KJob *job);
+
+Q_SIGNALS:
+    void slotGranted(KJob *job);
+
+private Q_SLOTS:
+    void onJobFinished(KJob *job);
+
+private:
+    struct Entry {
+        KJob *job;
+        qulonglong size;
+        Priority priority;
+        qulonglong sequence;
+    };
+
+    struct AccountQueue {
+        AccountQueue() : active(0) {}
+
+        int active;
+        QList<Entry> pending;
+        // Started jobs asking for their slot back
+        QList<KJob*> resuming;
+    };
+
+    void startJobs(const QString &account);
+    static bool lessThan(const Entry &left, const Entry &right);
+
+    int m_maxActiveTransfers;
+    qulonglong m_sequence;
+    QHash<QString, AccountQueue> m_accounts;
+    QHash<KJob*, QString> m_jobAccounts;
+    QSet<KJob*> m_running;
+    // Started jobs that released their slot
+    QSet<KJob*> m_waiting;
+};
+
+#endif // TRANSFER_SCHEDULER_H
@@ -0,0 +1,79 @@
+/*
+* Copyright (C) 2026 The KDE Telepathy Team
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this library; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "transfer-thread-pool.h"
+#include "ktp-fth-debug.h"
+
+#include <QCoreApplication>
+#include <QThread>
+
+TransferThreadPool *TransferThreadPool::instance()
+{
+    static TransferThreadPool *pool = 0;
+    if (!pool) {
+        pool = new TransferThreadPool(qApp);
+    }
+    return pool;
+}
+
+TransferThreadPool::TransferThreadPool(QObject *parent)
+    : QObject(parent),
+      m_maxThreads(qMax(1, QThread::idealThreadCount()))
+{
+    qCDebug(KTP_FTH_MODULE) << "Using up to" << m_maxThreads << "transfer threads";
+}
+
+TransferThreadPool::~TransferThreadPool()
+{
+    Q_FOREACH (QThread *thread, m_threads) {
+        thread->quit();
+    }
+    Q_FOREACH (QThread *thread, m_threads) {
+        thread->wait();
+        delete thread;
+    }
+}
+
+QThread *TransferThreadPool::acquireThread()
+{
+    QThread *thread = 0;
+    Q_FOREACH (QThread *candidate, m_threads) {
+        if (!thread || m_load.value(candidate) < m_load.value(thread)) {
+            thread = candidate;
+        }
+    }
+
+    if (!thread || (m_load.value(thread) > 0 && m_threads.size() < m_maxThreads)) {
+        thread = new QThread;
+        thread->setObjectName(QString::fromLatin1("FileTransfer%1").arg(m_threads.size()));
+        thread->start();
+        m_threads << thread;
+    }
+
+    m_load[thread]++;
+    return thread;
+}
+
+void TransferThreadPool::releaseThread(QThread *thread)
+{
+    if (m_load.contains(thread) && m_load[thread] > 0) {
+        m_load[thread]--;
+    }
+}
+
+#include "moc_transfer-thread-pool.cpp"
@@ -0,0 +1,54 @@
+/*
+* Copyright (C) 2026 The KDE Telepathy Team
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this library; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef TRANSFER_THREAD_POOL_H
+#define TRANSFER_THREAD_POOL_H
+
+#include <QObject>
+#include <QHash>
+#include <QList>
+
+class QThread;
+
+/**
+ * Shared pool of threads running the event loops that move the data of the
+ * transfers. There is at most one thread per core; objects moved to these
+ * threads must not touch the Telepathy proxies or the jobs directly.
+ */
+class TransferThreadPool : public QObject
+{
+    Q_OBJECT
+    Q_DISABLE_COPY(TransferThreadPool)
+
+public:
+    static TransferThreadPool *instance();
+
+    /** Returns the least loaded thread, starting a new one if needed */
+    QThread *acquireThread();
+    void releaseThread(QThread *thread);
+
+private:
+    explicit TransferThreadPool(QObject *parent = 0);
+    virtual ~TransferThreadPool();
+
+    int m_maxThreads;
+    QList<QThread*> m_threads;
+    QHash<QThread*, int> m_load;
+};
+
+#endif // TRANSFER_THREAD_POOL_H
@@ -0,0 +1,81 @@
+/*
+* Copyright (C) 2026 The KDE Telepathy Team
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this library; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "transfer-ui-plugin.h"
+
+#include <QFileDialog>
+
+#include <kio/jobtracker.h>
+#include <kio/renamedialog.h>
+#include <KIOFileWidgets/KFileWidget>
+#include <KIOFileWidgets/KRecentDirs>
+
+TransferUiPlugin::TransferUiPlugin(QObject *parent)
+    : QObject(parent)
+{
+}
+
+TransferUiPlugin::~TransferUiPlugin()
+{
+}
+
+QUrl TransferUiPlugin::askSaveUrl(const QString &fileName)
+{
+    QString recentDirClass;
+
+    const QUrl url = QFileDialog::getSaveFileUrl(0, QString(),
+                                                 KFileWidget::getStartUrl(QUrl(QLatin1String("kfiledialog:///FileTransferLastDirectory/") + fileName), recentDirClass));
+
+    if (!recentDirClass.isEmpty()) {
+        KRecentDirs::add(recentDirClass, url.toLocalFile());
+    }
+    return url;
+}
+
+QObject *TransferUiPlugin::showRenameDialog(const QString &title, const QUrl &dest, bool resume,
+                                            qulonglong existingSize, qulonglong incomingSize,
+                                            const QDateTime &existingCreated, const QDateTime &existingModified,
+                                            const QDateTime &incomingModified)
+{
+    KIO::RenameDialog *dialog = new KIO::RenameDialog(0,
+                                                      title,
+                                                      QUrl(), //TODO
+                                                      dest,
+                                                      resume ? KIO::RenameDialog_Resume : KIO::RenameDialog_Overwrite,
+                                                      existingSize,
+                                                      incomingSize,
+                                                      existingCreated,
+                                                      QDateTime(),
+                                                      existingModified,
+                                                      incomingModified);
+    dialog->show();
+    return dialog;
+}
+
+QUrl TransferUiPlugin::newDestUrl(QObject *dialog) const
+{
+    KIO::RenameDialog *renameDialog = qobject_cast<KIO::RenameDialog*>(dialog);
+    return renameDialog ? renameDialog->newDestUrl() : QUrl();
+}
+
+KJobTrackerInterface *TransferUiPlugin::jobTracker()
+{
+    return KIO::getJobTracker();
+}
+
+#include "moc_transfer-ui-plugin.cpp"
@@ -0,0 +1,49 @@
+/*
+* Copyright (C) 2026 The KDE Telepathy Team
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this library; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef TRANSFER_UI_PLUGIN_H
+#define TRANSFER_UI_PLUGIN_H
+
+#include "transfer-ui.h"
+
+#include <QObject>
+
+/**
+ * The widget based implementation of TransferUiInterface, built as a
+ * separate module.
+ */
+class TransferUiPlugin : public QObject, public TransferUiInterface
+{
+    Q_OBJECT
+    Q_PLUGIN_METADATA(IID "org.kde.KTp.FileTransferHandler.TransferUi/1.0")
+    Q_INTERFACES(TransferUiInterface)
+
+public:
+    explicit TransferUiPlugin(QObject *parent = 0);
+    virtual ~TransferUiPlugin();
+
+    virtual QUrl askSaveUrl(const QString &fileName);
+    virtual QObject *showRenameDialog(const QString &title, const QUrl &dest, bool resume,
+                                      qulonglong existingSize, qulonglong incomingSize,
+                                      const QDateTime &existingCreated, const QDateTime &existingModified,
+                                      const QDateTime &incomingModified);
+    virtual QUrl newDestUrl(QObject *dialog) const;
+    virtual KJobTrackerInterface *jobTracker();
+};
+
+#endif // TRANSFER_UI_PLUGIN_H
@@ -0,0 +1,52 @@
+/*
+* Copyright (C) 2026 The KDE Telepathy Team
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this library; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "transfer-ui.h"
+#include "file-transfer-config.h"
+#include "transfer-metrics.h"
+#include "ktp-fth-debug.h"
+
+#include <QElapsedTimer>
+#include <QPluginLoader>
+
+TransferUiInterface *TransferUi::instance()
+{
+    static bool loaded = false;
+    static TransferUiInterface *ui = 0;
+    if (loaded) {
+        return ui;
+    }
+    loaded = true;
+
+    if (FileTransferConfig::instance()->headless()) {
+        return 0;
+    }
+
+    QElapsedTimer loadTimer;
+    loadTimer.start();
+    QPluginLoader loader(QLatin1String("ktp-filetransfer-handler/ktp_filetransfer_handler_ui"));
+    ui = qobject_cast<TransferUiInterface*>(loader.instance());
+    if (!ui) {
+        qCWarning(KTP_FTH_MODULE) << "Unable to load the user interface, running headless -" << loader.errorString();
+        return 0;
+    }
+
+    qCDebug(KTP_FTH_MODULE) << "User interface loaded in" << loadTimer.elapsed() << "ms";
+    TransferMetrics::instance()->recordUiLoad(loadTimer.elapsed());
+    return ui;
+}
@@ -0,0 +1,69 @@
+/*
+* Copyright (C) 2026 The KDE Telepathy Team
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this library; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef TRANSFER_UI_H
+#define TRANSFER_UI_H
+
+#include <QtPlugin>
+#include <QDateTime>
+#include <QString>
+#include <QUrl>
+
+class KJobTrackerInterface;
+
+/**
+ * Dialogs and job tracker of the handler. They live in a plugin, so that
+ * the widget libraries are only loaded when something has to be shown and
+ * not when the handler is activated.
+ */
+class TransferUiInterface
+{
+public:
+    virtual ~TransferUiInterface() {}
+
+    /** Asks the user where \p fileName should be saved */
+    virtual QUrl askSaveUrl(const QString &fileName) = 0;
+
+    /**
+     * Shows a non modal KIO::RenameDialog for \p dest, offering to resume if
+     * \p resume is true, to overwrite otherwise. The dialog emits
+     * finished(int) with a KIO::RenameDialog_Result; the caller deletes it.
+     */
+    virtual QObject *showRenameDialog(const QString &title, const QUrl &dest, bool resume,
+                                      qulonglong existingSize, qulonglong incomingSize,
+                                      const QDateTime &existingCreated, const QDateTime &existingModified,
+                                      const QDateTime &incomingModified) = 0;
+    /** The URL chosen in a dialog returned by showRenameDialog() */
+    virtual QUrl newDestUrl(QObject *dialog) const = 0;
+
+    virtual KJobTrackerInterface *jobTracker() = 0;
+};
+
+Q_DECLARE_INTERFACE(TransferUiInterface, "org.kde.KTp.FileTransferHandler.TransferUi/1.0")
+
+namespace TransferUi
+{
+    /**
+     * Loads the plugin the first time it is called. Returns 0 when running
+     * headless or if the plugin cannot be loaded; the conflicts are then
+     * solved with the configured policies.
+     */
+    TransferUiInterface *instance();
+}
+
+#endif // TRANSFER_UI_H
@@ -0,0 +1,411 @@
+/*
+* Copyright (C) 2026 The KDE Telepathy Team
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this library; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "write-behind-file.h"
+#include "buffer-pool.h"
+#include "chunk-manifest.h"
+#include "transfer-metrics.h"
+#include "ktp-fth-debug.h"
+
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QQueue>
+#include <QRunnable>
+#include <QThreadPool>
+
+#include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Amount of queued data over which the queue is full, until it is back under
+// half of it
+static const qint64 MaxPendingBytes = 8 * 1024 * 1024;
+
+// Chunks written by a task before leaving the thread to the other files
+static const int MaxChunksPerTask = 64;
+
+// Consecutive writes share the buffer of the last chunk of the queue
+struct WriteBehindChunk
+{
+    char *data;
+    qint64 size;
+    qint64 position;
+};
+
+class WriteBehindQueue
+{
+public:
+    explicit WriteBehindQueue(int fd)
+        : fd(fd),
+          metricsId(-1),
+          pendingBytes(0),
+          draining(false),
+          full(false),
+          device(0),
+          hash(0),
+          hashedBytes(0),
+          hashBroken(false),
+          directWriter(0),
+          dropper(0)
+    {
+    }
+
+    ~WriteBehindQueue()
+    {
+        delete hash;
+        delete directWriter;
+        delete dropper;
+        Q_FOREACH (const WriteBehindChunk &chunk, chunks) {
+            BufferPool::instance()->release(chunk.data);
+        }
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+
+    QMutex mutex;
+    QQueue<WriteBehindChunk> chunks;
+    int fd;
+    int metricsId;
+    qint64 pendingBytes;
+    // A task for this queue is running or scheduled
+    bool draining;
+    // Over MaxPendingBytes, until the queue is short again
+    bool full;
+    QString error;
+    // Device notified about errors and about the queue being empty, cleared
+    // when the device is deleted
+    QObject *device;
+    // Only used by the running task, or by the device when the queue is
+    // drained
+    QCryptographicHash *hash;
+    qint64 hashedBytes;
+    bool hashBroken;
+    QSharedPointer<ChunkManifest> manifest;
+    // At most one of them, only used by the running task
+    DirectWriter *directWriter;
+    WriteBackDropper *dropper;
+
+    void hashUpTo(qint64 position);
+    void hashChunk(const WriteBehindChunk &chunk);
+};
+
+// Feeds the hash with the content of the file up to position
+void WriteBehindQueue::hashUpTo(qint64 position)
+{
+    char *buffer = BufferPool::instance()->acquire();
+    while (hashedBytes < position) {
+        const ssize_t count = ::pread(fd, buffer, qMin<qint64>(BufferPool::BufferSize, position - hashedBytes), hashedBytes);
+        if (count <= 0) {
+            if (count < 0 && errno == EINTR) {
+                continue;
+            }
+            hashBroken = true;
+            break;
+        }
+        hash->addData(buffer, count);
+        hashedBytes += count;
+    }
+    BufferPool::instance()->release(buffer);
+}
+
+void WriteBehindQueue::hashChunk(const WriteBehindChunk &chunk)
+{
+    if (!hash || hashBroken) {
+        return;
+    }
+
+    if (chunk.position < hashedBytes) {
+        // Data rewritten, the hash cannot be computed inline anymore
+        qCWarning(KTP_FTH_MODULE) << "Non sequential write at" << chunk.position << "cannot hash the file";
+        hashBroken = true;
+        return;
+    }
+    if (chunk.position > hashedBytes) {
+        hashUpTo(chunk.position);
+    }
+    hash->addData(chunk.data, chunk.size);
+    hashedBytes += chunk.size;
+}
+
+class WriteBehindTask : public QRunnable
+{
+public:
+    explicit WriteBehindTask(const QSharedPointer<WriteBehindQueue> &queue)
+        : m_queue(queue)
+    {
+    }
+
+    virtual void run();
+
+private:
+    QSharedPointer<WriteBehindQueue> m_queue;
+};
+
+void WriteBehindTask::run()
+{
+    for (int i = 0; i < MaxChunksPerTask; ++i) {
+        WriteBehindChunk chunk;
+        {
+            QMutexLocker locker(&m_queue->mutex);
+            if (m_queue->chunks.isEmpty()) {
+                m_queue->draining = false;
+                if (m_queue->device) {
+                    QMetaObject::invokeMethod(m_queue->device, "onDrained", Qt::QueuedConnection);
+                }
+                return;
+            }
+            chunk = m_queue->chunks.dequeue();
+        }
+
+        // Only one task runs for a queue at a time, in order
+        m_queue->hashChunk(chunk);
+
+        QElapsedTimer writeTimer;
+        writeTimer.start();
+        QString error;
+        if (m_queue->directWriter) {
+            bool last;
+            {
+                QMutexLocker locker(&m_queue->mutex);
+                last = m_queue->chunks.isEmpty();
+            }
+            // The unaligned tail must reach the file before the queue is
+            // reported as drained
+            if (m_queue->directWriter->write(chunk.data, chunk.size, chunk.position, &error)
+                    && last) {
+                m_queue->directWriter->flushTail(&error);
+            }
+        } else {
+            PageCacheIo::writeFully(m_queue->fd, chunk.data, chunk.size, chunk.position, &error);
+        }
+        TransferMetrics::instance()->recordDiskWrite(m_queue->metricsId, writeTimer.nsecsElapsed());
+        if (error.isEmpty() && m_queue->manifest) {
+            m_queue->manifest->addData(chunk.position, chunk.data, chunk.size);
+        }
+        if (error.isEmpty() && m_queue->dropper) {
+            // After the manifest, which may sync the file
+            m_queue->dropper->dataWritten(chunk.position, chunk.size);
+        }
+        BufferPool::instance()->release(chunk.data);
+
+        QMutexLocker locker(&m_queue->mutex);
+        m_queue->pendingBytes -= chunk.size;
+        if (!error.isEmpty()) {
+            // Drop everything else, the transfer is going to be cancelled
+            m_queue->error = error;
+            Q_FOREACH (const WriteBehindChunk &pending, m_queue->chunks) {
+                BufferPool::instance()->release(pending.data);
+            }
+            m_queue->chunks.clear();
+            m_queue->pendingBytes = 0;
+            m_queue->draining = false;
+            m_queue->full = false;
+            if (m_queue->device) {
+                QMetaObject::invokeMethod(m_queue->device, "onWriteFailed", Qt::QueuedConnection,
+                                          Q_ARG(QString, error));
+            }
+            return;
+        }
+        if (m_queue->full && m_queue->pendingBytes <= MaxPendingBytes / 2) {
+            m_queue->full = false;
+            if (m_queue->device) {
+                QMetaObject::invokeMethod(m_queue->device, "onSpaceAvailable", Qt::QueuedConnection);
+            }
+        }
+    }
+
+    // Continue later, after the other files had their turn
+    PageCacheIo::diskWriterPool()->start(new WriteBehindTask(m_queue));
+}
+
+WriteBehindFile::WriteBehindFile(int fd, QObject *parent)
+    : QIODevice(parent),
+      m_queue(new WriteBehindQueue(::dup(fd)))
+{
+    m_queue->device = this;
+}
+
+WriteBehindFile::~WriteBehindFile()
+{
+    close();
+
+    QMutexLocker locker(&m_queue->mutex);
+    m_queue->device = 0;
+}
+
+void WriteBehindFile::setMetricsId(int id)
+{
+    QMutexLocker locker(&m_queue->mutex);
+    m_queue->metricsId = id;
+}
+
+void WriteBehindFile::enableHashing(QCryptographicHash::Algorithm algorithm)
+{
+    QMutexLocker locker(&m_queue->mutex);
+    delete m_queue->hash;
+    m_queue->hash = new QCryptographicHash(algorithm);
+    m_queue->hashedBytes = 0;
+    m_queue->hashBroken = false;
+}
+
+QByteArray WriteBehindFile::hashResult()
+{
+    QMutexLocker locker(&m_queue->mutex);
+    if (!m_queue->hash || m_queue->hashBroken || m_queue->pendingBytes > 0) {
+        return QByteArray();
+    }
+
+    // Nothing was written after a resumed part, or the file was truncated
+    struct stat st;
+    if (::fstat(m_queue->fd, &st) < 0) {
+        return QByteArray();
+    }
+    const qint64 size = st.st_size;
+    if (size > m_queue->hashedBytes) {
+        m_queue->hashUpTo(size);
+    } else if (size < m_queue->hashedBytes) {
+        return QByteArray();
+    }
+    return m_queue->hashBroken ? QByteArray() : m_queue->hash->result();
+}
+
+void WriteBehindFile::setChunkManifest(const QSharedPointer<ChunkManifest> &manifest)
+{
+    QMutexLocker locker(&m_queue->mutex);
+    m_queue->manifest = manifest;
+}
+
+PageCacheIo::Mode WriteBehindFile::setIoMode(PageCacheIo::Mode mode)
+{
+    QMutexLocker locker(&m_queue->mutex);
+    delete m_queue->directWriter;
+    m_queue->directWriter = 0;
+    delete m_queue->dropper;
+    m_queue->dropper = 0;
+
+    if (mode == PageCacheIo::Direct) {
+        m_queue->directWriter = new DirectWriter(m_queue->fd);
+        if (m_queue->directWriter->isValid()) {
+            return mode;
+        }
+        delete m_queue->directWriter;
+        m_queue->directWriter = 0;
+        mode = PageCacheIo::DropBehind;
+    }
+    if (mode == PageCacheIo::DropBehind) {
+        m_queue->dropper = new WriteBackDropper(m_queue->fd);
+    }
+    return mode;
+}
+
+bool WriteBehindFile::isSequential() const
+{
+    return false;
+}
+
+void WriteBehindFile::close()
+{
+    // The I/O threads keep writing what is still queued
+    QIODevice::close();
+}
+
+bool WriteBehindFile::isDrained() const
+{
+    QMutexLocker locker(&m_queue->mutex);
+    return m_queue->pendingBytes == 0;
+}
+
+bool WriteBehindFile::isFull() const
+{
+    QMutexLocker locker(&m_queue->mutex);
+    return m_queue->full;
+}
+
+qint64 WriteBehindFile::readData(char *data, qint64 maxSize)
+{
+    Q_UNUSED(data);
+    Q_UNUSED(maxSize);
+    return -1;
+}
+
+qint64 WriteBehindFile::writeData(const char *data, qint64 size)
+{
+    QMutexLocker locker(&m_queue->mutex);
+
+    if (!m_queue->error.isEmpty()) {
+        setErrorString(m_queue->error);
+        return -1;
+    }
+
+    // The chunks still queued are not used by the I/O threads yet
+    qint64 position = pos();
+    qint64 left = size;
+    while (left > 0) {
+        if (m_queue->chunks.isEmpty()
+                || m_queue->chunks.last().size == BufferPool::BufferSize
+                || m_queue->chunks.last().position + m_queue->chunks.last().size != position) {
+            WriteBehindChunk chunk;
+            chunk.data = BufferPool::instance()->acquire();
+            chunk.size = 0;
+            chunk.position = position;
+            m_queue->chunks.enqueue(chunk);
+        }
+        WriteBehindChunk &chunk = m_queue->chunks.last();
+        const qint64 count = qMin(left, BufferPool::BufferSize - chunk.size);
+        memcpy(chunk.data + chunk.size, data, count);
+        chunk.size += count;
+        data += count;
+        left -= count;
+        position += count;
+    }
+    m_queue->pendingBytes += size;
+
+    if (!m_queue->draining) {
+        m_queue->draining = true;
+        PageCacheIo::diskWriterPool()->start(new WriteBehindTask(m_queue));
+    }
+    // The data is accepted anyway, the caller might not handle short writes
+    if (m_queue->pendingBytes > MaxPendingBytes) {
+        m_queue->full = true;
+    }
+    return size;
+}
+
+void WriteBehindFile::onDrained()
+{
+    if (isDrained()) {
+        Q_EMIT drained();
+    }
+}
+
+void WriteBehindFile::onWriteFailed(const QString &errorMessage)
+{
+    setErrorString(errorMessage);
+    Q_EMIT writeFailed(errorMessage);
+}
+
+void WriteBehindFile::onSpaceAvailable()
+{
+    if (!isFull()) {
+        Q_EMIT spaceAvailable();
+    }
+}
+
+#include "moc_write-behind-file.cpp"
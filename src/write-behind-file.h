@@ -0,0 +1,117 @@
+/*
+* Copyright (C) 2026 The KDE Telepathy Team
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this library; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef WRITE_BEHIND_FILE_H
+#define WRITE_BEHIND_FILE_H
+
+#include "page-cache-io.h"
+
+#include <QIODevice>
+#include <QCryptographicHash>
+#include <QSharedPointer>
+
+class ChunkManifest;
+class WriteBehindQueue;
+
+/**
+ * Write only device that queues the data written to it and writes it to a
+ * file descriptor from a small pool of disk I/O threads, so that a slow
+ * disk does not block the thread that receives the data.
+ *
+ * Data is written in the same order it was queued, at the position the
+ * device had when it was written. write() never blocks nor writes less than
+ * asked; the writer is expected to stop while the queue is full, see
+ * isFull(), otherwise the queue grows without limits.
+ *
+ * The file descriptor is duplicated, the caller can close its own copy. Data
+ * still queued when the device is closed keeps being written, drained() is
+ * emitted once it reached the file.
+ *
+ * The content of the file can be hashed by the I/O threads while it is
+ * written, see enableHashing().
+ */
+class WriteBehindFile : public QIODevice
+{
+    Q_OBJECT
+    Q_DISABLE_COPY(WriteBehindFile)
+
+public:
+    explicit WriteBehindFile(int fd, QObject *parent = 0);
+    virtual ~WriteBehindFile();
+
+    /** Id of the transfer in TransferMetrics */
+    void setMetricsId(int id);
+
+    /**
+     * Hashes the content of the whole file with \p algorithm. Data already in
+     * the file before the first write, e.g. when resuming, is read back
+     * once. Must be called before the first write.
+     */
+    void enableHashing(QCryptographicHash::Algorithm algorithm);
+    /**
+     * Hash of the content of the file, to be called once the queue is
+     * drained. Empty if hashing is not enabled, the data was not written
+     * sequentially or the queue is not drained yet.
+     */
+    QByteArray hashResult();
+
+    /**
+     * Records the chunks written in \p manifest, from the I/O threads. Must be
+     * called before the first write.
+     */
+    void setChunkManifest(const QSharedPointer<ChunkManifest> &manifest);
+
+    /**
+     * How the I/O threads use the page cache, see PageCacheIo. Must be
+     * called before the first write. Returns the mode actually used, Direct
+     * falls back to DropBehind if the file cannot be opened with O_DIRECT.
+     */
+    PageCacheIo::Mode setIoMode(PageCacheIo::Mode mode);
+
+    virtual bool isSequential() const;
+    virtual void close();
+
+    /** True if all the data written so far reached the file */
+    bool isDrained() const;
+    /**
+     * True once more than a few megabytes are queued, until the I/O threads
+     * wrote half of them and spaceAvailable() is emitted
+     */
+    bool isFull() const;
+
+Q_SIGNALS:
+    /** Emitted every time the queue becomes empty */
+    void drained();
+    /** The queue is not full anymore */
+    void spaceAvailable();
+    void writeFailed(const QString &errorMessage);
+
+protected:
+    virtual qint64 readData(char *data, qint64 maxSize);
+    virtual qint64 writeData(const char *data, qint64 size);
+
+private Q_SLOTS:
+    void onDrained();
+    void onWriteFailed(const QString &errorMessage);
+    void onSpaceAvailable();
+
+private:
+    QSharedPointer<WriteBehindQueue> m_queue;
+};
+
+#endif // WRITE_BEHIND_FILE_H